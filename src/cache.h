@@ -204,7 +204,15 @@ struct ShaderCache {
     }
 };
 
+// by default ambient cubes are computed on the CPU from the room data (vertex colors, lights and sky)
+// projected into L2 spherical harmonics, AMBIENT_GPU renders the environment from the sector instead
+//#define AMBIENT_GPU
+
 struct AmbientCache {
+    #define AMBIENT_TASKS       32
+    #define AMBIENT_ALBEDO      0.5f    // average texture brightness, the surfaces are untextured here
+    #define AMBIENT_LIGHT       0.25f   // room lights weight
+
     IGame     *game;
     TR::Level *level;
 
@@ -221,10 +229,33 @@ struct AmbientCache {
         int  flip;
         int  sector;
         Cube *cube;
-    } tasks[32];
+    #ifndef AMBIENT_GPU
+    // snapshot of the room data, flipMap swaps the rooms while the worker reads them
+        vec3           pos;
+        TR::Room::Info info;
+        TR::Room::Data data;
+        TR::Room::Light *lights;
+        int            lightsCount;
+        int            ambient;
+        bool           sky;
+        vec4           colors[6];
+    #endif
+    } tasks[AMBIENT_TASKS];
     int tasksCount;
 
+#ifdef AMBIENT_GPU
     Texture *textures[6 * 4]; // 64, 16, 4, 1 
+#else
+    Task results[AMBIENT_TASKS];
+    int  resultsCount;
+
+    #ifdef OS_PTHREAD_MT
+        pthread_t       thread;
+        pthread_mutex_t mutex;
+        pthread_cond_t  cond;
+        bool            running;
+    #endif
+#endif
 
     AmbientCache(IGame *game) : game(game), level(game->getLevel()), tasksCount(0) {
         items   = NULL;
@@ -238,39 +269,82 @@ struct AmbientCache {
     // init cache buffer
         items = new Cube[sectors];
         memset(items, 0, sizeof(Cube) * sectors);
+    #ifdef AMBIENT_GPU
     // init downsample textures
         for (int j = 0; j < 6; j++)
             for (int i = 0; i < 4; i++)
                 textures[j * 4 + i] = new Texture(64 >> (i << 1), 64 >> (i << 1), 1, FMT_RGBA, OPT_TARGET | OPT_NEAREST);
+    #else
+        resultsCount = 0;
+        #ifdef OS_PTHREAD_MT
+            pthread_mutex_init(&mutex, NULL);
+            pthread_cond_init(&cond, NULL);
+            running = pthread_create(&thread, NULL, workerThread, this) == 0;
+        #endif
+    #endif
     }
 
     ~AmbientCache() {
+    #if !defined(AMBIENT_GPU) && defined(OS_PTHREAD_MT)
+        if (running) {
+            pthread_mutex_lock(&mutex);
+            running = false;
+            pthread_cond_signal(&cond);
+            pthread_mutex_unlock(&mutex);
+            pthread_join(thread, NULL);
+        }
+        pthread_cond_destroy(&cond);
+        pthread_mutex_destroy(&mutex);
+    #endif
         delete[] items;
         delete[] offsets;
+    #ifdef AMBIENT_GPU
         for (int i = 0; i < 6 * 4; i++)
             delete textures[i];
+    #endif
+    }
+
+    static vec3 getSectorPos(const TR::Room &r, int sector) {
+        const TR::Room::Sector &s = r.sectors[sector];
+        return vec3(float((sector / r.zSectors) * 1024 + 512 + r.info.x),
+                    float(max((s.floor - 2) * 256, (s.floor + s.ceiling) * 256 / 2)),
+                    float((sector % r.zSectors) * 1024 + 512 + r.info.z));
     }
 
     void addTask(int room, int sector) {
-        if (tasksCount >= COUNT(tasks)) return;
-
-        Task &task  = tasks[tasksCount++];
-        task.room   = room;
-        task.flip   = level->state.flags.flipped && level->rooms[room].alternateRoom > -1;
-        task.sector = sector;
-        task.cube   = &items[offsets[room] + sector];
-        task.cube->status = Cube::WAIT;
+    #if !defined(AMBIENT_GPU) && defined(OS_PTHREAD_MT)
+        pthread_mutex_lock(&mutex);
+    #endif
+        if (tasksCount < COUNT(tasks)) {
+            Task &task  = tasks[tasksCount++];
+            task.room   = room;
+            task.flip   = level->state.flags.flipped && level->rooms[room].alternateRoom > -1;
+            task.sector = sector;
+            task.cube   = &items[offsets[room] + sector];
+            task.cube->status = Cube::WAIT;
+
+        #ifndef AMBIENT_GPU
+            TR::Room &r = level->rooms[room];
+            task.pos         = getSectorPos(r, task.flip ? sector - r.xSectors * r.zSectors : sector);
+            task.info        = r.info;
+            task.data        = r.data;
+            task.lights      = r.lights;
+            task.lightsCount = r.lightsCount;
+            task.ambient     = r.ambient;
+            task.sky         = r.flags.sky;
+        #endif
+        }
+    #if !defined(AMBIENT_GPU) && defined(OS_PTHREAD_MT)
+        pthread_cond_signal(&cond);
+        pthread_mutex_unlock(&mutex);
+    #endif
     }
 
+#ifdef AMBIENT_GPU
     void renderAmbient(int room, int sector, vec4 *colors) {
         PROFILE_MARKER("PASS_AMBIENT");
-                
-        TR::Room &r = level->rooms[room];
-        TR::Room::Sector &s = r.sectors[sector];
-            
-        vec3 pos = vec3(float((sector / r.zSectors) * 1024 + 512 + r.info.x), 
-                        float(max((s.floor - 2) * 256, (s.floor + s.ceiling) * 256 / 2)),
-                        float((sector % r.zSectors) * 1024 + 512 + r.info.z));
+
+        vec3 pos = getSectorPos(level->rooms[room], sector);
 
         Core::setClearColor(vec4(0, 0, 0, 1));
 
@@ -335,6 +409,178 @@ struct AmbientCache {
         }
         tasksCount = 0;
     }
+#else
+    struct SH {
+        vec3 c[9];
+
+        SH() {
+            for (int i = 0; i < 9; i++)
+                c[i] = vec3(0.0f);
+        }
+
+        static void basis(const vec3 &n, float *Y) {
+            Y[0] = 0.282095f;
+            Y[1] = 0.488603f * n.y;
+            Y[2] = 0.488603f * n.z;
+            Y[3] = 0.488603f * n.x;
+            Y[4] = 1.092548f * n.x * n.y;
+            Y[5] = 1.092548f * n.y * n.z;
+            Y[6] = 0.315392f * (3.0f * n.z * n.z - 1.0f);
+            Y[7] = 1.092548f * n.x * n.z;
+            Y[8] = 0.546274f * (n.x * n.x - n.y * n.y);
+        }
+
+        void add(const vec3 &dir, const vec3 &color) {
+            float Y[9];
+            basis(dir, Y);
+            for (int i = 0; i < 9; i++)
+                c[i] += color * Y[i];
+        }
+
+    // average incoming radiance weighted by the cosine lobe around the normal (irradiance / PI)
+        vec3 irradiance(const vec3 &n) const {
+            static const float band[9] = { 1.0f, 2.0f / 3.0f, 2.0f / 3.0f, 2.0f / 3.0f, 0.25f, 0.25f, 0.25f, 0.25f, 0.25f };
+            float Y[9];
+            basis(n, Y);
+            vec3 e(0.0f);
+            for (int i = 0; i < 9; i++)
+                e += c[i] * (band[i] * Y[i]);
+            return e;
+        }
+    };
+
+    static vec3 getColor(const Color32 &c) {
+        return vec3(c.r, c.g, c.b) * (1.0f / 255.0f);
+    }
+
+    static void computeAmbient(Task &task) {
+        SH sh;
+
+        const TR::Room::Data &d = task.data;
+        vec3 offset = vec3(float(task.info.x), 0.0f, float(task.info.z));
+        float weight = 0.0f;
+
+    // every face is an emitter of its vertex light, weighted by the solid angle it covers
+        for (int i = 0; i < d.fCount; i++) {
+            const TR::Face &f = d.faces[i];
+            int count = f.triangle ? 3 : 4;
+
+            vec3 p[4], color(0.0f), center(0.0f);
+            for (int j = 0; j < count; j++) {
+                const TR::Room::Data::Vertex &v = d.vertices[f.vertices[j]];
+                p[j]    = vec3(v.pos) + offset;
+                center += p[j];
+                color  += getColor(v.color);
+            }
+            center *= 1.0f / count;
+            color  *= AMBIENT_ALBEDO / count;
+
+            vec3 n = f.triangle ? (p[1] - p[0]).cross(p[2] - p[0]) : (p[2] - p[0]).cross(p[3] - p[1]);
+            float area = n.length() * 0.5f;
+
+            vec3 dir = center - task.pos;
+            float dist2 = dir.length2();
+            if (area <= 0.0f || dist2 < 1.0f)
+                continue;
+
+            dir *= 1.0f / sqrtf(dist2);
+
+        // solid angle of a disk with the projected area of the face
+            float w = 2.0f * PI * (1.0f - 1.0f / sqrtf(1.0f + area * fabsf(n.normal().dot(dir)) / (PI * dist2)));
+            sh.add(dir, color * w);
+            weight += w;
+        }
+
+    // faces overlap each other, normalize to the whole sphere or fill the uncovered part
+        float ambient = 1.0f - clamp(task.ambient / 8191.0f, 0.0f, 1.0f);
+        if (weight > 4.0f * PI) {
+            float k = 4.0f * PI / weight;
+            for (int i = 0; i < 9; i++)
+                sh.c[i] *= k;
+        } else {
+            float missing = 4.0f * PI - weight;
+            if (task.sky) // the open part of the sky rooms is above
+                sh.add(vec3(0.0f, -1.0f, 0.0f), vec3(ambient * missing));
+            else
+                sh.c[0] += vec3(ambient * AMBIENT_ALBEDO * missing * 0.282095f);
+        }
+
+    // room lights, the same falloff as TR::Room::getAmbient
+        for (int i = 0; i < task.lightsCount; i++) {
+            const TR::Room::Light &light = task.lights[i];
+            if (light.intensity > 8192)
+                continue;
+
+            vec3 dir = vec3(float(light.x), float(light.y), float(light.z)) - task.pos;
+            float D = dir.length2() / 4096.0f;
+            float R = SQR(float(light.radius >> 1)) / 4096.0f;
+            float value = light.intensity * R / max(1.0f, D + R) / 8191.0f;
+
+            vec3 color = vec3(light.color.r, light.color.g, light.color.b) * (1.0f / 255.0f);
+            sh.add(dir.normal(), color * (value * AMBIENT_LIGHT * 4.0f * PI));
+        }
+
+        static const vec3 axis[6] = {
+            vec3( 1, 0, 0), vec3(-1, 0, 0),
+            vec3( 0, 1, 0), vec3( 0,-1, 0),
+            vec3( 0, 0, 1), vec3( 0, 0,-1),
+        };
+
+        for (int j = 0; j < 6; j++) {
+            vec3 c = sh.irradiance(axis[j]);
+            task.colors[j] = vec4(clamp(c.x, 0.0f, 1.0f), clamp(c.y, 0.0f, 1.0f), clamp(c.z, 0.0f, 1.0f), 1.0f);
+        }
+    }
+
+    #ifdef OS_PTHREAD_MT
+        static void* workerThread(void *arg) {
+            AmbientCache *cache = (AmbientCache*)arg;
+
+            pthread_mutex_lock(&cache->mutex);
+            while (cache->running) {
+                if (!cache->tasksCount || cache->resultsCount >= AMBIENT_TASKS) {
+                    pthread_cond_wait(&cache->cond, &cache->mutex);
+                    continue;
+                }
+
+                Task task = cache->tasks[--cache->tasksCount];
+                pthread_mutex_unlock(&cache->mutex);
+
+                computeAmbient(task);
+
+                pthread_mutex_lock(&cache->mutex);
+                cache->results[cache->resultsCount++] = task;
+            }
+            pthread_mutex_unlock(&cache->mutex);
+            return NULL;
+        }
+    #endif
+
+    void processQueue() {
+    #ifdef OS_PTHREAD_MT
+        pthread_mutex_lock(&mutex);
+        if (!running)
+    #endif
+        {   // no worker, compute in place
+            while (tasksCount && resultsCount < AMBIENT_TASKS) {
+                Task &task = results[resultsCount++] = tasks[--tasksCount];
+                computeAmbient(task);
+            }
+        }
+
+        for (int i = 0; i < resultsCount; i++) {
+            Task &task = results[i];
+            memcpy(task.cube->colors, task.colors, sizeof(task.colors));
+            task.cube->status = Cube::READY;
+        }
+        resultsCount = 0;
+
+    #ifdef OS_PTHREAD_MT
+        pthread_cond_signal(&cond);
+        pthread_mutex_unlock(&mutex);
+    #endif
+    }
+#endif
 
     Cube* getAmbient(int roomIndex, int x, int z) {
         TR::Room &r = level->rooms[roomIndex];
@@ -432,12 +678,196 @@ struct WaterCache {
     #define DETAIL             (WATER_TILE_SIZE / 1024.0f)
     #define MAX_DROPS          32
 
+// GAPI::SW has no render targets, the surface is simulated on the CPU
+#ifdef _GAPI_SW
+    #define WATER_CPU
+#endif
+
     IGame     *game;
     TR::Level *level;
     Texture   *screen;
     Texture   *refract;
     Texture   *reflect;
 
+    struct Drop {
+        vec3  pos;
+        float radius;
+        float strength;
+        Drop() {}
+        Drop(const vec3 &pos, float radius, float strength) : pos(pos), radius(radius), strength(strength) {}
+    };
+
+#ifdef WATER_CPU
+    #define WATER_LOOKUP_SHIFT  2      // lookup texel per 4x4 cells
+    #define WATER_MAX_STEPS     8
+    #define WATER_VELOCITY      358    // 1.4 / 4 in 1/1024
+    #define WATER_VISCOSITY     1019   // 0.995 in 1/1024
+    #define WATER_NOISE         256
+    #define WATER_CAUSTICS_BASE 51     // flat surface, 0.2 as in water_caustics
+
+// height field in 2.14 fixed point, the same integration as water_simulate
+    struct Surface {
+        int    w, h;                // sectors
+        int    width, height;       // cells
+        int    stride;
+        uint8  *mask;               // per sector
+        int16  *field[2];           // heights with one cell border, current and next
+        int16  *speed;
+        int    lookupWidth, lookupHeight;
+        uint8  *caustics[2];        // [0] is bound to the rasterizer, [1] is written by the simulation
+        int8   *slope[2];           // dx, dz pairs for refraction
+        bool   ready;
+        int    steps;
+        int    dropsCount;
+        Drop   drops[MAX_DROPS];    // in cells
+        uint32 seed;
+
+        Surface(const uint8 *m, int w, int h) : w(w), h(h), ready(false), steps(0), dropsCount(0), seed(w * 31 + h) {
+            width  = w * WATER_TILE_SIZE;
+            height = h * WATER_TILE_SIZE;
+            stride = width + 2;
+
+            mask = new uint8[w * h];
+            memcpy(mask, m, w * h * sizeof(mask[0]));
+
+            for (int i = 0; i < 2; i++) {
+                field[i] = new int16[stride * (height + 2)];
+                memset(field[i], 0, stride * (height + 2) * sizeof(field[i][0]));
+            }
+            speed = new int16[width * height];
+            memset(speed, 0, width * height * sizeof(speed[0]));
+
+            lookupWidth  = width  >> WATER_LOOKUP_SHIFT;
+            lookupHeight = height >> WATER_LOOKUP_SHIFT;
+            for (int i = 0; i < 2; i++) {
+                caustics[i] = new uint8[lookupWidth * lookupHeight];
+                slope[i]    = new int8[lookupWidth * lookupHeight * 2];
+                memset(caustics[i], 0, lookupWidth * lookupHeight * sizeof(caustics[i][0]));
+                memset(slope[i],    0, lookupWidth * lookupHeight * 2 * sizeof(slope[i][0]));
+            }
+        }
+
+        ~Surface() {
+            for (int i = 0; i < 2; i++) {
+                delete[] field[i];
+                delete[] caustics[i];
+                delete[] slope[i];
+            }
+            delete[] speed;
+            delete[] mask;
+        }
+
+        uint32 random() {
+            seed = seed * 1103515245 + 12345;
+            return seed >> 8;
+        }
+
+        void drop(const Drop &d) {
+            int x0 = max(0, int(d.pos.x - d.radius)), x1 = min(width  - 1, int(d.pos.x + d.radius));
+            int z0 = max(0, int(d.pos.z - d.radius)), z1 = min(height - 1, int(d.pos.z + d.radius));
+
+            for (int z = z0; z <= z1; z++)
+                for (int x = x0; x <= x1; x++) {
+                    float k = max(0.0f, 1.0f - sqrtf(SQR(x - d.pos.x) + SQR(z - d.pos.z)) / d.radius);
+                    k = 0.5f - cosf(k * PI) * 0.5f;
+                    int16 &value = field[0][(z + 1) * stride + x + 1];
+                    value = int16(clamp(value - int32(k * d.strength * 16384.0f), -32767, 32767));
+                }
+        }
+
+        void step() {
+            const int16 *src = field[0] + stride + 1;
+            int16 *dst = field[1] + stride + 1;
+            int16 *spd = speed;
+
+            for (int z = 0; z < height; z++) {
+                const uint8 *m = mask + (z / WATER_TILE_SIZE) * w;
+            // straight loops over the sector cells, auto-vectorized by the compiler
+                for (int s = 0; s < w; s++) {
+                    if (m[s]) {
+                        for (int x = 0; x < WATER_TILE_SIZE; x++) {
+                            int32 sum = src[x - 1] + src[x + 1] + src[x - stride] + src[x + stride];
+                            int32 v = spd[x] + (sum - (src[x] << 2)) * WATER_VELOCITY / 1024;
+                            v = clamp(v * WATER_VISCOSITY / 1024, -32767, 32767);
+                            spd[x] = int16(v);
+                            dst[x] = int16(clamp(src[x] + v, -32767, 32767));
+                        }
+                    } else {
+                        memset(dst, 0, WATER_TILE_SIZE * sizeof(dst[0]));
+                        memset(spd, 0, WATER_TILE_SIZE * sizeof(spd[0]));
+                    }
+                    src += WATER_TILE_SIZE;
+                    dst += WATER_TILE_SIZE;
+                    spd += WATER_TILE_SIZE;
+                }
+                src += 2;
+                dst += 2;
+            }
+            swap(field[0], field[1]);
+
+        // a few random impulses per sector keep the surface alive
+            for (int i = 0; i < w * h * 4; i++) {
+                int x = random() % width;
+                int z = random() % height;
+                if (!mask[(z / WATER_TILE_SIZE) * w + x / WATER_TILE_SIZE]) continue;
+                int16 &value = field[0][(z + 1) * stride + x + 1];
+                value = int16(clamp(value + ((random() & 1) ? WATER_NOISE : -WATER_NOISE), -32767, 32767));
+            }
+        }
+
+        void updateLookup() {
+            const int d = 1 << (WATER_LOOKUP_SHIFT - 1);
+            uint8 *c  = caustics[1];
+            int8  *sl = slope[1];
+
+            for (int lz = 0; lz < lookupHeight; lz++) {
+                int z = (lz << WATER_LOOKUP_SHIFT) + d;
+                const uint8 *m = mask + (z / WATER_TILE_SIZE) * w;
+
+                for (int lx = 0; lx < lookupWidth; lx++, c++, sl += 2) {
+                    int x = (lx << WATER_LOOKUP_SHIFT) + d;
+
+                    if (!m[x / WATER_TILE_SIZE]) {
+                        c[0] = 0;
+                        sl[0] = sl[1] = 0;
+                        continue;
+                    }
+
+                    const int16 *p = field[0] + (z + 1) * stride + x + 1;
+                    int32 dx  = p[d] - p[-d];
+                    int32 dz  = p[d * stride] - p[-d * stride];
+                    int32 lap = p[d] + p[-d] + p[d * stride] + p[-d * stride] - (p[0] << 2);
+                // light focuses under the crests
+                    c[0]  = uint8(clamp(WATER_CAUSTICS_BASE - lap / 16, 0, 255));
+                    sl[0] = int8(clamp(dx / 32, -127, 127));
+                    sl[1] = int8(clamp(dz / 32, -127, 127));
+                }
+            }
+        }
+
+        void simulate() {
+            for (int i = 0; i < dropsCount; i++)
+                drop(drops[i]);
+            dropsCount = 0;
+
+            while (steps > 0) {
+                step();
+                steps--;
+            }
+
+            updateLookup();
+            ready = true;
+        }
+
+        void swapLookup() {
+            if (!ready) return;
+            swap(caustics[0], caustics[1]);
+            swap(slope[0], slope[1]);
+            ready = false;
+        }
+    };
+#endif
+
     struct Item {
         int     from, to, caust;
         float   timer;
@@ -448,13 +878,22 @@ struct WaterCache {
         Texture *mask;
         Texture *caustics;
         Texture *data[2];
+    #ifdef WATER_CPU
+        Surface *surface;
+    #endif
 
         Item() {
             mask = caustics = data[0] = data[1] = NULL;
+        #ifdef WATER_CPU
+            surface = NULL;
+        #endif
         }
 
         Item(int from, int to) : from(from), to(to), caust(to), timer(SIMULATE_TIMESTEP), visible(true), blank(true) {
             mask = caustics = data[0] = data[1] = NULL;
+        #ifdef WATER_CPU
+            surface = NULL;
+        #endif
         }
 
         void init(IGame *game) {
@@ -517,12 +956,21 @@ struct WaterCache {
 
                     m[(x - minX) + w * (z - minZ)] = hasWater ? 0xFF : 0x00; // TODO: flow map
                 }
+        #ifdef WATER_CPU
+            surface = new Surface(m, w, h);
+        #else
             mask = new Texture(w, h, 1, FMT_LUMINANCE, OPT_NEAREST, m);
+        #endif
             delete[] m;
 
             size = vec3(float((maxX - minX) * 512), 1.0f, float((maxZ - minZ) * 512)); // half size
             pos  = vec3(r.info.x + minX * 1024 + size.x, float(posY), r.info.z + minZ * 1024 + size.z);
 
+        #ifdef WATER_CPU
+            blank = false;
+            return;
+        #endif
+
             int *mf = new int[4 * w * h * SQR(WATER_TILE_SIZE)];
             memset(mf, 0, sizeof(int) * 4 * w * h * SQR(WATER_TILE_SIZE));
             data[0] = new Texture(w * WATER_TILE_SIZE, h * WATER_TILE_SIZE, 1, FMT_RG_HALF, OPT_TARGET | OPT_VERTEX, mf);
@@ -540,25 +988,59 @@ struct WaterCache {
             delete caustics;
             delete mask;
             mask = caustics = data[0] = data[1] = NULL;
+        #ifdef WATER_CPU
+            delete surface;
+            surface = NULL;
+        #endif
         }
 
     } items[MAX_SURFACES];
     int count, visible;
 
-    int dropCount;
-    struct Drop {
-        vec3  pos;
-        float radius;
-        float strength;
-        Drop() {}
-        Drop(const vec3 &pos, float radius, float strength) : pos(pos), radius(radius), strength(strength) {}
-    } drops[MAX_DROPS];
+    int  dropCount;
+    Drop drops[MAX_DROPS];
+
+#ifdef WATER_CPU
+    Surface *jobs[MAX_SURFACES];
+    int     jobsCount;
+
+    #ifdef OS_PTHREAD_MT
+        pthread_t       thread;
+        pthread_mutex_t mutex;
+        pthread_cond_t  cond;
+        pthread_cond_t  done;
+        bool            running;
+    #endif
+#endif
 
     WaterCache(IGame *game) : game(game), level(game->getLevel()), screen(NULL), refract(NULL), count(0), dropCount(0) {
+    #ifdef WATER_CPU
+        reflect   = NULL;
+        jobsCount = 0;
+        #ifdef OS_PTHREAD_MT
+            pthread_mutex_init(&mutex, NULL);
+            pthread_cond_init(&cond, NULL);
+            pthread_cond_init(&done, NULL);
+            running = pthread_create(&thread, NULL, workerThread, this) == 0;
+        #endif
+    #else
         reflect = new Texture(512, 512, 1, FMT_RGBA, OPT_TARGET);
+    #endif
     }
 
     ~WaterCache() {
+    #if defined(WATER_CPU) && defined(OS_PTHREAD_MT)
+        if (running) {
+            pthread_mutex_lock(&mutex);
+            running = false;
+            pthread_cond_signal(&cond);
+            pthread_mutex_unlock(&mutex);
+            pthread_join(thread, NULL);
+        }
+        pthread_cond_destroy(&done);
+        pthread_cond_destroy(&cond);
+        pthread_mutex_destroy(&mutex);
+    #endif
         delete screen;
         delete refract;
         delete reflect;
@@ -571,6 +1053,7 @@ struct WaterCache {
         while (i < count) {
             Item &item = items[i];
             if (item.timer > MAX_INVISIBLE_TIME) {
+                sync();
                 items[i].deinit();
                 items[i] = items[--count];
                 continue;
@@ -592,6 +1075,7 @@ struct WaterCache {
                 int j = 0;
                 while (j < count) {
                     if (items[j].from == i || items[j].to == i) {
+                        sync();
                         items[j].deinit();
                         items[j] = items[--count];
                     } else
@@ -650,6 +1134,19 @@ struct WaterCache {
                 break;
             }
 
+    #ifdef WATER_CPU
+        Surface *surface = item ? item->surface : NULL;
+        if (surface) {
+            bool caustics = Core::settings.detail.water > Core::Settings::MEDIUM;
+            bool refract  = !((Camera*)game->getCamera())->isUnderwater(); // looking through the surface
+            GAPI::setWaterLookup(caustics ? surface->caustics[0] : NULL, refract ? surface->slope[0] : NULL, surface->lookupWidth, surface->lookupHeight,
+                                 vec4(item->pos.x - item->size.x, item->pos.z - item->size.z, DETAIL / (1 << WATER_LOOKUP_SHIFT), 0.0f));
+            game->setWaterParams(item->pos.y);
+        } else
+            GAPI::setWaterLookup(NULL, NULL, 0, 0, vec4(0.0f));
+        return;
+    #endif
+
         if (item && item->caustics) {
             item->caustics->bind(sReflect);
             Core::active.shader->setParam(uRoomSize, vec4(item->pos.x - item->size.x, item->pos.z - item->size.z, item->size.x * 2.0f, item->size.z * 2.0f));
@@ -741,7 +1238,7 @@ struct WaterCache {
     }
 
     void renderRays() {
-        #ifdef _OS_PSV // TODO
+        #if defined(_OS_PSV) || defined(WATER_CPU) // TODO
             return;
         #endif
         if (!visible) return;
@@ -777,6 +1274,9 @@ struct WaterCache {
     }
 
     void renderMask() {
+        #ifdef WATER_CPU
+            return;
+        #endif
         if (!visible) return;
         PROFILE_MARKER("WATER_MASK");
     // mask underwater geometry by zero alpha
@@ -805,6 +1305,9 @@ struct WaterCache {
 
 
     Texture* getScreenTex() {
+        #ifdef WATER_CPU
+            return NULL;
+        #endif
         int w = Core::viewportDef.z;
         int h = Core::viewportDef.w;
     // get refraction texture
@@ -821,6 +1324,9 @@ struct WaterCache {
     }
 
     void copyScreenToRefraction() {
+        #ifdef WATER_CPU
+            return;
+        #endif
         PROFILE_MARKER("WATER_REFRACT_COPY");
     // get refraction texture
         int x, y;
@@ -846,6 +1352,96 @@ struct WaterCache {
         }
     }
 
+#ifdef WATER_CPU
+    #ifdef OS_PTHREAD_MT
+        static void* workerThread(void *arg) {
+            WaterCache *cache = (WaterCache*)arg;
+
+            pthread_mutex_lock(&cache->mutex);
+            while (cache->running) {
+                if (!cache->jobsCount) {
+                    pthread_cond_wait(&cache->cond, &cache->mutex);
+                    continue;
+                }
+
+            // the main thread doesn't touch the jobs until they are done
+                Surface *surface = cache->jobs[cache->jobsCount - 1];
+                pthread_mutex_unlock(&cache->mutex);
+
+                surface->simulate();
+
+                pthread_mutex_lock(&cache->mutex);
+                if (!--cache->jobsCount)
+                    pthread_cond_signal(&cache->done);
+            }
+            pthread_mutex_unlock(&cache->mutex);
+            return NULL;
+        }
+    #endif
+
+// wait for the surfaces queued by the previous simulate call
+    void sync() {
+    #ifdef OS_PTHREAD_MT
+        pthread_mutex_lock(&mutex);
+        while (running && jobsCount)
+            pthread_cond_wait(&done, &mutex);
+        pthread_mutex_unlock(&mutex);
+    #endif
+    }
+
+    void simulate() {
+        PROFILE_MARKER("WATER_SIMULATE");
+        sync();
+
+        Surface *queue[MAX_SURFACES];
+        int queueCount = 0;
+
+        for (int i = 0; i < count; i++) {
+            Item &item = items[i];
+            if (!item.visible) continue;
+
+            if (item.blank)
+                item.init(game);
+
+            Surface *surface = item.surface;
+            surface->swapLookup();
+
+            if (item.timer < SIMULATE_TIMESTEP && !dropCount) continue;
+
+            item.timer = min(item.timer, SIMULATE_TIMESTEP * WATER_MAX_STEPS);
+            surface->steps = int(item.timer / SIMULATE_TIMESTEP);
+            item.timer -= surface->steps * SIMULATE_TIMESTEP;
+
+        // add water drops
+            for (int j = 0; j < dropCount && surface->dropsCount < MAX_DROPS; j++) {
+                Drop &drop = drops[j];
+                vec3 p;
+                p.x = (drop.pos.x - (item.pos.x - item.size.x)) * DETAIL;
+                p.y = 0.0f;
+                p.z = (drop.pos.z - (item.pos.z - item.size.z)) * DETAIL;
+                surface->drops[surface->dropsCount++] = Drop(p, drop.radius * DETAIL, drop.strength);
+            }
+
+            queue[queueCount++] = surface;
+        }
+        dropCount = 0;
+
+    #ifdef OS_PTHREAD_MT
+        if (running) {
+            pthread_mutex_lock(&mutex);
+            memcpy(jobs, queue, queueCount * sizeof(queue[0]));
+            jobsCount = queueCount;
+            pthread_cond_signal(&cond);
+            pthread_mutex_unlock(&mutex);
+            return;
+        }
+    #endif
+        for (int i = 0; i < queueCount; i++)
+            queue[i]->simulate();
+    }
+#else
+    void sync() {}
+
     void simulate() {
         PROFILE_MARKER("WATER_SIMULATE");
     // simulate water
@@ -866,8 +1462,12 @@ struct WaterCache {
         }
         Core::setDepthTest(true);
     }
+#endif
 
     void renderReflection() {
+        #ifdef WATER_CPU
+            return;
+        #endif
         if (!visible) return;
         PROFILE_MARKER("WATER_REFLECT");
 
@@ -935,6 +1535,9 @@ struct WaterCache {
     }
 
     void compose() {
+        #ifdef WATER_CPU
+            return;
+        #endif
         if (!visible) return;
         PROFILE_MARKER("WATER_COMPOSE");
         for (int i = 0; i < count; i++) {
@@ -1035,6 +1638,8 @@ struct WaterCache {
     #undef DETAIL
 };
 
+#define MAX_FLOW_FIELDS 8
+
 struct ZoneCache {
 
     struct Item {
@@ -1053,22 +1658,40 @@ struct ZoneCache {
         }
     } *items;
 
+// next box toward the target box for every box of the target zone (shared by all enemies with the same params)
+    struct FlowField {
+        uint16 *zones;
+        uint16 target;
+        int    ascend;
+        int    descend;
+        bool   big;
+        int    lastUse;
+        uint16 *next;
+    } flows[MAX_FLOW_FIELDS];
+
     IGame  *game;
     // dummy arrays for path search
     uint16 *nodes;
-    uint16 *parents;
     uint16 *weights;
+    uint16 *flowData;
+    int    flowUse;
 
-    ZoneCache(IGame *game) : items(NULL), game(game) {
+    ZoneCache(IGame *game) : items(NULL), game(game), flowUse(0) {
         TR::Level *level = game->getLevel();
-        nodes   = new uint16[level->boxesCount * 3];
-        parents = nodes + level->boxesCount;
-        weights = nodes + level->boxesCount * 2;
+        nodes    = new uint16[level->boxesCount * 2];
+        weights  = nodes + level->boxesCount;
+        flowData = new uint16[level->boxesCount * MAX_FLOW_FIELDS];
+
+        memset(flows, 0, sizeof(flows));
+        for (int i = 0; i < MAX_FLOW_FIELDS; i++) {
+            flows[i].next = flowData + level->boxesCount * i;
+        }
     }
 
     ~ZoneCache() {
         delete   items;
         delete[] nodes;
+        delete[] flowData;
     }
 
     Item *getBoxes(uint16 zone, uint16 *zones) {
@@ -1092,91 +1715,242 @@ struct ZoneCache {
         return items = new Item(zone, count, zones, boxes, items);
     }
 
-    uint16 findPath(int ascend, int descend, bool big, int boxStart, int boxEnd, uint16 *zones, uint16 **boxes) {
-        if (boxStart == TR::NO_BOX || boxEnd == TR::NO_BOX)
-            return 0;
+// call when box blocking state changes (doors)
+    void invalidate() {
+        for (int i = 0; i < MAX_FLOW_FIELDS; i++) {
+            flows[i].zones = NULL;
+        }
+    }
+
+    uint16* getFlowField(int ascend, int descend, bool big, int boxEnd, uint16 *zones) {
+        if (boxEnd == TR::NO_BOX)
+            return NULL;
 
-        TR::Level *level = game->getLevel();
-        memset(parents, 0xFF, sizeof(uint16) * level->boxesCount); // fill parents by 0xFFFF
-        memset(weights, 0x00, sizeof(uint16) * level->boxesCount); // zeroes weights
+        flowUse++;
 
-        uint16 count = 0;
-        nodes[count++] = boxEnd;
+        FlowField *flow = flows;
+        for (int i = 0; i < MAX_FLOW_FIELDS; i++) {
+            FlowField &f = flows[i];
+            if (f.zones == zones && f.target == boxEnd && f.ascend == ascend && f.descend == descend && f.big == big) {
+                f.lastUse = flowUse;
+                return f.next;
+            }
+        // replace free or least recently used field
+            if (!f.zones || (flow->zones && f.lastUse < flow->lastUse))
+                flow = &f;
+        }
+
+        flow->zones   = zones;
+        flow->target  = boxEnd;
+        flow->ascend  = ascend;
+        flow->descend = descend;
+        flow->big     = big;
+        flow->lastUse = flowUse;
+
+        buildFlowField(ascend, descend, big, boxEnd, zones, flow->next);
+
+        return flow->next;
+    }
 
-        uint16 zone = zones[boxStart];
+    void heapPush(int &count, uint16 index) {
+        heapUp(count++, index);
+    }
+
+    void heapUp(int i, uint16 index) {
+        while (i > 0) {
+            int parent = (i - 1) >> 1;
+            if (weights[nodes[parent]] <= weights[index])
+                break;
+            nodes[i] = nodes[parent];
+            i = parent;
+        }
+        nodes[i] = index;
+    }
+
+    uint16 heapPop(int &count) {
+        uint16 top  = nodes[0];
+        uint16 last = nodes[--count];
+        int i = 0;
+        while (true) {
+            int child = i * 2 + 1;
+            if (child >= count)
+                break;
+            if (child + 1 < count && weights[nodes[child + 1]] < weights[nodes[child]])
+                child++;
+            if (weights[last] <= weights[nodes[child]])
+                break;
+            nodes[i] = nodes[child];
+            i = child;
+        }
+        nodes[i] = last;
+        return top;
+    }
 
-        if (zone != zones[boxEnd])
-            return 0;
+// reverse Dijkstra from the target box over the box overlaps graph
+    void buildFlowField(int ascend, int descend, bool big, int boxEnd, uint16 *zones, uint16 *next) {
+        TR::Level *level = game->getLevel();
+        memset(next,    0xFF, sizeof(uint16) * level->boxesCount); // fill by TR::NO_BOX
+        memset(weights, 0xFF, sizeof(uint16) * level->boxesCount);
 
-        TR::Box &b = level->boxes[boxStart];
+        uint16 zone = zones[boxEnd];
 
-        int sx = (b.minX + b.maxX) >> 11; // box center / 1024
-        int sz = (b.minZ + b.maxZ) >> 11;
+        int count = 0;
+        next[boxEnd]    = boxEnd;
+        weights[boxEnd] = 0;
+        heapPush(count, boxEnd);
 
         while (count) {
-            // get min weight
-            int minI  = 0;
-            int minW = weights[nodes[minI]];
-            for (int i = 1; i < count; i++)
-                if (weights[nodes[i]] < minW) {
-                    minI = i;
-                    minW = weights[nodes[i]];
-                }
-            int cur = nodes[minI];
-
-            // peek min weight item from array
-            count--;
-            for (int i = minI; i < count; i++)
-                nodes[i] = nodes[i + 1];
-
-            // check for end of path
-            if (cur == boxStart) {
-                count = 0;
-                while (cur != boxEnd) {
-                    nodes[count++] = cur;
-                    cur = parents[cur];
-                }
-                nodes[count++] = cur;
-                *boxes = nodes;
-                return count;
-            }
+            int cur = heapPop(count);
 
-            // add overlap boxes
-            TR::Box &b = game->getLevel()->boxes[cur];
+            TR::Box &b = level->boxes[cur];
             TR::Overlap *overlap = &level->overlaps[b.overlap.index];
 
+            int cx = (b.minX + b.maxX) >> 11; // box center / 1024
+            int cz = (b.minZ + b.maxZ) >> 11;
+
             do {
                 uint16 index = overlap->boxIndex;
-                // unvisited yet
-                if (parents[index] != 0xFFFF)
-                    continue;
+                TR::Box &n = level->boxes[index];
                 // has same zone
                 if (zones[index] != zone)
                     continue;
                 // check passability
-                if (big && level->boxes[index].overlap.blockable)
+                if (big && n.overlap.blockable)
                     continue;
                 // check blocking (doors)
-                if (level->boxes[index].overlap.block)
+                if (n.overlap.block)
                     continue;
                 // check for height difference
-                int d = level->boxes[index].floor - b.floor;
+                int d = n.floor - b.floor;
                 if (d > ascend || d < descend)
                     continue;
-                
-                int dx = sx - ((b.minX + b.maxX) >> 11);
-                int dz = sz - ((b.minZ + b.maxZ) >> 11);
-                int w = abs(dx) + abs(dz);
 
-                ASSERT(count < level->boxesCount);
-                nodes[count++] = index;
-                parents[index] = cur;
-                weights[index] = weights[cur] + w;
+                int dx = cx - ((n.minX + n.maxX) >> 11);
+                int dz = cz - ((n.minZ + n.maxZ) >> 11);
+                int w  = min(weights[cur] + abs(dx) + abs(dz) + 1, 0xFFFE);
+                // already reached with less weight
+                if (w >= weights[index])
+                    continue;
+
+                bool queued = next[index] != TR::NO_BOX;
+
+                next[index]    = cur;
+                weights[index] = w;
+
+                if (queued) { // decrease key of the queued box
+                    int i = 0;
+                    while (nodes[i] != index) {
+                        i++;
+                        ASSERT(i < count);
+                    }
+                    heapUp(i, index);
+                } else {
+                    ASSERT(count < level->boxesCount);
+                    heapPush(count, index);
+                }
 
             } while (!(overlap++)->end);
         }
+    }
+};
+
+// static room lights precomputed per sector, GAPI::SW lights the entities by a directional light from it
+struct LightCache {
+
+    struct Item {
+        int8  dir[3];       // to the lights
+        uint8 intensity;
+    } *items;
+
+    TR::Level *level;
+    int       *offsets;     // [room * 2 + flipped], -1 if the room has no alternate state
+
+    LightCache(IGame *game) : level(game->getLevel()) {
+        int flip = level->state.flags.flipped;
+
+        offsets = new int[level->roomsCount * 2];
+        int count = 0;
+        for (int i = 0; i < level->roomsCount; i++) {
+            const TR::Room &r = level->rooms[i];
+            offsets[i * 2 + flip]  = count;
+            offsets[i * 2 + !flip] = -1;
+            count += r.xSectors * r.zSectors;
+            if (r.alternateRoom > -1) { // flipMap swaps the rooms data
+                const TR::Room &a = level->rooms[r.alternateRoom];
+                offsets[i * 2 + !flip] = count;
+                count += a.xSectors * a.zSectors;
+            }
+        }
+
+        items = new Item[count];
+        for (int i = 0; i < level->roomsCount; i++) {
+            const TR::Room &r = level->rooms[i];
+            initRoom(r, items + offsets[i * 2 + flip]);
+            if (r.alternateRoom > -1)
+                initRoom(level->rooms[r.alternateRoom], items + offsets[i * 2 + !flip]);
+        }
+    }
+
+    ~LightCache() {
+        delete[] items;
+        delete[] offsets;
+    }
+
+    void initRoom(const TR::Room &r, Item *item) {
+        for (int sector = 0; sector < r.xSectors * r.zSectors; sector++, item++) {
+            vec3 pos = AmbientCache::getSectorPos(r, sector);
+
+        // the same falloff as the main light of GAPI::SW, but for all static lights of the room
+            vec3 light(0.0f);
+            for (int i = 0; i < r.lightsCount; i++) {
+                const TR::Room::Light &l = r.lights[i];
+                if (l.intensity > 8192 || !l.radius)
+                    continue;
+
+                vec3 dir = vec3(float(l.x), float(l.y), float(l.z)) - pos;
+                float radius = min(LIGHT_DIST * 1.5f, float(l.radius));
+                float att = 1.0f - dir.length2() / SQR(radius);
+                if (att <= 0.0f)
+                    continue;
+
+                float intensity = (l.color.r + l.color.g + l.color.b) / 3.0f;
+                light += dir.normal() * (intensity * att);
+            }
+
+            float intensity = light.length();
+            vec3  dir       = intensity > 0.0f ? light * (127.0f / intensity) : vec3(0.0f);
+
+            item->dir[0]    = int8(dir.x);
+            item->dir[1]    = int8(dir.y);
+            item->dir[2]    = int8(dir.z);
+            item->intensity = uint8(min(255.0f, intensity));
+        }
+    }
+
+    vec3 getSectorLight(const TR::Room &r, const Item *items, int x, int z) {
+        const Item &item = items[clamp(x, 0, r.xSectors - 1) * r.zSectors + clamp(z, 0, r.zSectors - 1)];
+        return vec3(item.dir[0], item.dir[1], item.dir[2]) * (item.intensity / 127.0f);
+    }
 
-        return 0;
+// bilinear between the sector centers, direction * intensity
+    vec3 getLight(int roomIndex, const vec3 &pos) {
+        int offset = offsets[roomIndex * 2 + level->state.flags.flipped];
+        if (offset < 0)
+            return vec3(0.0f);
+
+        const TR::Room &r = level->rooms[roomIndex];
+        const Item *items = this->items + offset;
+
+        float fx = (pos.x - r.info.x) / 1024.0f - 0.5f;
+        float fz = (pos.z - r.info.z) / 1024.0f - 0.5f;
+        int x = int(floorf(fx));
+        int z = int(floorf(fz));
+        fx -= x;
+        fz -= z;
+
+        vec3 a = getSectorLight(r, items, x, z).lerp(getSectorLight(r, items, x + 1, z), fx);
+        vec3 b = getSectorLight(r, items, x, z + 1).lerp(getSectorLight(r, items, x + 1, z + 1), fx);
+        return a.lerp(b, fz);
     }
 };
 
@@ -46,6 +46,8 @@ struct Camera : ICamera {
     float       fov, aspect, znear, zfar;
     vec3        lookAngle, targetAngle, viewAngle;
     mat4        mViewInv;
+    mat4        mViewPrev;      // view at the start of the last simulation tick
+    int         viewPrevTick;
 
     float       timer;
 
@@ -76,7 +78,8 @@ struct Camera : ICamera {
         Sound::listener[cameraIndex].matrix.identity();
         Sound::listener[cameraIndex].matrix.translate(vec3(float(0x7FFFFFFF)));
 
-        lookAngle = vec3(0.0f);
+        lookAngle    = vec3(0.0f);
+        viewPrevTick = -1;
 
         changeView(false);
         if (level->isCutsceneLevel()) {
@@ -353,7 +356,19 @@ struct Camera : ICamera {
         if (eye.pos.y < ceiling) eye.pos.y = ceiling;
     }
 
+    mat4 getViewInv() {
+        if (viewPrevTick != Core::tickIndex || Core::tickAlpha >= 1.0f || (mViewPrev.getPos() - mViewInv.getPos()).length2() > SQR(INTERP_MAX_DIST))
+            return mViewInv;
+        Basis b = Basis(mViewPrev).lerp(Basis(mViewInv), Core::tickAlpha);
+        return mat4(b.rot, b.pos);
+    }
+
     virtual void update() {
+        if (viewPrevTick != Core::tickIndex) {
+            mViewPrev    = mViewInv;
+            viewPrevTick = Core::tickIndex;
+        }
+
         if (shake > 0.0f) {
             shake = max(0.0f, shake - Core::deltaTime);
             Input::setJoyVibration(cameraIndex,  clamp(shake, 0.0f, 1.0f), 0);
@@ -633,7 +648,7 @@ struct Camera : ICamera {
 
     virtual void setup(bool calcMatrices) {
         if (calcMatrices) {
-            Core::mViewInv = mViewInv;
+            Core::mViewInv = getViewInv();
 
             if (Core::settings.detail.stereo == Core::Settings::STEREO_VR)
                 Core::mViewInv = Core::mViewInv * Input::hmd.eye[Core::eye == -1.0f ? 0 : 1];
@@ -13,6 +13,8 @@
 
 #define UNLIMITED_AMMO  10000
 
+#define INTERP_MAX_DIST 1024.0f // don't interpolate teleports and camera cuts
+
 struct Controller;
 
 struct ICamera {
@@ -69,7 +71,8 @@ struct IGame {
     virtual Controller*  getLara(const vec3 &pos)   { return NULL; }
     virtual bool         isCutscene()   { return false; }
     virtual uint16       getRandomBox(uint16 zone, uint16 *zones) { return 0; }
-    virtual uint16       findPath(int ascend, int descend, bool big, int boxStart, int boxEnd, uint16 *zones, uint16 **boxes) { return 0; }
+    virtual uint16*      getFlowField(int ascend, int descend, bool big, int boxEnd, uint16 *zones) { return NULL; }
+    virtual void         invalidatePaths() {}
     virtual void         flipMap(bool water = true) {}
     virtual void setWaterParams(float height) {}
     virtual void waterDrop(const vec3 &pos, float radius, float strength) {}
@@ -124,6 +127,9 @@ struct Controller {
 
     Basis   *joints;
     int     jointsFrame;
+    Basis   *jointsPrev;     // pose at the start of the last simulation tick
+    int     jointsPrevCount;
+    int     jointsPrevTick;
 
     vec4    ambient[6];
     float   specular;
@@ -174,6 +180,10 @@ struct Controller {
         joints      = m ? new Basis[m->mCount] : NULL;
         jointsFrame = -1;
 
+        jointsPrev      = NULL;
+        jointsPrevCount = 0;
+        jointsPrevTick  = -1;
+
         specular   = 0.0f;
         intensity  = e.intensity == -1 ? -1.0f : intensityf(e.intensity);
         timer      = 0.0f;
@@ -202,6 +212,7 @@ struct Controller {
 
     virtual ~Controller() {
         delete[] joints;
+        delete[] jointsPrev;
         delete[] layers;
         delete[] explodeParts;
         deactivate(true);
@@ -1428,10 +1439,38 @@ struct Controller {
     }
 
     void updateJoints() {
-        if (Core::stats.frame == jointsFrame)
+        int frame = Core::tickAlpha < 1.0f ? Core::stats.frame : -2; // simulation ticks share the exact pose
+        if (frame == jointsFrame)
             return;
         animation.getJoints(getMatrix(), -1, true, joints);
-        jointsFrame = Core::stats.frame;
+        jointsFrame = frame;
+
+    // render between the last two simulation ticks
+        if (jointsPrevTick == Core::tickIndex && Core::tickAlpha < 1.0f && jointsPrevCount == animation.model->mCount &&
+            (jointsPrev[0].pos - joints[0].pos).length2() < SQR(INTERP_MAX_DIST)) {
+            for (int i = 0; i < jointsPrevCount; i++) {
+                Basis &b = joints[i];
+                b.rot = jointsPrev[i].rot.lerp(b.rot, Core::tickAlpha);
+                b.pos = jointsPrev[i].pos.lerp(b.pos, Core::tickAlpha);
+            }
+        }
+    }
+
+    // called by the level right before the controller update
+    void storePose() {
+        jointsFrame = -1;
+
+        if (!animation.model || !animation.model->mCount || !joints)
+            return;
+
+        if (jointsPrevCount != animation.model->mCount) {
+            delete[] jointsPrev;
+            jointsPrevCount = animation.model->mCount;
+            jointsPrev      = new Basis[jointsPrevCount];
+        }
+
+        animation.getJoints(getMatrix(), -1, true, jointsPrev);
+        jointsPrevTick = Core::tickIndex;
     }
 
     Basis& getJoint(int index) {
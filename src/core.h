@@ -97,6 +97,12 @@
     #define DYNGEOM_NO_VBO
     #define INV_GAMEPAD_ONLY
     #define INV_STEREO
+#elif __SERVER__
+    #define _OS_SERVER  1
+    #define _OS_LINUX   1
+    #define _GAPI_SW    1
+
+    #define _NAPI_SOCKET
 #elif __BITTBOY__ || __MIYOO__
     #define _OS_BITTBOY 1
     #define _OS_LINUX   1
@@ -334,6 +340,8 @@ namespace Core {
     };
 
     float deltaTime;
+    float tickAlpha;    // render position between the last two simulation ticks
+    int32 tickIndex;
     int   lastTime;
     int   x, y, width, height;
 
@@ -408,8 +416,10 @@ namespace Core {
             }
 
             void setWater(Quality value) {
-            #if defined(_GAPI_SW) || defined(_GAPI_GU)
+            #if defined(_GAPI_GU)
                 water = LOW;
+            #elif defined(_GAPI_SW)
+                water = value; // CPU simulation, MEDIUM - refraction, HIGH - caustics
             #else
                 if (value > LOW && !(support.texFloat || support.texHalf))
                     value = LOW;
@@ -759,21 +769,31 @@ namespace Core {
 
     struct Stats {
         uint32 dips, tris, rt, cb, frame, frameIndex, fps;
+        uint32 scale; // render resolution in percent of the screen
         int fpsTime;
+    #ifdef _GAPI_SW
+        uint32 drawn, culled; // triangles passed and rejected by hierarchical-Z
+    #endif
     #ifdef PROFILE
         int tFrame;
         int video;
     #endif
 
-        Stats() : frame(0), frameIndex(0), fps(0), fpsTime(0) {}
+        Stats() : frame(0), frameIndex(0), fps(0), scale(100), fpsTime(0) {}
 
         void start() {
             dips = tris = rt = cb = 0;
+        #ifdef _GAPI_SW
+            drawn = culled = 0;
+        #endif
         }
 
         void stop() {
             if (fpsTime < Core::getTime()) {
-                LOG("FPS: %d DIP: %d TRI: %d RT: %d\n", fps, dips, tris, rt);
+                LOG("FPS: %d DIP: %d TRI: %d RT: %d RES: %d%%\n", fps, dips, tris, rt, scale);
+            #ifdef _GAPI_SW
+                LOG("HiZ: drawn %d culled %d\n", drawn, culled);
+            #endif
             #ifdef PROFILE
                 LOG("frame time: %d mcs\n", tFrame / 1000);
                 LOG("sound: mix %d rev %d ren %d/%d ogg %d\n", Sound::stats.mixer, Sound::stats.reverb, Sound::stats.render[0], Sound::stats.render[1], Sound::stats.ogg);
@@ -873,6 +893,9 @@ namespace Core {
 
         isQuit = false;
 
+        tickAlpha = 1.0f;
+        tickIndex = 0;
+
         Input::init();
         Sound::init();
         NAPI::init();
@@ -1069,6 +1092,10 @@ namespace Core {
         settings.audio.reverb = false;
     #endif
 
+    #if defined(_OS_TNS) || defined(_OS_BITTBOY)
+        settings.detail.setWater    (Core::Settings::LOW);
+    #endif
+
     #ifdef _OS_PSV
         settings.detail.setFilter   (Core::Settings::HIGH);
         settings.detail.setLighting (Core::Settings::LOW);
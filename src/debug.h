@@ -506,16 +506,24 @@ namespace Debug {
         }
 
         void path(TR::Level &level, Enemy *enemy) {
-            Enemy::Path *path = enemy->path;
+            Enemy::Path &path = enemy->path;
 
-            if (!path || !enemy->target) return;
-            for (int i = 0; i < path->count; i++) {
-                TR::Box &b = level.boxes[path->boxes[i]];
-                if (i == path->index)
+            if (!path.isValid() || !enemy->target) return;
+
+            uint16 *flow = enemy->getFlowField();
+            if (!flow) return;
+
+            uint16 index = path.prev;
+            while (index != TR::NO_BOX) {
+                TR::Box &b = level.boxes[index];
+                if (index == path.box)
                     glColor4f(0.5, 0.5, 0.0, 0.5);
                 else
                     glColor4f(0.0, 0.5, 0.0, 0.5);
                 debugBox(b);
+
+                if (index == path.target) break;
+                index = flow[index];
             }
 
             Core::setDepthTest(false);
@@ -747,6 +755,15 @@ namespace Debug {
             char buf[255];
             sprintf(buf, "DIP = %d, TRI = %d, SND = %d, active = %d", Core::stats.dips, Core::stats.tris, Sound::channelsCount, activeCount);
             Debug::Draw::text(vec2(16, y += 16), vec4(1.0f), buf);
+
+            char *ptr = buf + sprintf(buf, "pools (used/max/capacity):");
+            PoolBase *pool = PoolBase::first;
+            while (pool && ptr < buf + sizeof(buf) - 48) {
+                ptr += sprintf(ptr, " %s %d/%d/%d", pool->name, pool->count, pool->highWater, pool->capacity);
+                pool = pool->next;
+            }
+            Debug::Draw::text(vec2(16, y += 16), vec4(1.0f), buf);
+
             vec3 angle = controller->angle * RAD2DEG;
             sprintf(buf, "pos = (%d, %d, %d), angle = (%d, %d), room = %d (camera: %d [%d, %d, %d])", int(controller->pos.x), int(controller->pos.y), int(controller->pos.z), (int)angle.x, (int)angle.y, controller->getRoomIndex(), game->getCamera()->getRoomIndex(), int(viewPos.x), int(viewPos.y), int(viewPos.z));
             Debug::Draw::text(vec2(16, y += 16), vec4(1.0f), buf);
@@ -12,26 +12,27 @@
 
 struct Enemy : Character {
 
+// current step along the shared flow field toward the target box
     struct Path {
-        int16       index;
-        int16       count;
-        uint16      *boxes;
-        TR::Level   *level;
+        uint16 prev;
+        uint16 box;
+        uint16 target;
 
-        Path(TR::Level *level, uint16 *boxes, int count) : index(0), count(count), boxes(new uint16[count]), level(level) {
-            memcpy(this->boxes, boxes, count * sizeof(boxes[0]));
-        }
+        Path() : prev(TR::NO_BOX), box(TR::NO_BOX), target(TR::NO_BOX) {}
 
-        ~Path() {
-            delete[] boxes;
+        bool isValid() const {
+            return target != TR::NO_BOX;
         }
 
-        bool getNextPoint(TR::Level *level, vec3 &point) {
-            if (index >= count - 1)
+        bool getNextPoint(TR::Level *level, uint16 *flow, vec3 &point) {
+            if (!flow || box == target || flow[box] == TR::NO_BOX)
                 return false;
 
-            TR::Box &a = level->boxes[boxes[index++]];
-            TR::Box &b = level->boxes[boxes[index]];
+            TR::Box &a = level->boxes[box];
+            TR::Box &b = level->boxes[flow[box]];
+
+            prev = box;
+            box  = flow[box];
 
             int minX = max(a.minX, b.minX);
             int minZ = max(a.minZ, b.minZ);
@@ -67,7 +68,7 @@ struct Enemy : Character {
     int   hitSound;
 
     Character *target;
-    Path      *path;
+    Path      path;
 
     float targetDist;
     float targetAngle;
@@ -76,16 +77,12 @@ struct Enemy : Character {
     bool  targetFromView;   // enemy in target view zone
     bool  targetCanAttack;
 
-    Enemy(IGame *game, int entity, float health, int radius, float length, float aggression) : Character(game, entity, health), ai(AI_RANDOM), mood(MOOD_SLEEP), wound(false), nextState(0), targetBox(TR::NO_BOX), thinkTime(1.0f / 30.0f), length(length), aggression(aggression), radius(radius), hitSound(-1), target(NULL), path(NULL) {
+    Enemy(IGame *game, int entity, float health, int radius, float length, float aggression) : Character(game, entity, health), ai(AI_RANDOM), mood(MOOD_SLEEP), wound(false), nextState(0), targetBox(TR::NO_BOX), thinkTime(1.0f / 30.0f), length(length), aggression(aggression), radius(radius), hitSound(-1), target(NULL) {
         targetDist   = +INF;
         targetInView = targetFromView = targetCanAttack = false;
         waypoint     = pos;
     }
 
-    virtual ~Enemy() {
-        delete path;
-    }
-
     virtual bool getSaveData(SaveEntity &data) {
         Character::getSaveData(data);
         data.extraSize = sizeof(data.extra.enemy);
@@ -407,7 +404,7 @@ struct Enemy : Character {
         if (targetBox == TR::NO_BOX)
             gotoBox(target->box);
 
-        if (path && this->box != path->boxes[path->index - 1] && this->box != path->boxes[path->index])
+        if (path.isValid() && this->box != path.prev && this->box != path.box)
             targetBoxOld = TR::NO_BOX;
 
         if (zoneOld != zone)
@@ -420,7 +417,7 @@ struct Enemy : Character {
                 targetBox = TR::NO_BOX;
         }
 
-        if (targetBox != TR::NO_BOX && path) {
+        if (targetBox != TR::NO_BOX && path.isValid()) {
             vec3 d = pos - waypoint;
 
             if (fabsf(d.x) < 512 && fabsf(d.y) < 512 && fabsf(d.z) < 512)
@@ -430,8 +427,12 @@ struct Enemy : Character {
         return true;
     }
 
+    uint16* getFlowField() {
+        return game->getFlowField(stepHeight, dropHeight, getEntity().isBigEnemy(), path.target, getZones());
+    }
+
     void nextWaypoint() {
-        if (!path->getNextPoint(level, waypoint))
+        if (!path.getNextPoint(level, getFlowField(), waypoint))
             waypoint = target->pos;
     }
 
@@ -497,17 +498,19 @@ struct Enemy : Character {
     }
 
     bool findPath(int ascend, int descend, bool big) {
-        delete path;
-        path = NULL;
+        path = Path();
 
-        uint16 *boxes;
-        uint16 count = game->findPath(ascend, descend, big, box, targetBox, getZones(), &boxes);
-        if (count) {
-            path = new Path(level, boxes, count);
-            return true;
-        }
+        if (box == TR::NO_BOX)
+            return false;
 
-        return false;
+        uint16 *flow = game->getFlowField(ascend, descend, big, targetBox, getZones());
+        if (!flow || flow[box] == TR::NO_BOX)
+            return false;
+
+        path.prev   = box;
+        path.box    = box;
+        path.target = targetBox;
+        return true;
     }
 
     void shot(TR::Entity::Type type, int joint, const vec3 &offset, float rx, float ry) {
@@ -2075,10 +2075,6 @@ namespace TR {
         Face        *faces;
 
         Mesh() : vertices(0), faces(0) {}
-        ~Mesh() {
-            delete[] vertices;
-            delete[] faces;
-        }
     };
 
     struct Entity {
@@ -3157,7 +3153,53 @@ namespace TR {
         uint32 tsubCount;
         uint8 *tsub;
 
-        Level(Stream &stream) {
+    // all level data arrays are allocated from the arena and released at once with the level
+        enum MemoryTag {
+            MEM_ROOMS,
+            MEM_MESHES,
+            MEM_ANIMATION,
+            MEM_TEXTURES,
+            MEM_TILES,
+            MEM_NAVIGATION,
+            MEM_CAMERAS,
+            MEM_ENTITIES,
+            MEM_SOUNDS,
+            MEM_MAX
+        };
+
+        Arena arena;
+
+        template <typename T>
+        T* alloc(int count, MemoryTag tag) {
+            return arena.alloc<T>(count, tag);
+        }
+
+        template <typename T>
+        T* readArray(Stream &stream, T *&a, int count, MemoryTag tag) {
+            a = alloc<T>(count, tag);
+            if (a) {
+                stream.raw(a, count * sizeof(T));
+            }
+            return a;
+        }
+
+        void logMemory() {
+            static const char *tagNames[MEM_MAX] = { "rooms", "meshes", "animation", "textures", "tiles", "navigation", "cameras", "entities", "sounds" };
+
+            LOG("level memory: %d KB (reserved %d KB)\n", arena.getUsed() / 1024, arena.reserved / 1024);
+            for (int i = 0; i < MEM_MAX; i++) {
+                LOG("  %-10s %6d KB\n", tagNames[i], arena.tagSize[i] / 1024);
+            }
+        }
+
+        Level(Stream &stream, Level *loaded = NULL, bool (*cancelled)() = NULL) {
+            if (loaded) { // take ownership of the level data loaded in background
+            // bitwise move, arena blocks change the owner and the emptied source is safe to delete
+                memcpy((void*)this, (void*)loaded, sizeof(*this));
+                memset((void*)loaded, 0, sizeof(*loaded));
+                return;
+            }
+
             memset(this, 0, sizeof(*this));
             version     = VER_UNKNOWN;
             cutEntity   = -1;
@@ -3225,6 +3267,11 @@ namespace TR {
             }
         #endif
 
+            if (cancelled && cancelled()) return;
+
+        // parsed data is about the size of the level file
+            arena.reserve(stream.size);
+
             switch (version) {
                 case VER_TR1_PC   : loadTR1_PC  (stream); break;
                 case VER_TR1_PSX  : loadTR1_PSX (stream); break;
@@ -3244,86 +3291,27 @@ namespace TR {
                 default           : ASSERT(false);
             }
 
+            if (cancelled && cancelled()) { // arena blocks are freed with the level
+                delete[] meshData;
+                meshData = NULL;
+                return;
+            }
+
             prepare();
-        }
 
-        ~Level() {
-        // rooms
-            for (int i = 0; i < roomsCount; i++) {
-                Room &r = rooms[i];
-                delete[] r.data.vertices;
-                delete[] r.data.faces;
-                delete[] r.data.sprites;
-                delete[] r.portals;
-                delete[] r.sectors;
-                delete[] r.lights;
-                delete[] r.meshes;
-            }
-            delete[] rooms;
-            delete[] floors;
-            delete[] meshOffsets;
-            delete[] anims;
-            delete[] states;
-            delete[] ranges;
-            delete[] commands;
-            delete[] nodesData;
-            delete[] frameData;
-            delete[] models;
-            delete[] staticMeshes;
-            delete[] objectTextures;
-            delete[] objectTexturesData;
-            delete[] roomTextures;
-            delete[] roomTexturesData;
-            delete[] itemTextures;
-            delete[] itemTexturesData;
-            delete[] spriteTextures;
-            delete[] spriteSequences;
-            delete[] spriteTexturesData;
-            delete[] cameras;
-            delete[] flybyCameras;
-            delete[] soundSources;
-            delete[] boxes;
-            delete[] overlaps;
-            for (int i = 0; i < 2; i++) {
-                delete[] zones[i].ground1;
-                delete[] zones[i].ground2;
-                delete[] zones[i].ground3;
-                delete[] zones[i].ground4;
-                delete[] zones[i].fly;
-            }
-            for (int i = 0; i < animTexturesCount; i++)
-                delete[] animTextures[i].textures;
-            delete[] animTextures;
-            delete[] entities;
-            delete[] palette;
-            delete[] palette32;
-            delete[] cluts;
-            delete[] tiles4;
-            delete[] tiles8;
-            delete[] tiles16;
-            delete[] tiles32;
-            delete[] tilesMisc;
-            delete[] cameraFrames;
-            delete[] AIObjects;
-            delete[] demoData;
-            delete[] soundsMap;
-            delete[] soundsInfo;
-            delete[] soundData;
-            delete[] soundOffsets;
-            delete[] soundSize;
-
-            delete[] tsub;
+            logMemory();
         }
 
+
         void loadTR1_PC (Stream &stream) {
-            stream.read(tiles8, stream.read(tilesCount));
+            readArray(stream, tiles8, stream.read(tilesCount), MEM_TILES);
 
             readDataArrays(stream);
             readObjectTex(stream);
             readSpriteTex(stream);
 
             if (isDemoLevel) {
-                stream.read(palette, 256);
+                readArray(stream, palette, 256, MEM_TILES);
             }
 
             readCameras(stream);
@@ -3336,7 +3324,7 @@ namespace TR {
             readLightMap(stream);
             
             if (!isDemoLevel) {
-                stream.read(palette, 256);
+                readArray(stream, palette, 256, MEM_TILES);
             }
 
             readCameraFrames(stream);
@@ -3357,8 +3345,8 @@ namespace TR {
                 stream.read(numSounds);
                 stream.setPos(2086 + numSounds * 512);
                 soundOffsetsCount = numSounds;
-                soundOffsets = new uint32[soundOffsetsCount];
-                soundSize    = new uint32[soundOffsetsCount];
+                soundOffsets = alloc<uint32>(soundOffsetsCount, MEM_SOUNDS);
+                soundSize    = alloc<uint32>(soundOffsetsCount, MEM_SOUNDS);
                 soundDataSize = 0;
                 for (int i = 0; i < soundOffsetsCount; i++) {
                     soundOffsets[i] = soundDataSize;
@@ -3368,12 +3356,12 @@ namespace TR {
                 }           
             // sound data
                 stream.setPos(2600 + numSounds * 512);
-                stream.read(soundData, soundDataSize);
+                readArray(stream, soundData, soundDataSize, MEM_SOUNDS);
                 stream.setPos(offsetTexTiles + 8);
             }
 
-            stream.read(tiles4, tilesCount = 13);
-            stream.read(cluts,  clutsCount = 1024);
+            readArray(stream, tiles4, tilesCount = 13, MEM_TILES);
+            readArray(stream, cluts,  clutsCount = 1024, MEM_TILES);
 
             readDataArrays(stream);
             readObjectTex(stream);
@@ -3454,10 +3442,10 @@ namespace TR {
         }
 
         void loadTR2_PC (Stream &stream) {
-            stream.read(palette,   256);
-            stream.read(palette32, 256);
-            stream.read(tiles8, stream.read(tilesCount));
-            stream.read(tiles16, tilesCount);
+            readArray(stream, palette,   256, MEM_TILES);
+            readArray(stream, palette32, 256, MEM_TILES);
+            readArray(stream, tiles8, stream.read(tilesCount), MEM_TILES);
+            readArray(stream, tiles16, tilesCount, MEM_TILES);
 
             readDataArrays(stream);
             readObjectTex(stream);
@@ -3479,8 +3467,8 @@ namespace TR {
         }
 
         void loadTR2_PSX (Stream &stream) {
-            stream.read(soundOffsets, stream.read(soundOffsetsCount) + 1);
-            soundSize = new uint32[soundOffsetsCount];
+            readArray(stream, soundOffsets, stream.read(soundOffsetsCount) + 1, MEM_SOUNDS);
+            soundSize = alloc<uint32>(soundOffsetsCount, MEM_SOUNDS);
             soundDataSize = 0;
             for (int i = 0; i < soundOffsetsCount; i++) {
                 ASSERT(soundOffsets[i] < soundOffsets[i + 1]);
@@ -3488,18 +3476,18 @@ namespace TR {
                 soundOffsets[i] = soundDataSize;
                 soundDataSize  += soundSize[i];
             }
-            stream.read(soundData, soundDataSize);
+            readArray(stream, soundData, soundDataSize, MEM_SOUNDS);
 
             readDataArrays(stream);
 
-            stream.read(tiles4, stream.read(tilesCount));
+            readArray(stream, tiles4, stream.read(tilesCount), MEM_TILES);
             stream.read(clutsCount);
             if (clutsCount > 1024) { // check for japanese version (read kanji CLUT index)
                 kanjiSprite = clutsCount & 0xFFFF;
                 stream.seek(-2);
                 stream.read(clutsCount);
             }
-            stream.read(cluts, clutsCount);
+            readArray(stream, cluts, clutsCount, MEM_TILES);
             stream.seek(4);
             readObjectTex(stream);
             readSpriteTex(stream);
@@ -3517,10 +3505,10 @@ namespace TR {
         }
 
         void loadTR3_PC (Stream &stream) {
-            stream.read(palette,   256);
-            stream.read(palette32, 256);
-            stream.read(tiles8, stream.read(tilesCount));
-            stream.read(tiles16, tilesCount);
+            readArray(stream, palette,   256, MEM_TILES);
+            readArray(stream, palette32, 256, MEM_TILES);
+            readArray(stream, tiles8, stream.read(tilesCount), MEM_TILES);
+            readArray(stream, tiles16, tilesCount, MEM_TILES);
 
             readDataArrays(stream);
             readSpriteTex(stream);
@@ -3544,7 +3532,7 @@ namespace TR {
             readSoundOffsets(stream);
             if (soundOffsetsCount) {
                 readSoundData(stream);
-                soundSize = new uint32[soundOffsetsCount];
+                soundSize = alloc<uint32>(soundOffsetsCount, MEM_SOUNDS);
                 int size = 0;
                 for (int i = 0; i < soundOffsetsCount - 1; i++) {
                     ASSERT(soundOffsets[i] < soundOffsets[i + 1]);
@@ -3572,7 +3560,7 @@ namespace TR {
 
             readDataArrays(stream);
 
-            stream.read(tiles4, stream.read(tilesCount));
+            readArray(stream, tiles4, stream.read(tilesCount), MEM_TILES);
             stream.read(clutsCount);
             if (clutsCount > 1024) { // check for japanese version (read kanji CLUT index)
                 kanjiSprite = clutsCount & 0xFFFF;
@@ -3580,7 +3568,7 @@ namespace TR {
                 stream.read(clutsCount);
             }
             clutsCount *= 2; // read underwater cluts too
-            stream.read(cluts, clutsCount);
+            readArray(stream, cluts, clutsCount, MEM_TILES);
 
             readObjectTex(stream);
             readSpriteTex(stream);
@@ -3597,7 +3585,7 @@ namespace TR {
             roomTexturesCount = stream.readLE32();
 
             if (roomTexturesCount) {
-                roomTextures = new TextureInfo[roomTexturesCount];
+                roomTextures = alloc<TextureInfo>(roomTexturesCount, MEM_TEXTURES);
 
             // load room textures
                 for (int i = 0; i < roomTexturesCount; i++) {
@@ -3625,7 +3613,7 @@ namespace TR {
             stream.read(sizeD);
             stream.read(dataC, stream.read(sizeC));
             ASSERT(sizeD == sizeof(Tile32) * (roomTilesCount + objTilesCount + bumpTilesCount));
-            tiles32 = new Tile32[roomTilesCount + objTilesCount + bumpTilesCount];
+            tiles32 = alloc<Tile32>(roomTilesCount + objTilesCount + bumpTilesCount, MEM_TILES);
             tinf_uncompress(tiles32, &sizeR, dataC + 2, 0);
             ASSERT(sizeD == sizeR);
             delete[] dataC;
@@ -3639,7 +3627,7 @@ namespace TR {
             stream.read(sizeD);
             stream.read(dataC, stream.read(sizeC));
             ASSERT(sizeD == sizeof(Tile32) * 2);
-            tilesMisc = new Tile32[2];
+            tilesMisc = alloc<Tile32>(2, MEM_TILES);
             tinf_uncompress(tilesMisc, &sizeR, dataC + 2, 0);
             ASSERT(sizeD == sizeR);
             delete[] dataC;
@@ -3676,10 +3664,10 @@ namespace TR {
             stream.read(soundsCount);
             if (soundOffsetsCount <= 0 && soundsCount > 0) {
                 soundOffsetsCount = soundsCount;
-                soundOffsets = new uint32[soundOffsetsCount];
+                soundOffsets = alloc<uint32>(soundOffsetsCount, MEM_SOUNDS);
             }
             soundDataSize = stream.size - stream.pos;
-            soundData = new uint8[soundDataSize];
+            soundData = alloc<uint8>(soundDataSize, MEM_SOUNDS);
             soundDataSize = 0;
             for (int i = 0; i < soundsCount; i++) {
                 stream.read(sizeD);
@@ -3716,12 +3704,12 @@ namespace TR {
                 stream.seek(4);            
             }
 
-            rooms = stream.read(roomsCount) ? new Room[roomsCount] : NULL;
+            rooms = stream.read(roomsCount) ? alloc<Room>(roomsCount, MEM_ROOMS) : NULL;
             for (int i = 0; i < roomsCount; i++) {
                 readRoom(stream, i);
             }
 
-            stream.read(floors, stream.read(floorsCount));
+            readArray(stream, floors, stream.read(floorsCount), MEM_ROOMS);
 
             if (version == VER_TR3_PSX) {
                 // outside room offsets
@@ -3736,24 +3724,24 @@ namespace TR {
             }
 
             stream.read(meshData,    stream.read(meshDataSize));
-            stream.read(meshOffsets, stream.read(meshOffsetsCount));
+            readArray(stream, meshOffsets, stream.read(meshOffsetsCount), MEM_MESHES);
 
             readAnims(stream);
 
-            stream.read(states,      stream.read(statesCount));
-            stream.read(ranges,      stream.read(rangesCount));
-            stream.read(commands,    stream.read(commandsCount));
-            stream.read(nodesData,   stream.read(nodesDataSize));
-            stream.read(frameData,   stream.read(frameDataSize));
+            readArray(stream, states,      stream.read(statesCount), MEM_ANIMATION);
+            readArray(stream, ranges,      stream.read(rangesCount), MEM_ANIMATION);
+            readArray(stream, commands,    stream.read(commandsCount), MEM_ANIMATION);
+            readArray(stream, nodesData,   stream.read(nodesDataSize), MEM_ANIMATION);
+            readArray(stream, frameData,   stream.read(frameDataSize), MEM_ANIMATION);
 
             readModels(stream);
 
-            stream.read(staticMeshes, stream.read(staticMeshesCount));
+            readArray(stream, staticMeshes, stream.read(staticMeshesCount), MEM_MESHES);
         }
 
         void readAnims(Stream &stream) {
             stream.read(animsCount);
-            anims = animsCount ? new Animation[animsCount] : NULL;
+            anims = animsCount ? alloc<Animation>(animsCount, MEM_ANIMATION) : NULL;
             for (int i = 0; i < animsCount; i++) {
                 Animation &anim = anims[i];
                 stream.read(anim.frameOffset);
@@ -3782,7 +3770,7 @@ namespace TR {
         }
 
         void readModels(Stream &stream) {
-            models = stream.read(modelsCount) ? new Model[modelsCount] : NULL;
+            models = stream.read(modelsCount) ? alloc<Model>(modelsCount, MEM_MESHES) : NULL;
             for (int i = 0; i < modelsCount; i++) {
                 Model &m = models[i];
                 uint16 type;
@@ -3801,19 +3789,19 @@ namespace TR {
         }
 
         void readCameras(Stream &stream) {
-            stream.read(cameras, stream.read(camerasCount));
+            readArray(stream, cameras, stream.read(camerasCount), MEM_CAMERAS);
         }
 
         void readFlybyCameras(Stream &stream) {
-            stream.read(flybyCameras, stream.read(flybyCamerasCount));
+            readArray(stream, flybyCameras, stream.read(flybyCamerasCount), MEM_CAMERAS);
         }
 
         void readSoundSources(Stream &stream) {
-            stream.read(soundSources, stream.read(soundSourcesCount));
+            readArray(stream, soundSources, stream.read(soundSourcesCount), MEM_SOUNDS);
         }
 
         void readBoxes(Stream &stream) {
-            boxes = stream.read(boxesCount) ? new Box[boxesCount] : NULL;
+            boxes = stream.read(boxesCount) ? alloc<Box>(boxesCount, MEM_NAVIGATION) : NULL;
             for (int i = 0; i < boxesCount; i++) {
                 Box &b = boxes[i];
                 if (version & VER_TR1) {
@@ -3837,21 +3825,21 @@ namespace TR {
         }
 
         void readOverlaps(Stream &stream) {
-            stream.read(overlaps, stream.read(overlapsCount));
+            readArray(stream, overlaps, stream.read(overlapsCount), MEM_NAVIGATION);
         }
 
         void readZones(Stream &stream) {
             for (int i = 0; i < 2; i++) {
-                stream.read(zones[i].ground1, boxesCount);
-                stream.read(zones[i].ground2, boxesCount);
+                readArray(stream, zones[i].ground1, boxesCount, MEM_NAVIGATION);
+                readArray(stream, zones[i].ground2, boxesCount, MEM_NAVIGATION);
                 if (!(version & VER_TR1)) {
-                    stream.read(zones[i].ground3, boxesCount);
-                    stream.read(zones[i].ground4, boxesCount);
+                    readArray(stream, zones[i].ground3, boxesCount, MEM_NAVIGATION);
+                    readArray(stream, zones[i].ground4, boxesCount, MEM_NAVIGATION);
                 } else {
                     zones[i].ground3 = NULL;
                     zones[i].ground4 = NULL;
                 }
-                stream.read(zones[i].fly, boxesCount);
+                readArray(stream, zones[i].fly, boxesCount, MEM_NAVIGATION);
             }
         }
 
@@ -3863,21 +3851,21 @@ namespace TR {
         }
 
         void readCameraFrames(Stream &stream) {
-            stream.read(cameraFrames, stream.read(cameraFramesCount));
+            readArray(stream, cameraFrames, stream.read(cameraFramesCount), MEM_CAMERAS);
         }
 
         void readAIObjects(Stream &stream) {
-            stream.read(AIObjects, stream.read(AIObjectsCount));
+            readArray(stream, AIObjects, stream.read(AIObjectsCount), MEM_ENTITIES);
         }
 
         void readDemoData(Stream &stream) {
-            stream.read(demoData, stream.read(demoDataSize));
+            readArray(stream, demoData, stream.read(demoDataSize), MEM_ENTITIES);
         }
 
         void readSoundMap(Stream &stream) {
             soundsCount = (version & VER_TR1) ? 256 : 370;
-            stream.read(soundsMap, soundsCount);
-            soundsInfo = (stream.read(soundsInfoCount) > 0) ? new SoundInfo[soundsInfoCount] : NULL;
+            readArray(stream, soundsMap, soundsCount, MEM_SOUNDS);
+            soundsInfo = (stream.read(soundsInfoCount) > 0) ? alloc<SoundInfo>(soundsInfoCount, MEM_SOUNDS) : NULL;
             for (int i = 0; i < soundsInfoCount; i++) {
                 SoundInfo &s = soundsInfo[i];
 
@@ -3903,11 +3891,11 @@ namespace TR {
         }
 
         void readSoundData(Stream &stream) {
-            stream.read(soundDataSize) > 0 ? stream.read(soundData, soundDataSize) : NULL;
+            stream.read(soundDataSize) > 0 ? readArray(stream, soundData, soundDataSize, MEM_SOUNDS) : NULL;
         }
 
         void readSoundOffsets(Stream &stream) {
-            stream.read(soundOffsetsCount) > 0 ? stream.read(soundOffsets, soundOffsetsCount) : NULL;
+            stream.read(soundOffsetsCount) > 0 ? readArray(stream, soundOffsets, soundOffsetsCount, MEM_SOUNDS) : NULL;
         }
 
         #define CHUNK(str) ((uint64)((const char*)(str))[0]        | ((uint64)((const char*)(str))[1] << 8)  | ((uint64)((const char*)(str))[2] << 16) | ((uint64)((const char*)(str))[3] << 24) | \
@@ -3991,14 +3979,14 @@ namespace TR {
                     case SAT_ROOMTINF :
                         ASSERTV(stream.readBE32() == 0x00000010);
                         roomTexturesCount = stream.readBE32();
-                        roomTextures = roomTexturesCount ? new TextureInfo[roomTexturesCount] : NULL;
+                        roomTextures = roomTexturesCount ? alloc<TextureInfo>(roomTexturesCount, MEM_TEXTURES) : NULL;
                         for (int i = 0; i < roomTexturesCount; i++)
                             readObjectTex(stream, roomTextures[i], TEX_TYPE_ROOM);
                         break;
                     case SAT_ROOMTQTR : {
                         ASSERTV(stream.readBE32() == 0x00000001);
                         roomTexturesDataSize = stream.readBE32();
-                        roomTexturesData = roomTexturesDataSize ? new uint8[roomTexturesDataSize] : NULL;
+                        roomTexturesData = roomTexturesDataSize ? alloc<uint8>(roomTexturesDataSize, MEM_TEXTURES) : NULL;
                         stream.raw(roomTexturesData, roomTexturesDataSize);
 /*
                         int32 count = stream.readBE32();
@@ -4010,12 +3998,12 @@ namespace TR {
                         ASSERTV(stream.readBE32() == 0x00000001);
                         /*
                         roomTexturesDataSize = stream.readBE32();
-                        roomTexturesData = roomTexturesDataSize ? new uint8[roomTexturesDataSize] : NULL;
+                        roomTexturesData = roomTexturesDataSize ? alloc<uint8>(roomTexturesDataSize, MEM_TEXTURES) : NULL;
                         stream.raw(roomTexturesData, roomTexturesDataSize);
                         */
 
                         tsubCount = stream.readBE32();
-                        tsub = new uint8[tsubCount];
+                        tsub = alloc<uint8>(tsubCount, MEM_TEXTURES);
                         stream.raw(tsub, sizeof(uint8) * tsubCount);
 
                         break;
@@ -4032,7 +4020,7 @@ namespace TR {
                     case SAT_ROOMDATA :
                         ASSERTV(stream.readBE32() == 0x00000044);
                         roomsCount = stream.readBE32();
-                        rooms = new Room[roomsCount];
+                        rooms = alloc<Room>(roomsCount, MEM_ROOMS);
                         memset(rooms, 0, sizeof(Room) * roomsCount);
                         break;
                     case SAT_ROOMNUMB :
@@ -4052,7 +4040,7 @@ namespace TR {
                         if (flag == 0x00000014) {
                             room->meshesCount = stream.readBE32();
 
-                            room->meshes = room->meshesCount ? new Room::Mesh[room->meshesCount] : NULL;
+                            room->meshes = room->meshesCount ? alloc<Room::Mesh>(room->meshesCount, MEM_ROOMS) : NULL;
                             for (int i = 0; i < room->meshesCount; i++) {
                                 Room::Mesh &m = room->meshes[i];
                                 m.x = stream.readBE32();
@@ -4076,7 +4064,7 @@ namespace TR {
 
                         data.size = stream.readBE32();
                         data.vCount = stream.readBE16();
-                        data.vertices = new Room::Data::Vertex[data.vCount];
+                        data.vertices = alloc<Room::Data::Vertex>(data.vCount, MEM_ROOMS);
                         for (int j = 0; j < data.vCount; j++) {
                             Room::Data::Vertex &v = data.vertices[j];
                             v.pos.x      = stream.readBE16();
@@ -4087,8 +4075,8 @@ namespace TR {
                         }
 
                         data.fCount  = stream.readBE16();
-                        data.faces   = new Face[data.fCount];
-                        data.sprites = new Room::Data::Sprite[data.fCount];
+                        data.faces   = alloc<Face>(data.fCount, MEM_ROOMS);
+                        data.sprites = alloc<Room::Data::Sprite>(data.fCount, MEM_ROOMS);
 
                         enum {
                             TYPE_R_TRANSP    = 33,
@@ -4174,7 +4162,7 @@ namespace TR {
                         ASSERT(room && room->sectors == NULL);
 
                         room->portalsCount = stream.readBE32();
-                        room->portals = new Room::Portal[room->portalsCount];
+                        room->portals = alloc<Room::Portal>(room->portalsCount, MEM_ROOMS);
 
                         for (int j = 0; j < room->portalsCount; j++) {
                             Room::Portal &p = room->portals[j];
@@ -4202,7 +4190,7 @@ namespace TR {
                         int32 count = stream.readBE32();
                         ASSERT(count == room->xSectors * room->zSectors);
 
-                        room->sectors = count ? new Room::Sector[count] : NULL;
+                        room->sectors = count ? alloc<Room::Sector>(count, MEM_ROOMS) : NULL;
 
                         for (int i = 0; i < count; i++) {
                             Room::Sector &s = room->sectors[i];
@@ -4220,7 +4208,7 @@ namespace TR {
                         ASSERTV(stream.readBE32() == 0x00000002);
                         ASSERT(floors == NULL);
                         floorsCount = stream.readBE32();
-                        floors = new FloorData[floorsCount];
+                        floors = alloc<FloorData>(floorsCount, MEM_ROOMS);
                         for (int i = 0; i < floorsCount; i++)
                             floors[i].value = stream.readBE16();
                         break;
@@ -4246,7 +4234,7 @@ namespace TR {
                         ASSERTV(stream.readBE32() == 0x00000014);
                         ASSERT(room && room->lights == NULL);
                         room->lightsCount = stream.readBE32();
-                        room->lights = room->lightsCount ? new Room::Light[room->lightsCount] : NULL;
+                        room->lights = room->lightsCount ? alloc<Room::Light>(room->lightsCount, MEM_ROOMS) : NULL;
                         for (int i = 0; i < room->lightsCount; i++) {
                             Room::Light &light = room->lights[i];
                             light.x = stream.readBE32();
@@ -4268,7 +4256,7 @@ namespace TR {
                         ASSERTV(stream.readBE32() == 0x00000010);
                         ASSERT(cameras == NULL);
                         camerasCount = stream.readBE32();
-                        cameras = camerasCount ? new Camera[camerasCount] : NULL;
+                        cameras = camerasCount ? alloc<Camera>(camerasCount, MEM_CAMERAS) : NULL;
                         for (int i = 0; i < camerasCount; i++) {
                             Camera &cam = cameras[i];
                             cam.x = stream.readBE32();
@@ -4286,11 +4274,11 @@ namespace TR {
                             int pos = stream.pos;
                             stream.setPos(0);
                             soundDataSize = stream.size;
-                            soundData = new uint8[soundDataSize];
+                            soundData = alloc<uint8>(soundDataSize, MEM_SOUNDS);
                             stream.raw(soundData, soundDataSize);
                             soundOffsetsCount = 256;
-                            soundOffsets = new uint32[soundOffsetsCount];
-                            soundSize    = new uint32[soundOffsetsCount];
+                            soundOffsets = alloc<uint32>(soundOffsetsCount, MEM_SOUNDS);
+                            soundSize    = alloc<uint32>(soundOffsetsCount, MEM_SOUNDS);
                             memset(soundOffsets, 0, soundOffsetsCount * sizeof(uint32));
                             memset(soundSize,    0, soundOffsetsCount * sizeof(uint32));
                             stream.setPos(pos);
@@ -4301,7 +4289,7 @@ namespace TR {
 
                         ASSERT(soundSources == NULL);
                         soundSourcesCount = stream.readBE32();
-                        soundSources = soundSourcesCount ? new SoundSource[soundSourcesCount] : NULL;
+                        soundSources = soundSourcesCount ? alloc<SoundSource>(soundSourcesCount, MEM_SOUNDS) : NULL;
                         for (int i = 0; i < soundSourcesCount; i++) {
                             SoundSource &s = soundSources[i];
                             s.x     = stream.readBE32();
@@ -4316,7 +4304,7 @@ namespace TR {
                         ASSERTV(stream.readBE32() == 0x00000014);
                         ASSERT(boxes == NULL);
                         boxesCount = stream.readBE32();
-                        boxes = boxesCount ? new Box[boxesCount] : NULL;
+                        boxes = boxesCount ? alloc<Box>(boxesCount, MEM_NAVIGATION) : NULL;
                         for (int i = 0; i < boxesCount; i++) {
                             Box &b = boxes[i];
                             b.minZ          = stream.readBE32();
@@ -4331,7 +4319,7 @@ namespace TR {
                         ASSERTV(stream.readBE32() == 0x00000002);
                         ASSERT(overlaps == NULL);
                         overlapsCount = stream.readBE32();
-                        overlaps = overlapsCount ? new Overlap[overlapsCount] : NULL;
+                        overlaps = overlapsCount ? alloc<Overlap>(overlapsCount, MEM_NAVIGATION) : NULL;
                         for (int i = 0; i < overlapsCount; i++)
                             overlaps[i].value = stream.readBE16();
                         break;
@@ -4352,7 +4340,7 @@ namespace TR {
                         ASSERT(*ptr == NULL);
 
                         int32 count = stream.readBE32();
-                        *ptr = count ? new uint16[count] : NULL;
+                        *ptr = count ? alloc<uint16>(count, MEM_NAVIGATION) : NULL;
                         for (int i = 0; i < count; i++)
                             (*ptr)[i] = stream.readBE16();
                         break;
@@ -4360,13 +4348,13 @@ namespace TR {
                     case SAT_ARANGES_ : {
                         ASSERTV(stream.readBE32() == 0x00000008);
                         animTexturesCount = stream.readBE32();
-                        animTextures = new AnimTexture[animTexturesCount];
+                        animTextures = alloc<AnimTexture>(animTexturesCount, MEM_TEXTURES);
                         for (int i = 0; i < animTexturesCount; i++) {
                             AnimTexture &animTex = animTextures[i];
                             uint32 first = stream.readBE32();
                             uint32 last  = stream.readBE32();
                             animTex.count    = last - first + 1;
-                            animTex.textures = new uint16[animTex.count];
+                            animTex.textures = alloc<uint16>(animTex.count, MEM_TEXTURES);
                             for (int j = 0; j < animTex.count; j++)
                                 animTex.textures[j] = first + j;
                         }
@@ -4376,7 +4364,7 @@ namespace TR {
                         ASSERTV(stream.readBE32() == 0x00000014);
                         entitiesBaseCount = stream.readBE32();
                         entitiesCount = entitiesBaseCount + MAX_RESERVED_ENTITIES;
-                        entities = new Entity[entitiesCount];
+                        entities = alloc<Entity>(entitiesCount, MEM_ENTITIES);
                         for (int i = 0; i < entitiesBaseCount; i++) {
                             Entity &e = entities[i];
                             e.type = Entity::Type(stream.readBE16());
@@ -4404,7 +4392,7 @@ namespace TR {
                         ASSERTV(stream.readBE32() == 0x00000022);
                         ASSERT(anims == NULL);
                         animsCount = stream.readBE32();
-                        anims = animsCount ? new Animation[animsCount] : NULL;
+                        anims = animsCount ? alloc<Animation>(animsCount, MEM_ANIMATION) : NULL;
                         for (int i = 0; i < animsCount; i++) {
                             Animation &anim = anims[i];
                             anim.frameOffset   = stream.readBE32();
@@ -4429,7 +4417,7 @@ namespace TR {
                         ASSERTV(stream.readBE32() == 0x00000008);
                         ASSERT(states == NULL);
                         statesCount = stream.readBE32();
-                        states = statesCount ? new AnimState[statesCount] : NULL;
+                        states = statesCount ? alloc<AnimState>(statesCount, MEM_ANIMATION) : NULL;
                         for (int i = 0; i < statesCount; i++) {
                             AnimState &state = states[i];
                             state.state         = stream.readBE16();
@@ -4442,7 +4430,7 @@ namespace TR {
                         ASSERTV(stream.readBE32() == 0x00000008);
                         ASSERT(ranges == NULL);
                         rangesCount = stream.readBE32();
-                        ranges = rangesCount ? new AnimRange[rangesCount] : NULL;
+                        ranges = rangesCount ? alloc<AnimRange>(rangesCount, MEM_ANIMATION) : NULL;
                         for (int i = 0; i < rangesCount; i++) {
                             AnimRange &range = ranges[i];
                             range.low           = stream.readBE16();
@@ -4455,7 +4443,7 @@ namespace TR {
                         ASSERTV(stream.readBE32() == 0x00000002);
                         ASSERT(commands == NULL);
                         commandsCount = stream.readBE32();
-                        commands = commandsCount ? new int16[commandsCount] : NULL;
+                        commands = commandsCount ? alloc<int16>(commandsCount, MEM_ANIMATION) : NULL;
                         for (int i = 0; i < commandsCount; i++)
                             commands[i] = stream.readBE16();
                         break;
@@ -4463,7 +4451,7 @@ namespace TR {
                         ASSERTV(stream.readBE32() == 0x00000004);
                         ASSERT(nodesData == NULL);
                         nodesDataSize = stream.readBE32();
-                        nodesData = nodesDataSize ? new uint32[nodesDataSize] : NULL;
+                        nodesData = nodesDataSize ? alloc<uint32>(nodesDataSize, MEM_ANIMATION) : NULL;
                         for (int i = 0; i < nodesDataSize; i++)
                             nodesData[i] = stream.readBE32();
                         break;
@@ -4471,7 +4459,7 @@ namespace TR {
                         ASSERTV(stream.readBE32() == 0x00000038);
                         ASSERT(models == NULL);
                         modelsCount = stream.readBE32();
-                        models = modelsCount ? new Model[modelsCount] : NULL;
+                        models = modelsCount ? alloc<Model>(modelsCount, MEM_MESHES) : NULL;
                         for (int i = 0; i < modelsCount; i++) {
                             Model &model = models[i];
                             ASSERTV(stream.readBE16() == 0x0000);
@@ -4489,7 +4477,7 @@ namespace TR {
                         ASSERTV(stream.readBE32() == 0x00000020);
                         ASSERT(staticMeshes == NULL);
                         staticMeshesCount = stream.readBE32();
-                        staticMeshes = staticMeshesCount ? new StaticMesh[staticMeshesCount] : NULL;
+                        staticMeshes = staticMeshesCount ? alloc<StaticMesh>(staticMeshesCount, MEM_MESHES) : NULL;
                         for (int i = 0; i < staticMeshesCount; i++) {
                             StaticMesh &mesh = staticMeshes[i];
                             mesh.id        = stream.readBE32();
@@ -4513,7 +4501,7 @@ namespace TR {
                         ASSERTV(stream.readBE32() == 0x00000002);
                         ASSERT(frameData == NULL);
                         frameDataSize = stream.readBE32();
-                        frameData = frameDataSize ? new uint16[frameDataSize] : NULL;
+                        frameData = frameDataSize ? alloc<uint16>(frameDataSize, MEM_ANIMATION) : NULL;
                         for (int i = 0; i < frameDataSize; i++) 
                             frameData[i] = stream.readBE16();
                         break;
@@ -4521,7 +4509,7 @@ namespace TR {
                         ASSERTV(stream.readBE32() == 0x00000004);
                         ASSERT(meshOffsets == NULL);
                         meshOffsetsCount = stream.readBE32();
-                        meshOffsets = meshOffsetsCount ? new int32[meshOffsetsCount] : NULL;
+                        meshOffsets = meshOffsetsCount ? alloc<int32>(meshOffsetsCount, MEM_MESHES) : NULL;
                         for (int i = 0; i < meshOffsetsCount; i++) 
                             meshOffsets[i] = stream.readBE32();
                         break;
@@ -4536,7 +4524,7 @@ namespace TR {
                         ASSERTV(stream.readBE32() == 0x00000010);
                         ASSERT(objectTextures == NULL);
                         objectTexturesCount = stream.readBE32();
-                        objectTextures = objectTexturesCount ? new TextureInfo[objectTexturesCount * 5] : NULL;
+                        objectTextures = objectTexturesCount ? alloc<TextureInfo>(objectTexturesCount * 5, MEM_TEXTURES) : NULL;
                         for (int i = 0; i < objectTexturesCount; i++)
                             readObjectTex(stream, objectTextures[i], TEX_TYPE_OBJECT);
                         objectTexturesBaseCount = objectTexturesCount;
@@ -4545,14 +4533,14 @@ namespace TR {
                     case SAD_OTEXTDAT : {
                         ASSERTV(stream.readBE32() == 0x00000001);
                         objectTexturesDataSize = stream.readBE32();
-                        objectTexturesData = objectTexturesDataSize ? new uint8[objectTexturesDataSize] : NULL;
+                        objectTexturesData = objectTexturesDataSize ? alloc<uint8>(objectTexturesDataSize, MEM_TEXTURES) : NULL;
                         stream.raw(objectTexturesData, objectTexturesDataSize);
                         break;
                     }
                     case SAD_ITEXTINF : {
                         ASSERTV(stream.readBE32() == 0x00000014);
                         itemTexturesCount = stream.readBE32();
-                        itemTextures = itemTexturesCount ? new TextureInfo[itemTexturesCount * 5] : NULL;
+                        itemTextures = itemTexturesCount ? alloc<TextureInfo>(itemTexturesCount * 5, MEM_TEXTURES) : NULL;
                         for (int i = 0; i < itemTexturesCount; i++)
                             readObjectTex(stream, itemTextures[i], TEX_TYPE_ITEM);
                         itemTexturesBaseCount = itemTexturesCount;
@@ -4562,7 +4550,7 @@ namespace TR {
                     case SAD_ITEXTDAT : {
                         ASSERTV(stream.readBE32() == 0x00000001);
                         itemTexturesDataSize = stream.readBE32();
-                        itemTexturesData = itemTexturesDataSize ? new uint8[itemTexturesDataSize] : NULL;
+                        itemTexturesData = itemTexturesDataSize ? alloc<uint8>(itemTexturesDataSize, MEM_TEXTURES) : NULL;
                         stream.raw(itemTexturesData, itemTexturesDataSize);
                         break;
                     }
@@ -4578,7 +4566,7 @@ namespace TR {
                     case SPR_SPRITINF : {
                         ASSERTV(stream.readBE32() == 0x00000010);
                         spriteTexturesCount = stream.readBE32();
-                        spriteTextures = spriteTexturesCount ? new TextureInfo[spriteTexturesCount] : NULL;
+                        spriteTextures = spriteTexturesCount ? alloc<TextureInfo>(spriteTexturesCount, MEM_TEXTURES) : NULL;
                         for (int i = 0; i < spriteTexturesCount; i++)
                             readSpriteTex(stream, spriteTextures[i]);
                         break;
@@ -4586,14 +4574,14 @@ namespace TR {
                     case SPR_SPRITDAT : {
                         ASSERTV(stream.readBE32() == 0x00000001);
                         spriteTexturesDataSize = stream.readBE32();
-                        spriteTexturesData = spriteTexturesDataSize ? new uint8[spriteTexturesDataSize] : NULL;
+                        spriteTexturesData = spriteTexturesDataSize ? alloc<uint8>(spriteTexturesDataSize, MEM_TEXTURES) : NULL;
                         stream.raw(spriteTexturesData, spriteTexturesDataSize);
                         break;
                     }
                     case SPR_OBJECTS_ : {
                         ASSERTV(stream.readBE32() == 0x00000000);
                         spriteSequencesCount = stream.readBE32();
-                        spriteSequences = spriteSequencesCount ? new SpriteSequence[spriteSequencesCount] : NULL;
+                        spriteSequences = spriteSequencesCount ? alloc<SpriteSequence>(spriteSequencesCount, MEM_TEXTURES) : NULL;
                         for (int i = 0; i < spriteSequencesCount; i++) {
                             SpriteSequence &s = spriteSequences[i];
                             ASSERTV(stream.readBE16() == 0);
@@ -4612,7 +4600,7 @@ namespace TR {
                     case SND_SAMPLUT_ : {
                         ASSERTV(stream.readBE32() == 0x00000002);
                         int count = stream.readBE32();
-                        soundsMap = new int16[count];
+                        soundsMap = alloc<int16>(count, MEM_SOUNDS);
                         for (int i = 0; i < count; i++)
                             soundsMap[i] = stream.readBE16();
                         break;
@@ -4620,7 +4608,7 @@ namespace TR {
                     case SND_SAMPINFS : {
                         ASSERTV(stream.readBE32() == 0x00000008);
                         soundsInfoCount = stream.readBE32();
-                        soundsInfo = soundsInfoCount ? new SoundInfo[soundsInfoCount] : NULL;
+                        soundsInfo = soundsInfoCount ? alloc<SoundInfo>(soundsInfoCount, MEM_SOUNDS) : NULL;
                         for (int i = 0; i < soundsInfoCount; i++) {
                             SoundInfo &s = soundsInfo[i];
                             s.index       = stream.readBE16();
@@ -4662,20 +4650,18 @@ namespace TR {
         void readCIN(Stream &stream) {
             stream.seek(2); // skip unknown word
             cameraFramesCount = (stream.size - 2) / 16;
-            cameraFrames = cameraFramesCount ? new CameraFrame[cameraFramesCount] : NULL;
+            cameraFrames = cameraFramesCount ? alloc<CameraFrame>(cameraFramesCount, MEM_CAMERAS) : NULL;
             stream.raw(cameraFrames, cameraFramesCount * 16);
         }
 
         void appendObjectTex(TextureInfo *&objTex, int32 &count) {
             if (!objTex) return;
-            TextureInfo *newObjectTextures = new TextureInfo[objectTexturesCount + count];
+            TextureInfo *newObjectTextures = alloc<TextureInfo>(objectTexturesCount + count, MEM_TEXTURES);
             memcpy(newObjectTextures,                       objectTextures,   sizeof(TextureInfo) * objectTexturesCount);
             memcpy(newObjectTextures + objectTexturesCount, objTex,           sizeof(TextureInfo) * count);
-            delete[] objectTextures;
             objectTextures       = newObjectTextures;
             objectTexturesCount += count;
 
-            delete[] objTex;
             objTex = NULL;
             count  = 0;
         }
@@ -4802,15 +4788,10 @@ namespace TR {
             initExtra();
             initCutscene();
             initTextureTypes();
-
-            gObjectTextures      = objectTextures;
-            gSpriteTextures      = spriteTextures;
-            gObjectTexturesCount = objectTexturesCount;
-            gSpriteTexturesCount = spriteTexturesCount;
         }
 
         void readSamples(Stream &stream) {
-            stream.read(soundData, soundDataSize = stream.size);
+            readArray(stream, soundData, soundDataSize = stream.size, MEM_SOUNDS);
 
             int32 dataOffsets[512];
             int32 dataOffsetsCount = 0;
@@ -5007,7 +4988,7 @@ namespace TR {
                         TextureInfo &t = objectTextures[f.flags.texture];
                         if (t.type != TEX_TYPE_OBJECT) {
                             if (!dupObjTex) {
-                                dupObjTex = new TextureInfo[256];
+                                dupObjTex = alloc<TextureInfo>(256, MEM_TEXTURES);
                             }
 
                             int index = 0;
@@ -5161,12 +5142,12 @@ namespace TR {
                 stream.setPos(startOffset + d.size * 2);
 
                 d.fCount   = d.rCount + d.tCount;
-                d.faces    = d.fCount ? new Face[d.fCount] : NULL;
-                d.vertices = d.vCount ? new Room::Data::Vertex[d.vCount] : NULL;
+                d.faces    = d.fCount ? alloc<Face>(d.fCount, MEM_ROOMS) : NULL;
+                d.vertices = d.vCount ? alloc<Room::Data::Vertex>(d.vCount, MEM_ROOMS) : NULL;
 
                 d.vCount = d.fCount = 0;
             } else {
-                d.vertices = stream.read(d.vCount) ? new Room::Data::Vertex[d.vCount] : NULL;
+                d.vertices = stream.read(d.vCount) ? alloc<Room::Data::Vertex>(d.vCount, MEM_ROOMS) : NULL;
             }
 
             if (version == VER_TR3_PSX) {
@@ -5328,7 +5309,7 @@ namespace TR {
                 stream.setPos(tmp);
 
                 d.fCount = d.rCount + d.tCount;
-                d.faces  = d.fCount ? new Face[d.fCount] : NULL;
+                d.faces  = d.fCount ? alloc<Face>(d.fCount, MEM_ROOMS) : NULL;
 
                 int idx = 0;
 
@@ -5393,7 +5374,7 @@ namespace TR {
                 d.sprites = NULL;
                 d.sCount  = 0;
             } else {
-                stream.read(d.sprites, stream.read(d.sCount));
+                readArray(stream, d.sprites, stream.read(d.sCount), MEM_ROOMS);
             }
 
             if (version == VER_TR3_PSX && partsCount != 0) {
@@ -5404,7 +5385,7 @@ namespace TR {
             stream.setPos(startOffset + d.size * 2);
 
         // portals
-            stream.read(r.portals, stream.read(r.portalsCount));
+            readArray(stream, r.portals, stream.read(r.portalsCount), MEM_ROOMS);
 
             if (version == VER_TR2_PSX || version == VER_TR3_PSX) {
                 for (int i = 0; i < r.portalsCount; i++) {
@@ -5418,7 +5399,7 @@ namespace TR {
         // sectors
             stream.read(r.zSectors);
             stream.read(r.xSectors);
-            r.sectors = (r.zSectors * r.xSectors > 0) ? new Room::Sector[r.zSectors * r.xSectors] : NULL;
+            r.sectors = (r.zSectors * r.xSectors > 0) ? alloc<Room::Sector>(r.zSectors * r.xSectors, MEM_ROOMS) : NULL;
 
             for (int i = 0; i < r.zSectors * r.xSectors; i++) {
                 Room::Sector &s = r.sectors[i];
@@ -5456,7 +5437,7 @@ namespace TR {
             }
 
         // lights
-            r.lights = stream.read(r.lightsCount) ? new Room::Light[r.lightsCount] : NULL;
+            r.lights = stream.read(r.lightsCount) ? alloc<Room::Light>(r.lightsCount, MEM_ROOMS) : NULL;
             for (int i = 0; i < r.lightsCount; i++) {
                 Room::Light &light = r.lights[i];
                 stream.read(light.x);
@@ -5517,7 +5498,7 @@ namespace TR {
             }
         // meshes
             stream.read(r.meshesCount);
-            r.meshes = r.meshesCount ? new Room::Mesh[r.meshesCount] : NULL;
+            r.meshes = r.meshesCount ? alloc<Room::Mesh>(r.meshesCount, MEM_ROOMS) : NULL;
             for (int i = 0; i < r.meshesCount; i++) {
                 Room::Mesh &m = r.meshes[i];
                 stream.read(m.x);
@@ -5613,7 +5594,7 @@ namespace TR {
 
             switch (version) {
                 case VER_TR1_SAT : {
-                    mesh.vertices = new Mesh::Vertex[mesh.vCount];
+                    mesh.vertices = alloc<Mesh::Vertex>(mesh.vCount, MEM_MESHES);
                     for (int i = 0; i < mesh.vCount; i++) {
                         short4 &c = mesh.vertices[i].coord;
                         c.x = stream.readBE16();
@@ -5638,7 +5619,7 @@ namespace TR {
                     }
 
                     mesh.fCount = stream.readBE16();
-                    mesh.faces = new Face[mesh.fCount];
+                    mesh.faces = alloc<Face>(mesh.fCount, MEM_MESHES);
                     mesh.tCount = mesh.rCount = 0;
 
                     enum {
@@ -5769,7 +5750,7 @@ namespace TR {
                 case VER_TR3_PC : 
                 case VER_TR4_PC :
                 case VER_TR5_PC : {
-                    mesh.vertices = new Mesh::Vertex[mesh.vCount];
+                    mesh.vertices = alloc<Mesh::Vertex>(mesh.vCount, MEM_MESHES);
                     for (int i = 0; i < mesh.vCount; i++) {
                         short4 &c = mesh.vertices[i].coord;
                         stream.read(c.x);
@@ -5815,7 +5796,7 @@ namespace TR {
                     mesh.rCount = rCount + crCount;
                     mesh.tCount = tCount + ctCount;
                     mesh.fCount = mesh.rCount + mesh.tCount;
-                    mesh.faces  = mesh.fCount ? new Face[mesh.fCount] : NULL;
+                    mesh.faces  = mesh.fCount ? alloc<Face>(mesh.fCount, MEM_MESHES) : NULL;
 
                     int idx = 0;
                     stream.seek(sizeof(rCount));  for (int i = 0; i < rCount; i++)  readFace(stream, mesh.faces[idx++], false, false, false);
@@ -5840,7 +5821,7 @@ namespace TR {
                 case VER_TR2_PSX : {
                     int nCount = mesh.vCount;
                     mesh.vCount = abs(mesh.vCount);
-                    mesh.vertices = new Mesh::Vertex[mesh.vCount];
+                    mesh.vertices = alloc<Mesh::Vertex>(mesh.vCount, MEM_MESHES);
 
                     for (int i = 0; i < mesh.vCount; i++)
                         stream.read(mesh.vertices[i].coord);
@@ -5872,7 +5853,7 @@ namespace TR {
                     stream.setPos(tmp);
 
                     mesh.fCount = mesh.rCount + mesh.tCount;
-                    mesh.faces  = mesh.fCount ? new Face[mesh.fCount] : NULL;
+                    mesh.faces  = mesh.fCount ? alloc<Face>(mesh.fCount, MEM_MESHES) : NULL;
 
                     int idx = 0;
                     stream.seek(sizeof(mesh.rCount)); for (int i = 0; i < mesh.rCount; i++) readFace(stream, mesh.faces[idx++], false, false, false);
@@ -5909,7 +5890,7 @@ namespace TR {
                         break;
                     }
 
-                    mesh.vertices = new Mesh::Vertex[mesh.vCount];
+                    mesh.vertices = alloc<Mesh::Vertex>(mesh.vCount, MEM_MESHES);
 
                     for (int i = 0; i < mesh.vCount; i++)
                         stream.read(mesh.vertices[i].coord);
@@ -5930,7 +5911,7 @@ namespace TR {
                         stream.read(mesh.rCount);
                     }
                     mesh.fCount = mesh.rCount + mesh.tCount;
-                    mesh.faces  = mesh.fCount ? new Face[mesh.fCount] : NULL;
+                    mesh.faces  = mesh.fCount ? alloc<Face>(mesh.fCount, MEM_MESHES) : NULL;
 
                 // read triangles
                     int idx = 0;
@@ -6160,7 +6141,7 @@ namespace TR {
         }
 
         void readObjectTex(Stream &stream) {
-            objectTextures = stream.read(objectTexturesCount) ? new TextureInfo[objectTexturesCount] : NULL;
+            objectTextures = stream.read(objectTexturesCount) ? alloc<TextureInfo>(objectTexturesCount, MEM_TEXTURES) : NULL;
             for (int i = 0; i < objectTexturesCount; i++) {
                 readObjectTex(stream, objectTextures[i]);
             }
@@ -6242,11 +6223,11 @@ namespace TR {
         }
 
         void readSpriteTex(Stream &stream) {
-            spriteTextures = stream.read(spriteTexturesCount) ? new TextureInfo[spriteTexturesCount] : NULL;
+            spriteTextures = stream.read(spriteTexturesCount) ? alloc<TextureInfo>(spriteTexturesCount, MEM_TEXTURES) : NULL;
             for (int i = 0; i < spriteTexturesCount; i++)
                 readSpriteTex(stream, spriteTextures[i]);
 
-            spriteSequences = stream.read(spriteSequencesCount) ? new SpriteSequence[spriteSequencesCount] : NULL;
+            spriteSequences = stream.read(spriteSequencesCount) ? alloc<SpriteSequence>(spriteSequencesCount, MEM_TEXTURES) : NULL;
             for (int i = 0; i < spriteSequencesCount; i++) {
                 SpriteSequence &s = spriteSequences[i];
                 uint16 type;
@@ -6272,8 +6253,7 @@ namespace TR {
                     } else
                         i++;
 
-                if (!data.sCount && data.sprites) {
-                    delete[] data.sprites;
+                if (!data.sCount) {
                     data.sprites = NULL;
                 }
             }
@@ -6292,12 +6272,12 @@ namespace TR {
                 uint16 *ptr = animTexBlock;
 
                 animTexturesCount = *(ptr++);
-                animTextures = animTexturesCount ? new AnimTexture[animTexturesCount] : NULL;
+                animTextures = animTexturesCount ? alloc<AnimTexture>(animTexturesCount, MEM_TEXTURES) : NULL;
 
                 for (int i = 0; i < animTexturesCount; i++) {
                     AnimTexture &animTex = animTextures[i];
                     animTex.count    = *(ptr++) + 1;
-                    animTex.textures = new uint16[animTex.count];
+                    animTex.textures = alloc<uint16>(animTex.count, MEM_TEXTURES);
                     for (int j = 0; j < animTex.count; j++)
                         animTex.textures[j] = *(ptr++);
                 }
@@ -6312,7 +6292,7 @@ namespace TR {
 
         void readEntities(Stream &stream) {
             entitiesCount = stream.read(entitiesBaseCount) + MAX_RESERVED_ENTITIES;
-            entities = new Entity[entitiesCount];
+            entities = alloc<Entity>(entitiesCount, MEM_ENTITIES);
             for (int i = 0; i < entitiesBaseCount; i++) {
                 Entity &e = entities[i];
                 uint16 type;
@@ -10,11 +10,14 @@
 #include "savegame.h"
 
 #define MAX_CHEAT_SEQUENCE 8
+#define TICK_STEP          (1.0f / 30.0f) // fixed simulation step, matches the original animation rate
 
 namespace Game {
     Level      *level;
     Stream     *nextLevel;
+    TR::Level  *nextLevelData; // level data loaded in background (optional)
     ControlKey cheatSeq[MAX_PLAYERS][MAX_CHEAT_SEQUENCE];
+    float      tickTime;      // simulation time not yet consumed by ticks
 
     void cheatControl(int32 playerIndex) {
         ControlKey key = Input::lastState[playerIndex];
@@ -69,7 +72,9 @@ namespace Game {
             playVideo = !saveSlots[loadSlot].isCheckpoint();
 
         delete level;
-        level = new Level(*lvl);
+        level = new Level(*lvl, nextLevelData);
+        delete nextLevelData; // emptied by the Level constructor
+        nextLevelData = NULL;
 
         bool playLogo = level->level.isTitle() && id == TR::LVL_MAX;
         playVideo = playVideo && (id != level->level.id);
@@ -92,7 +97,8 @@ void loadLevelAsync(Stream *stream, void *userData) {
         if (Game::level) Game::level->isEnded = false;
         return;
     }
-    Game::nextLevel = stream;
+    Game::nextLevel     = stream;
+    Game::nextLevelData = (TR::Level*)userData;
 }
 
 void loadSettings(Stream *stream, void *userData) {
@@ -153,15 +159,17 @@ namespace Game {
     }
 
     void init(Stream *lvl) {
-        loadSlot    = -1;
-        nextLevel   = NULL;
-        shaderCache = NULL;
-        level       = NULL;
+        loadSlot      = -1;
+        nextLevel     = NULL;
+        nextLevelData = NULL;
+        shaderCache   = NULL;
+        level         = NULL;
 
         memset(cheatSeq, 0, sizeof(cheatSeq));
 
         Core::init();
         Sound::callback = stopChannel;
+        SaveWriter::init();
 
         if (lvl->size == -1) {
             delete lvl;
@@ -194,7 +202,12 @@ namespace Game {
     }
 
     void deinit() {
+    #ifdef LEVEL_PRELOAD
+        LevelPreload::cancel();
+    #endif
+        SaveWriter::deinit();
         freeSaveSlots();
+        Input::Record::stop();
 
         #ifdef DEBUG_RENDER
             Debug::deinit();
@@ -237,6 +250,18 @@ namespace Game {
         Core::deltaTime = dt;
     }
 
+    uint32 getSyncHash() {
+        uint32 hash = fnv32((const char*)&level->level.id, sizeof(level->level.id));
+        for (int i = 0; i < MAX_PLAYERS; i++) {
+            Lara *lara = level->players[i];
+            if (!lara) continue;
+            hash = fnv32((const char*)&lara->pos,    sizeof(lara->pos),    hash);
+            hash = fnv32((const char*)&lara->angle,  sizeof(lara->angle),  hash);
+            hash = fnv32((const char*)&lara->health, sizeof(lara->health), hash);
+        }
+        return hash;
+    }
+
     void quickSave() {
         if (!level || TR::isTitleLevel(level->level.id) || TR::isCutsceneLevel(level->level.id)) {
             return;
@@ -278,6 +303,18 @@ namespace Game {
         if (!Core::update())
             return false;
 
+        if (Input::Record::isActive())
+            Input::Record::frame(getSyncHash());
+
+        SaveResult result;
+        if (SaveWriter::update(result)) {
+            saveResult = result;
+            if (result == SAVE_RESULT_SUCCESS)
+                UI::showHint(STR_HINT_SAVING_DONE, 1.0f);
+            else
+                UI::showHint(STR_HINT_SAVING_ERROR, 3.0f);
+        }
+
         float delta = Core::deltaTime;
 
         if (nextLevel) {
@@ -317,14 +354,29 @@ namespace Game {
         if (!level->level.isCutsceneLevel())
             delta = min(0.2f, delta);
 
-        while (delta > EPS) {
-            Core::deltaTime = min(delta, 1.0f / 30.0f);
+    #ifdef _OS_SERVER
+        delta = TICK_STEP; // the server calls update once per tick, ms clock rounding must not skip or double ticks
+    #endif
+
+    // simulation runs at a fixed rate, the remainder is carried over to the next frame
+    // and rendering interpolates controllers and camera between the last two ticks
+        tickTime += delta;
+        Core::tickAlpha = 1.0f;
+
+        while (tickTime >= TICK_STEP) {
+            Core::deltaTime = TICK_STEP;
+            Core::tickIndex++;
             Game::updateTick();
-            delta -= Core::deltaTime;
-            if (Core::resetState) // resetTime was called
+            tickTime -= TICK_STEP;
+            if (Core::resetState) { // resetTime was called
+                tickTime = 0.0f;
                 break;
+            }
         }
 
+        Core::tickAlpha = tickTime / TICK_STEP;
+        Core::deltaTime = delta;
+
         return true;
     }
 
@@ -561,8 +561,10 @@ namespace GAPI {
         GLuint  ID;
         int32   uID[uMAX];
 
-        vec4  cbMem[98 + MAX_CONTACTS];
-        int   cbCount[uMAX];
+    // shadow copy of the program uniforms, only changed ranges are marked dirty and uploaded before the draw
+        vec4   cbMem[98 + MAX_CONTACTS];
+        int    cbCount[uMAX];
+        uint32 cbDirty;
 
         bool  rebind;
 
@@ -688,6 +690,12 @@ namespace GAPI {
             for (int ut = 0; ut < uMAX; ut++)
                 uID[ut] = glGetUniformLocation(ID, (GLchar*)UniformName[ut]);
 
+        // uniforms are zero after linking
+            for (int i = 0; i < COUNT(cbMem); i++)
+                cbMem[i] = vec4(0.0f);
+            memset(cbCount, 0, sizeof(cbCount));
+            cbDirty = 0;
+
             rebind = true;
         }
 
@@ -761,7 +769,6 @@ namespace GAPI {
         void bind() {
             if (Core::active.shader != this) {
                 Core::active.shader = this;
-                memset(cbCount, 0, sizeof(cbCount));
                 rebind = true;
             }
         }
@@ -772,8 +779,8 @@ namespace GAPI {
                 rebind = false;
             }
 
-            for (int uType = 0; uType < uMAX; uType++) {
-                if (!cbCount[uType]) continue;
+            for (int uType = 0; cbDirty; uType++, cbDirty >>= 1) {
+                if (!(cbDirty & 1)) continue;
 
                 const Binding &b = bindings[uType];
 
@@ -788,8 +795,17 @@ namespace GAPI {
         }
         
         void setParam(UniformType uType, float *value, int count) {
-            cbCount[uType] = count;
-            memcpy(cbMem + bindings[uType].reg, value, count * 16);
+            vec4 *dst = cbMem + bindings[uType].reg;
+            uint32 mask = 1 << uType;
+
+            if (!(cbDirty & mask)) {
+                if (!memcmp(dst, value, count * 16))
+                    return; // the program already has these values
+                cbDirty |= mask;
+            }
+
+            cbCount[uType] = max(cbCount[uType], count); // keep pending values of the previous set
+            memcpy(dst, value, count * 16);
         }
 
         void setParam(UniformType uType, const vec4 &value, int count = 1) {
@@ -994,6 +1010,8 @@ namespace GAPI {
     };
 
 // Mesh
+    #define DYN_MESH_RING 4 // dynamic VBO holds this many full batches before it's orphaned
+
     struct Mesh {
         Index  *iBuffer;
         Vertex *vBuffer;
@@ -1005,7 +1023,12 @@ namespace GAPI {
         int    aCount;
         bool   dynamic;
 
-        Mesh(bool dynamic) : iBuffer(NULL), vBuffer(NULL), VAO(NULL), dynamic(dynamic) {
+    // dynamic geometry is appended to the ring and never overwrites the data of in-flight draws
+        Index  *iStreamData;
+        int    iStream, vStream;
+        int    iBase;
+
+        Mesh(bool dynamic) : iBuffer(NULL), vBuffer(NULL), VAO(NULL), dynamic(dynamic), iStreamData(NULL), iStream(0), vStream(0), iBase(0) {
             ID[0] = ID[1] = 0;
         }
 
@@ -1029,10 +1052,15 @@ namespace GAPI {
 
             if (useVBO) {
                 glGenBuffers(2, ID);
-                glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ID[0]);
-                glBindBuffer(GL_ARRAY_BUFFER,         ID[1]);
-                glBufferData(GL_ELEMENT_ARRAY_BUFFER, iCount * sizeof(Index),  indices,  dynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
-                glBufferData(GL_ARRAY_BUFFER,         vCount * sizeof(Vertex), vertices, dynamic ? GL_DYNAMIC_DRAW : GL_STATIC_DRAW);
+                if (dynamic) {
+                    iStreamData = new Index[iCount];
+                    orphan();
+                } else {
+                    glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, ID[0]);
+                    glBindBuffer(GL_ARRAY_BUFFER,         ID[1]);
+                    glBufferData(GL_ELEMENT_ARRAY_BUFFER, iCount * sizeof(Index),  indices,  GL_STATIC_DRAW);
+                    glBufferData(GL_ARRAY_BUFFER,         vCount * sizeof(Vertex), vertices, GL_STATIC_DRAW);
+                }
             } else {
                 iBuffer = new Index[iCount];
                 vBuffer = new GAPI::Vertex[vCount];
@@ -1055,7 +1083,37 @@ namespace GAPI {
                     delete[] VAO;
                 }
                 glDeleteBuffers(2, ID);
+                delete[] iStreamData;
+            }
+        }
+
+    // replace the ring storage, the driver keeps the old one alive until the draws using it are done
+        void orphan() {
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, Core::active.iBuffer = ID[0]);
+            glBindBuffer(GL_ARRAY_BUFFER,         Core::active.vBuffer = ID[1]);
+            glBufferData(GL_ELEMENT_ARRAY_BUFFER, iCount * DYN_MESH_RING * sizeof(Index),  NULL, GL_STREAM_DRAW);
+            glBufferData(GL_ARRAY_BUFFER,         vCount * DYN_MESH_RING * sizeof(Vertex), NULL, GL_STREAM_DRAW);
+            iStream = vStream = 0;
+        }
+
+        void stream(Index *indices, int iCount, ::Vertex *vertices, int vCount) {
+            if (iStream + iCount > this->iCount * DYN_MESH_RING || vStream + vCount > this->vCount * DYN_MESH_RING) {
+                orphan();
+            }
+
+        // indices are relative to the batch, shift them to its place in the ring
+            for (int i = 0; i < iCount; i++) {
+                iStreamData[i] = indices[i] + vStream;
             }
+
+            glBindBuffer(GL_ELEMENT_ARRAY_BUFFER, Core::active.iBuffer = ID[0]);
+            glBindBuffer(GL_ARRAY_BUFFER,         Core::active.vBuffer = ID[1]);
+            glBufferSubData(GL_ELEMENT_ARRAY_BUFFER, iStream * sizeof(Index),  iCount * sizeof(Index),  iStreamData);
+            glBufferSubData(GL_ARRAY_BUFFER,         vStream * sizeof(Vertex), vCount * sizeof(Vertex), vertices);
+
+            iBase    = iStream;
+            iStream += iCount;
+            vStream += vCount;
         }
 
         void update(Index *indices, int iCount, ::Vertex *vertices, int vCount) {
@@ -1064,6 +1122,13 @@ namespace GAPI {
             if (Core::support.VAO && Core::active.VAO != 0)
                 glBindVertexArray(Core::active.VAO = 0);
 
+            if (iStreamData) {
+                if (indices && iCount && vertices && vCount) {
+                    stream(indices, iCount, vertices, vCount);
+                }
+                return;
+            }
+
             if (indices && iCount) {
                 if (iBuffer) {
                     memcpy(iBuffer, indices, iCount * sizeof(Index));
@@ -1749,7 +1814,7 @@ namespace GAPI {
             Core::active.shader->validate();
         }
 
-        glDrawElements(GL_TRIANGLES, range.iCount, sizeof(Index) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, mesh->iBuffer + range.iStart);
+        glDrawElements(GL_TRIANGLES, range.iCount, sizeof(Index) == 2 ? GL_UNSIGNED_SHORT : GL_UNSIGNED_INT, mesh->iBuffer + mesh->iBase + range.iStart);
     }
 
     vec4 copyPixel(int x, int y) {
@@ -28,6 +28,9 @@
 
 #define SW_MAX_DIST  (20.0f * 1024.0f)
 #define SW_FOG_START (12.0f * 1024.0f)
+#define SW_REFRACT   0.5f // units per water slope step
+#define SW_HIZ_SHIFT 3    // 8x8 pixels per depth tile
+#define SW_DEPTH_MAX 32767.0f // 15-bit depth keeps the signed 16.16 VertexSW::z from overflow
 
 namespace GAPI {
 
@@ -53,7 +56,8 @@ namespace GAPI {
     Tile8   *curTile;
 
     uint8 ambient;
-    int32 lightsCount;
+    int32 lightsCount, lightsRelCount;
+    bool  mainLight;       // lights[0] is the nearest static light of the entity
 
     struct LightSW {
         uint32 intensity;
@@ -61,6 +65,24 @@ namespace GAPI {
         float  radius;
     } lights[MAX_LIGHTS], lightsRel[MAX_LIGHTS];
 
+// static room lights of the entity sector (LightCache), replaces the main light
+    vec3  sectorLight;     // direction * intensity
+    vec3  sectorLightRel;
+    bool  sectorLightActive;
+
+    Array<int32> swLighting; // per vertex of the batch
+    Array<float> swBatch;
+
+// water surface lookup of the underwater room (WaterCache)
+    struct WaterSW {
+        const uint8 *caustics;  // light focused by the surface
+        const int8  *slope;     // surface dx, dz for refraction
+        int32       width, height;
+        vec4        rect;       // lookup origin xz, texels per unit
+        vec4        rowX, rowZ; // model to world
+        vec3        normalY;
+    } swWater;
+
 // Shader
     struct Shader {
         void init(Pass pass, int type, int *def, int defCount) {}
@@ -174,6 +196,23 @@ namespace GAPI {
     ColorSW *swColor;
     DepthSW *swDepth;
     short4  swClipRect;
+    int32   swWidth, swHeight; // size of the bound target
+
+// render to texture, only the upscale target is supported (depth buffer and tiles are sized to the screen)
+// swColor points to the texture memory until the frame is bound back, other targets are ignored
+    ColorSW *swFrame;
+    Texture *swTarget;
+    Texture *swUpscaleTarget;
+
+// hierarchical-Z, coarse depth tiles over swDepth
+    enum { HIZ_HIDDEN, HIZ_PARTIAL, HIZ_FRONT };
+
+    DepthSW *swTileMin;   // nearest depth written into the tile
+    DepthSW *swTileMax;   // farthest depth of the tile pixels, recalculated if dirty
+    uint8   *swTileDirty;
+    int32   swTilesX, swTilesY;
+    bool    swDepthEnable, swDepthWrite;
+    bool    swDepthTest; // per primitive, false if it's in front of the tiles
 
     struct VertexSW {
         int32 x, y, z, w;
@@ -236,20 +275,52 @@ namespace GAPI {
     void init() {
         LOG("Renderer : %s\n", "Software");
         LOG("Version  : %s\n", "0.1");
-        swDepth = NULL;
+        support.texNPOT = true; // textures are plain memory blocks
+        swDepth     = NULL;
+        swTarget    = NULL;
+        swUpscaleTarget = NULL;
+        swTileMin   = NULL;
+        swTileMax   = NULL;
+        swTileDirty = NULL;
+        swDepthTest = swDepthEnable = swDepthWrite = true;
     }
 
     void deinit() {
         delete[] swDepth;
+        delete[] swTileMin;
+        delete[] swTileMax;
+        delete[] swTileDirty;
         swVertices.clear();
         swIndices.clear();
         swTriangles.clear();
         swQuads.clear();
+        swLighting.clear();
+        swBatch.clear();
+    }
+
+    void clear(bool color, bool depth);
+
+    void setTargetSize(int32 width, int32 height) {
+        swWidth  = width;
+        swHeight = height;
+        swTilesX = (width  + (1 << SW_HIZ_SHIFT) - 1) >> SW_HIZ_SHIFT;
+        swTilesY = (height + (1 << SW_HIZ_SHIFT) - 1) >> SW_HIZ_SHIFT;
     }
 
     void resize() {
         delete[] swDepth;
-        //swDepth = new DepthSW[Core::width * Core::height];
+        delete[] swTileMin;
+        delete[] swTileMax;
+        delete[] swTileDirty;
+
+        setTargetSize(Core::width, Core::height);
+
+        swDepth     = new DepthSW[Core::width * Core::height];
+        swTileMin   = new DepthSW[swTilesX * swTilesY];
+        swTileMax   = new DepthSW[swTilesX * swTilesY];
+        swTileDirty = new uint8[swTilesX * swTilesY];
+
+        clear(false, true);
     }
 
     inline mat4::ProjRange getProjRange() {
@@ -276,7 +347,47 @@ namespace GAPI {
 
     void resetState() {}
 
-    void bindTarget(Texture *texture, int face) {}
+    void setUpscaleTarget(Texture *texture) {
+        ASSERT(!texture || (texture->memory && texture->width * texture->height <= Core::width * Core::height));
+        swUpscaleTarget = texture;
+    }
+
+    void bindTarget(Texture *texture, int face) {
+        if (texture && texture != swUpscaleTarget) {
+            return;
+        }
+
+        if (!swTarget) {
+            swFrame = swColor; // platform can reallocate the frame buffer on resize
+        }
+        swTarget = texture;
+
+        if (texture) {
+            swColor = (ColorSW*)texture->memory;
+            setTargetSize(texture->width, texture->height);
+        } else {
+            swColor = swFrame;
+            setTargetSize(Core::width, Core::height);
+        }
+    }
+
+// nearest neighbour stretch of the low resolution target to the frame buffer
+    void upscale(Texture *texture) {
+        ASSERT(!swTarget && texture->memory);
+
+        const ColorSW *src = (ColorSW*)texture->memory;
+        ColorSW *dst = swColor;
+
+        int32 du = (texture->origWidth  << 16) / swWidth;
+        int32 dv = (texture->origHeight << 16) / swHeight;
+
+        for (int32 y = 0, v = 0; y < swHeight; y++, v += dv) {
+            const ColorSW *row = src + (v >> 16) * texture->width;
+            for (int32 x = 0, u = 0; x < swWidth; x++, u += du) {
+                *dst++ = row[u >> 16];
+            }
+        }
+    }
 
     void discardTarget(bool color, bool depth) {}
 
@@ -288,11 +399,14 @@ namespace GAPI {
 
     void clear(bool color, bool depth) {
         if (color) {
-            memset(swColor, 0x00, Core::width * Core::height * sizeof(ColorSW));
+            memset(swColor, 0x00, swWidth * swHeight * sizeof(ColorSW));
         }
 
-        if (depth) {
-            //memset(swDepth, 0xFF, Core::width * Core::height * sizeof(DepthSW));
+        if (depth && swDepth) {
+            memset(swDepth,     0xFF, swWidth * swHeight * sizeof(DepthSW));
+            memset(swTileMin,   0xFF, swTilesX * swTilesY * sizeof(DepthSW));
+            memset(swTileMax,   0xFF, swTilesX * swTilesY * sizeof(DepthSW));
+            memset(swTileDirty, 0x00, swTilesX * swTilesY * sizeof(uint8));
         }
     }
 
@@ -307,9 +421,13 @@ namespace GAPI {
         swClipRect.w = Core::active.viewport.w - s.y;
     }
 
-    void setDepthTest(bool enable) {}
+    void setDepthTest(bool enable) {
+        swDepthEnable = enable;
+    }
 
-    void setDepthWrite(bool enable) {}
+    void setDepthWrite(bool enable) {
+        swDepthWrite = enable;
+    }
 
     void setColorWrite(bool r, bool g, bool b, bool a) {}
 
@@ -325,10 +443,14 @@ namespace GAPI {
         ambient = clamp(int32(active.material.y * 255), 0, 255);
 
         lightsCount = 0;
+        mainLight   = false;
         for (int i = 0; i < count; i++) {
             if (lightColor[i].w >= 1.0f) {
                 continue;
             }
+            if (i == 0) {
+                mainLight = true;
+            }
             LightSW &light = lights[lightsCount++];
             vec4 &c = lightColor[i];
             light.intensity = uint32(((c.x + c.y + c.z) / 3.0f) * 255.0f);
@@ -378,6 +500,75 @@ namespace GAPI {
         49152,     0,       32768, 16384    // (xx yy) for (y & 1 == 1)
     };
 
+    inline void updateTiles(int32 y, int32 x1, int32 x2, DepthSW z) {
+        int32 row = (y >> SW_HIZ_SHIFT) * swTilesX;
+        for (int32 t = row + (x1 >> SW_HIZ_SHIFT); t <= row + ((x2 - 1) >> SW_HIZ_SHIFT); t++) {
+            swTileMin[t]   = min(swTileMin[t], z);
+            swTileDirty[t] = 1;
+        }
+    }
+
+    DepthSW getTileMax(int32 tx, int32 ty) {
+        int32 t = ty * swTilesX + tx;
+        if (swTileDirty[t]) {
+            int32 x1 = tx << SW_HIZ_SHIFT, x2 = min(x1 + (1 << SW_HIZ_SHIFT), swWidth);
+            int32 y1 = ty << SW_HIZ_SHIFT, y2 = min(y1 + (1 << SW_HIZ_SHIFT), swHeight);
+
+            DepthSW zMax = 0;
+            for (int32 y = y1; y < y2; y++) {
+                const DepthSW *depth = swDepth + y * swWidth;
+                for (int32 x = x1; x < x2; x++) {
+                    zMax = max(zMax, depth[x]);
+                }
+            }
+            swTileMax[t]   = zMax;
+            swTileDirty[t] = 0;
+        }
+        return swTileMax[t];
+    }
+
+// HIZ_HIDDEN - all the tiles are nearer than zMin, HIZ_FRONT - the rect is nearer than all the written pixels
+    int32 testTiles(int32 x1, int32 y1, int32 x2, int32 y2, DepthSW zMin, DepthSW zMax) {
+        x1 = max(x1, int32(swClipRect.x));
+        y1 = max(y1, int32(swClipRect.y));
+        x2 = min(x2, int32(swClipRect.z) - 1);
+        y2 = min(y2, int32(swClipRect.w) - 1);
+
+        if (x1 > x2 || y1 > y2) {
+            return HIZ_PARTIAL;
+        }
+
+        bool hidden = true;
+        bool front  = true;
+
+        for (int32 ty = y1 >> SW_HIZ_SHIFT; ty <= (y2 >> SW_HIZ_SHIFT); ty++) {
+            for (int32 tx = x1 >> SW_HIZ_SHIFT; tx <= (x2 >> SW_HIZ_SHIFT); tx++) {
+                front  = front  && zMax < swTileMin[ty * swTilesX + tx];
+                hidden = hidden && zMin > getTileMax(tx, ty);
+                if (!hidden && !front) {
+                    return HIZ_PARTIAL;
+                }
+            }
+        }
+
+        return hidden ? HIZ_HIDDEN : HIZ_FRONT;
+    }
+
+    int32 testPrimitive(const VertexSW **v, int32 count) {
+        int32 x1 = v[0]->x, x2 = x1;
+        int32 y1 = v[0]->y, y2 = y1;
+        uint32 z1 = uint32(v[0]->z), z2 = z1;
+        for (int32 i = 1; i < count; i++) {
+            x1 = min(x1, v[i]->x);
+            x2 = max(x2, v[i]->x);
+            y1 = min(y1, v[i]->y);
+            y2 = max(y2, v[i]->y);
+            z1 = min(z1, uint32(v[i]->z));
+            z2 = max(z2, uint32(v[i]->z));
+        }
+        return testTiles(x1 >> 16, y1, x2 >> 16, y2, DepthSW(z1 >> 16), DepthSW(z2 >> 16));
+    }
+
     void drawLine(const VertexSW &L, const VertexSW &R, int32 y) {
         int32 x1 = L.x >> 16;
         int32 x2 = R.x >> 16;
@@ -396,7 +587,11 @@ namespace GAPI {
         }
         if (x2 > swClipRect.z) x2 = swClipRect.z;
 
-        int32 i = y * Core::width;
+        if (x1 >= x2) return;
+
+        int32 i = y * swWidth;
+
+        DepthSW zMin = DepthSW(uint32(S.z + dS.z) >> 16);
 
     #ifdef DITHER_FILTER
         const int *dithY = uvDither + ((y & 1) * 4);
@@ -407,7 +602,7 @@ namespace GAPI {
 
             DepthSW z = DepthSW(uint32(S.z) >> 16);
 
-            {//if (swDepth[x] >= z) {
+            if (!swDepthTest || swDepth[x] >= z) {
             #ifdef DITHER_FILTER
                 const int *dithX = dithY + (x & 1);
 
@@ -424,12 +619,18 @@ namespace GAPI {
                     index = swLightmap[((S.l >> (16 + 3)) << 8) + index];
 
                     swColor[x] = swPalette[index];
-                    //swDepth[x] = z;
+                    if (swDepthWrite) {
+                        swDepth[x] = z;
+                    }
                 }
             }
 
             step(S, dS);
         }
+
+        if (swDepthWrite) {
+            updateTiles(y, x1, x2, min(zMin, DepthSW(uint32(S.z) >> 16)));
+        }
     }
 
     void drawPart(const VertexSW &a, const VertexSW &b, const VertexSW &c, const VertexSW &d) {
@@ -507,6 +708,15 @@ namespace GAPI {
         if (b->y < swClipRect.y || t->y > swClipRect.w)
             return;
 
+        const VertexSW *v[3] = { t, m, b };
+        int32 hiz = swDepthEnable ? testPrimitive(v, 3) : HIZ_FRONT;
+        if (hiz == HIZ_HIDDEN) {
+            Core::stats.culled++;
+            return;
+        }
+        swDepthTest = hiz != HIZ_FRONT;
+        Core::stats.drawn++;
+
         *n = ((*b - *t) / (b->y - t->y) * (m->y - t->y)) + *t;
         n->y = m->y;
 
@@ -556,6 +766,15 @@ namespace GAPI {
         if (b->y < swClipRect.y || t->y > swClipRect.w)
             return;
 
+        const VertexSW *v[4] = { t, m, b, o };
+        int32 hiz = swDepthEnable ? testPrimitive(v, 4) : HIZ_FRONT;
+        if (hiz == HIZ_HIDDEN) {
+            Core::stats.culled += 2;
+            return;
+        }
+        swDepthTest = hiz != HIZ_FRONT;
+        Core::stats.drawn += 2;
+
         if (checkBackface(t, b, m) == checkBackface(t, b, o)) {
 
             VertexSW d = (*b - *t) / (b->y - t->y);
@@ -588,19 +807,66 @@ namespace GAPI {
         if (o->y != b->y) drawPart(*p, *o, *b, *b);
     }
 
-    void applyLighting(VertexSW &result, const Vertex &vertex, float depth) {
-        vec3 coord  = vec3(float(vertex.coord.x), float(vertex.coord.y), float(vertex.coord.z));
-        vec3 normal = vec3(float(vertex.normal.x), float(vertex.normal.y), float(vertex.normal.z)).normal();
-        float lighting = 0.0f;
-        for (int i = 0; i < lightsCount; i++) {
-            LightSW &light = lightsRel[i];
-            vec3 dir = (light.pos - coord) * light.radius;
-            float att = dir.length2();
-            float lum = normal.dot(dir / sqrtf(att));
-            lighting += (max(0.0f, lum) * max(0.0f, 1.0f - att)) * light.intensity;
+// normal dependent lighting of the batch vertices, light by light over SoA arrays to let the compiler vectorize the loops
+    void lightVertices(const Vertex *vertices, int32 count) {
+        swLighting.resize(count);
+
+        if (!lightsRelCount && !sectorLightActive) {
+            memset(swLighting.items, 0, count * sizeof(int32));
+            return;
+        }
+
+        swBatch.resize(count * 7);
+        float *nx = swBatch.items;
+        float *ny = nx + count;
+        float *nz = ny + count;
+        float *px = nz + count;
+        float *py = px + count;
+        float *pz = py + count;
+        float *lighting = pz + count;
+
+        for (int32 i = 0; i < count; i++) {
+            const Vertex &v = vertices[i];
+            float x = v.normal.x, y = v.normal.y, z = v.normal.z;
+            float len2 = x * x + y * y + z * z;
+            float s = len2 > 0.0f ? 1.0f / sqrtf(len2) : 0.0f;
+            nx[i] = x * s;
+            ny[i] = y * s;
+            nz[i] = z * s;
+            px[i] = v.coord.x;
+            py[i] = v.coord.y;
+            pz[i] = v.coord.z;
+        }
+
+        if (sectorLightActive) {
+            const vec3 &L = sectorLightRel;
+            for (int32 i = 0; i < count; i++) {
+                lighting[i] = max(0.0f, nx[i] * L.x + ny[i] * L.y + nz[i] * L.z);
+            }
+        } else {
+            memset(lighting, 0, count * sizeof(float));
+        }
+
+        for (int32 j = 0; j < lightsRelCount; j++) {
+            const LightSW &light = lightsRel[j];
+            const float intensity = float(light.intensity);
+            for (int32 i = 0; i < count; i++) {
+                float dx = (light.pos.x - px[i]) * light.radius;
+                float dy = (light.pos.y - py[i]) * light.radius;
+                float dz = (light.pos.z - pz[i]) * light.radius;
+                float att = dx * dx + dy * dy + dz * dz;
+                float lum = (nx[i] * dx + ny[i] * dy + nz[i] * dz) / sqrtf(max(att, 1e-6f));
+                lighting[i] += (max(0.0f, lum) * max(0.0f, 1.0f - att)) * intensity;
+            }
+        }
+
+        for (int32 i = 0; i < count; i++) {
+            swLighting[i] = int32(lighting[i]);
         }
+    }
 
-        lighting += result.l;
+    void applyLighting(VertexSW &result, int32 light, float depth) {
+        float lighting = float(light + result.l);
 
         depth -= SW_FOG_START;
         if (depth > 0.0f) {
@@ -610,20 +876,77 @@ namespace GAPI {
         result.l = (255 - min(255, int32(lighting))) << 16;
     }
 
-    bool transform(const Index *indices, const Vertex *vertices, int iStart, int iCount, int vStart) {
+    int32 getWaterIndex(const Vertex &vertex) {
+        vec4 coord = vec4(float(vertex.coord.x), float(vertex.coord.y), float(vertex.coord.z), 1.0f);
+        int32 x = int32((swWater.rowX.dot(coord) - swWater.rect.x) * swWater.rect.z);
+        int32 z = int32((swWater.rowZ.dot(coord) - swWater.rect.y) * swWater.rect.z);
+        if (x < 0 || z < 0 || x >= swWater.width || z >= swWater.height) {
+            return -1;
+        }
+        return z * swWater.width + x;
+    }
+
+    mat4 getMatrix(const mat4 &model) {
+        mat4 m;
+        m.viewport(0.0f, (float)swHeight, (float)swWidth, -(float)swHeight, 0.0f, 1.0f);
+        return m * mViewProj * model;
+    }
+
+// conservative test of the model space box against the depth tiles
+    bool isOccluded(const mat4 &model, const vec3 &boxMin, const vec3 &boxMax) {
+        if (!swDepth || !swDepthEnable) return false;
+
+        mat4 m = getMatrix(model);
+        Box box(boxMin, boxMax);
+
+        float x1 = INF, y1 = INF, z1 = INF;
+        float x2 = -INF, y2 = -INF;
+        for (int i = 0; i < 8; i++) {
+            vec3 p = box[i];
+            vec4 c = m * vec4(p.x, p.y, p.z, 1.0f);
+            if (c.w <= 1.0f) { // crosses the near plane
+                return false;
+            }
+            c.x /= c.w;
+            c.y /= c.w;
+            c.z /= c.w;
+            x1 = min(x1, c.x);
+            y1 = min(y1, c.y);
+            z1 = min(z1, c.z);
+            x2 = max(x2, c.x);
+            y2 = max(y2, c.y);
+        }
+
+        x1 = clamp(x1, -16384.0f, 16384.0f);
+        y1 = clamp(y1, -16384.0f, 16384.0f);
+        x2 = clamp(x2, -16384.0f, 16384.0f);
+        y2 = clamp(y2, -16384.0f, 16384.0f);
+
+        DepthSW z = DepthSW(clamp(z1, 0.0f, 1.0f) * SW_DEPTH_MAX);
+        return testTiles(int32(x1) - 1, int32(y1) - 1, int32(x2) + 1, int32(y2) + 1, z, 0xFFFF) == HIZ_HIDDEN;
+    }
+
+    bool isOccluded(const Box &box) {
+        mat4 m;
+        m.identity();
+        return isOccluded(m, box.min, box.max);
+    }
+
+    bool transform(const Index *indices, const Vertex *vertices, int iStart, int iCount, int vStart, int32 vMin, int32 vMax) {
         swVertices.reset();
         swIndices.reset();
         swTriangles.reset();
         swQuads.reset();
 
-        mat4 swMatrix;
-        swMatrix.viewport(0.0f, (float)Core::height, (float)Core::width, -(float)Core::height, 0.0f, 1.0f);
-        swMatrix = swMatrix * mViewProj * mModel;
+        mat4 swMatrix = getMatrix(mModel);
 
         const bool colored = vertices[vStart + indices[iStart]].color.w == 142;
         int vIndex = 0;
         bool isTriangle = false;
 
+    // light every referenced vertex once, indices share them between faces
+        lightVertices(vertices + vStart + vMin, vMax - vMin + 1);
+
         for (int i = 0; i < iCount; i++) {
             const Index  index   = indices[iStart + i];
             const Vertex &vertex = vertices[vStart + index];
@@ -640,8 +963,19 @@ namespace GAPI {
                 }
             }
 
-            vec4 c;
-            c = swMatrix * vec4(vertex.coord.x, vertex.coord.y, vertex.coord.z, 1.0f);
+            vec4 c = vec4(vertex.coord.x, vertex.coord.y, vertex.coord.z, 1.0f);
+
+            int32 water = -1;
+            if (swWater.caustics || swWater.slope) {
+                water = getWaterIndex(vertex);
+            }
+
+            if (water >= 0 && swWater.slope) {
+                c.x += swWater.slope[water * 2 + 0] * SW_REFRACT;
+                c.z += swWater.slope[water * 2 + 1] * SW_REFRACT;
+            }
+
+            c = swMatrix * c;
 
             if (c.w < 0.0f || c.w > SW_MAX_DIST) { // skip primitive
                 if (isTriangle) {
@@ -662,7 +996,7 @@ namespace GAPI {
             VertexSW result;
             result.x = int32(c.x) << 16;
             result.y = int32(c.y);
-            result.z = uint32(clamp(c.z, 0.0f, 1.0f) * 65535.0f) << 16;
+            result.z = int32(clamp(c.z, 0.0f, 1.0f) * SW_DEPTH_MAX) << 16;
             result.w = int32(c.w);
 
             if (colored) {
@@ -675,7 +1009,12 @@ namespace GAPI {
             result.w = result.w << 16;
             result.l = ((vertex.light.x * ambient) >> 8);
 
-            applyLighting(result, vertex, c.w);
+            if (water >= 0 && swWater.caustics) {
+                vec3 normal = vec3(float(vertex.normal.x), float(vertex.normal.y), float(vertex.normal.z)).normal();
+                result.l += int32(swWater.caustics[water] * max(0.0f, -swWater.normalY.dot(normal)));
+            }
+
+            applyLighting(result, swLighting[index - vMin], c.w);
 
             swIndices.push(swVertices.push(result));
 
@@ -692,23 +1031,63 @@ namespace GAPI {
     }
 
     void transformLights() {
-        memcpy(lightsRel, lights, sizeof(LightSW) * lightsCount);
+        int32 first = (mainLight && sectorLightActive) ? 1 : 0;
+        lightsRelCount = lightsCount - first;
+        memcpy(lightsRel, lights + first, sizeof(LightSW) * lightsRelCount);
 
         mat4 mModelInv = mModel.inverseOrtho();
-        for (int i = 0; i < lightsCount; i++) {
-            lightsRel[i].pos = mModelInv * lights[i].pos;
+        for (int i = 0; i < lightsRelCount; i++) {
+            lightsRel[i].pos = mModelInv * lightsRel[i].pos;
+        }
+
+        if (sectorLightActive) {
+            sectorLightRel = (mModelInv * vec4(sectorLight, 0.0f)).xyz();
         }
     }
 
+    void transformWater() {
+        if (!swWater.caustics && !swWater.slope) return;
+
+        swWater.rowX    = vec4(mModel.e00, mModel.e01, mModel.e02, mModel.e03);
+        swWater.rowZ    = vec4(mModel.e20, mModel.e21, mModel.e22, mModel.e23);
+        swWater.normalY = vec3(mModel.e10, mModel.e11, mModel.e12);
+    }
+
     void DIP(Mesh *mesh, const MeshRange &range) {
         if (curTile == NULL) {
             //uint32 *tex = (uint32*)Core::active.textures[0]->memory; // TODO
             return;
         }
 
+        int32 vMin = 0x7FFFFFFF, vMax = -1;
+        for (int i = 0; i < range.iCount; i++) {
+            int32 index = mesh->iBuffer[range.iStart + i];
+            vMin = min(vMin, index);
+            vMax = max(vMax, index);
+        }
+
+    // reject the whole range by its bounds
+        const Vertex *vertices = mesh->vBuffer + range.vStart;
+        short3 boxMin = short3(32767, 32767, 32767), boxMax = short3(-32768, -32768, -32768);
+        for (int32 i = vMin; i <= vMax; i++) {
+            const short4 &p = vertices[i].coord;
+            boxMin.x = min(boxMin.x, p.x);
+            boxMin.y = min(boxMin.y, p.y);
+            boxMin.z = min(boxMin.z, p.z);
+            boxMax.x = max(boxMax.x, p.x);
+            boxMax.y = max(boxMax.y, p.y);
+            boxMax.z = max(boxMax.z, p.z);
+        }
+
+        if (isOccluded(mModel, vec3(boxMin.x, boxMin.y, boxMin.z), vec3(boxMax.x, boxMax.y, boxMax.z))) {
+            Core::stats.culled += range.iCount / 3;
+            return;
+        }
+
         transformLights();
+        transformWater();
 
-        bool colored = transform(mesh->iBuffer, mesh->vBuffer, range.iStart, range.iCount, range.vStart);
+        bool colored = transform(mesh->iBuffer, mesh->vBuffer, range.iStart, range.iCount, range.vStart, vMin, vMax);
 
         Tile8 *oldTile = curTile;
 
@@ -753,6 +1132,19 @@ namespace GAPI {
         swLightmap = enabled ? swLightmapShade : swLightmapNone;
     }
 
+    void setSectorLight(const vec3 &light) {
+        sectorLight       = light;
+        sectorLightActive = light.length2() > 0.0f;
+    }
+
+    void setWaterLookup(const uint8 *caustics, const int8 *slope, int width, int height, const vec4 &rect) {
+        swWater.caustics = caustics;
+        swWater.slope    = slope;
+        swWater.width    = width;
+        swWater.height   = height;
+        swWater.rect     = rect;
+    }
+
     vec4 copyPixel(int x, int y) {
         return vec4(0.0f); // TODO: read from framebuffer
     }
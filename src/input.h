@@ -228,7 +228,387 @@ namespace Input {
     }
 
 
+// input recording
+// every Game::update frame is stored as a group of its delta time (in ms), keyboard state and
+// resolved controls of each simulation tick, so a replay doesn't depend on key bindings or devices
+// groups are delta coded against the previous one and runs of identical groups take a single byte
+    #define INPUT_RECORD_MAGIC      FOURCC("OLIR")
+    #define INPUT_RECORD_VERSION    1
+    #define INPUT_RECORD_KEYS       ((ikBack + 32) / 32) // keyboard keys up to ikBack, mouse and touch are resolved by Input::update
+    #define INPUT_RECORD_MAX_TICKS  1024
+    #define INPUT_RECORD_MAX_RUN    128
+    #define INPUT_RECORD_CHECK      60                   // frames between sync checks
+
+    namespace Record {
+
+        enum Mode { NONE, RECORD, REPLAY } mode;
+
+        enum {
+            GROUP_TIME  = 1 << 0,
+            GROUP_KEYS  = 1 << 1,
+            GROUP_TICKS = 1 << 2,
+            GROUP_CHECK = 1 << 3,
+            GROUP_RUN   = 1 << 7, // low 7 bits are (count - 1) repeats of the previous group
+
+            TICK_STATE  = 1 << 0,
+            TICK_JOY    = 1 << 1,
+        };
+
+        struct Header {
+            uint32 magic;
+            uint16 version;
+            uint8  players;
+            uint8  keys;
+        };
+
+        struct Tick {
+            uint16 state[MAX_PLAYERS];
+            vec2   L[MAX_PLAYERS];
+            vec2   R[MAX_PLAYERS];
+        };
+
+        struct Group {
+            uint16 time;
+            bool   hasCheck;
+            uint32 check;
+            uint32 keys[INPUT_RECORD_KEYS];
+            int32  ticksCount;
+            Tick   ticks[INPUT_RECORD_MAX_TICKS];
+        };
+
+        Group  *cur, *prev;
+        Tick   lastTick;
+        int32  run;
+        int32  frameIndex;
+        int32  tickIndex;
+        int32  mismatches;
+
+        FILE   *file;
+        uint8  *data;
+        int32  size;
+        int32  pos;
+
+        bool isEqual(const Group *a, const Group *b) {
+            if (a->time != b->time || a->hasCheck || b->hasCheck || a->ticksCount != b->ticksCount)
+                return false;
+            if (memcmp(a->keys, b->keys, sizeof(a->keys)))
+                return false;
+            return memcmp(a->ticks, b->ticks, sizeof(Tick) * a->ticksCount) == 0;
+        }
+
+        bool isEqual(const Tick &a, const Tick &b, int flag) {
+            if (flag == TICK_STATE)
+                return memcmp(a.state, b.state, sizeof(a.state)) == 0;
+            return memcmp(a.L, b.L, sizeof(a.L)) == 0 && memcmp(a.R, b.R, sizeof(a.R)) == 0;
+        }
+
+        void alloc() {
+            cur  = new Group(); // value-initialized with zeros
+            prev = new Group();
+            lastTick = Tick();
+            run = frameIndex = tickIndex = mismatches = 0;
+
+        // both sides start from released controls, lastState depends on it
+            memset(state, 0, sizeof(state));
+            for (int i = 0; i < MAX_PLAYERS; i++)
+                lastState[i] = cMAX;
+        }
+
+    // writer
+        void write(const void *ptr, int32 count) {
+            fwrite(ptr, count, 1, file);
+            size += count;
+        }
+
+        void writeByte(uint8 value) {
+            write(&value, 1);
+        }
+
+        void flushRun() {
+            if (run) {
+                writeByte(uint8(GROUP_RUN | (run - 1)));
+                run = 0;
+            }
+        }
+
+        void commit() {
+            if (isEqual(cur, prev)) {
+                if (++run == INPUT_RECORD_MAX_RUN)
+                    flushRun();
+            } else {
+                flushRun();
+
+                uint8 flags = 0;
+                if (cur->time       != prev->time)                       flags |= GROUP_TIME;
+                if (memcmp(cur->keys, prev->keys, sizeof(cur->keys)))    flags |= GROUP_KEYS;
+                if (cur->ticksCount != prev->ticksCount)                 flags |= GROUP_TICKS;
+                if (cur->hasCheck)                                       flags |= GROUP_CHECK;
+
+                uint16 ticksCount = uint16(cur->ticksCount);
+
+                writeByte(flags);
+                if (flags & GROUP_TIME)  write(&cur->time, sizeof(cur->time));
+                if (flags & GROUP_KEYS)  write(cur->keys, sizeof(cur->keys));
+                if (flags & GROUP_TICKS) write(&ticksCount, sizeof(ticksCount));
+                if (flags & GROUP_CHECK) write(&cur->check, sizeof(cur->check));
+
+                for (int i = 0; i < cur->ticksCount; i++) {
+                    const Tick &t = cur->ticks[i];
+
+                    uint8 tflags = 0;
+                    if (!isEqual(t, lastTick, TICK_STATE)) tflags |= TICK_STATE;
+                    if (!isEqual(t, lastTick, TICK_JOY))   tflags |= TICK_JOY;
+
+                    writeByte(tflags);
+                    if (tflags & TICK_STATE) write(t.state, sizeof(t.state));
+                    if (tflags & TICK_JOY) {
+                        write(t.L, sizeof(t.L));
+                        write(t.R, sizeof(t.R));
+                    }
+                    lastTick = t;
+                }
+            }
+
+            swap(cur, prev);
+        }
+
+    // reader
+        bool read(void *ptr, int32 count) {
+            if (pos + count > size)
+                return false;
+            memcpy(ptr, data + pos, count);
+            pos += count;
+            return true;
+        }
+
+        bool readGroup() {
+            if (run) { // repeat the current group
+                run--;
+                return true;
+            }
+
+            uint8 flags;
+            if (!read(&flags, 1))
+                return false;
+
+            if (flags & GROUP_RUN) {
+                run = flags & ~GROUP_RUN;
+                return true;
+            }
+
+            swap(cur, prev);
+            cur->time       = prev->time;
+            cur->check      = prev->check;
+            cur->ticksCount = prev->ticksCount;
+            memcpy(cur->keys, prev->keys, sizeof(cur->keys));
+            cur->hasCheck = (flags & GROUP_CHECK) != 0;
+
+            uint16 ticksCount = uint16(cur->ticksCount);
+            if ((flags & GROUP_TIME)  && !read(&cur->time, sizeof(cur->time)))   return false;
+            if ((flags & GROUP_KEYS)  && !read(cur->keys, sizeof(cur->keys)))    return false;
+            if ((flags & GROUP_TICKS) && !read(&ticksCount, sizeof(ticksCount))) return false;
+            if ((flags & GROUP_CHECK) && !read(&cur->check, sizeof(cur->check))) return false;
+
+            if (ticksCount > INPUT_RECORD_MAX_TICKS)
+                return false;
+            cur->ticksCount = ticksCount;
+
+            for (int i = 0; i < cur->ticksCount; i++) {
+                Tick &t = cur->ticks[i];
+                t = lastTick;
+
+                uint8 tflags;
+                if (!read(&tflags, 1)) return false;
+                if ((tflags & TICK_STATE) && !read(t.state, sizeof(t.state))) return false;
+                if ((tflags & TICK_JOY)   && !(read(t.L, sizeof(t.L)) && read(t.R, sizeof(t.R)))) return false;
+                lastTick = t;
+            }
+
+            return true;
+        }
+
+        void stop() {
+            if (mode == RECORD) {
+                if (frameIndex)
+                    commit();
+                flushRun();
+                fclose(file);
+                LOG("record: %d frames, %d bytes\n", frameIndex, size);
+            }
+
+            if (mode == REPLAY) {
+                LOG("replay: %d frames, %d sync errors\n", frameIndex, mismatches);
+                delete[] data;
+                Input::reset();
+            }
+
+            if (mode != NONE) {
+                delete cur;
+                delete prev;
+            }
+
+            mode = NONE;
+            file = NULL;
+            data = NULL;
+        }
+
+        bool startRecord(const char *name) {
+            stop();
+
+            if (!(file = fopen(name, "wb"))) {
+                LOG("! record: can't create \"%s\"\n", name);
+                return false;
+            }
+
+            Header header;
+            header.magic   = INPUT_RECORD_MAGIC;
+            header.version = INPUT_RECORD_VERSION;
+            header.players = MAX_PLAYERS;
+            header.keys    = INPUT_RECORD_KEYS;
+
+            size = 0;
+            write(&header, sizeof(header));
+
+            alloc();
+            mode = RECORD;
+            LOG("record: \"%s\"\n", name);
+            return true;
+        }
+
+        bool startReplay(const char *name) {
+            stop();
+
+            FILE *f = fopen(name, "rb");
+            if (!f) {
+                LOG("! replay: can't open \"%s\"\n", name);
+                return false;
+            }
+
+            fseek(f, 0, SEEK_END);
+            size = ftell(f);
+            fseek(f, 0, SEEK_SET);
+            data = new uint8[size];
+            size = int32(fread(data, 1, size, f));
+            fclose(f);
+
+            Header header;
+            pos = 0;
+            if (!read(&header, sizeof(header)) || header.magic != INPUT_RECORD_MAGIC || header.version != INPUT_RECORD_VERSION ||
+                header.players != MAX_PLAYERS || header.keys != INPUT_RECORD_KEYS) {
+                LOG("! replay: unsupported file \"%s\"\n", name);
+                delete[] data;
+                data = NULL;
+                return false;
+            }
+
+            alloc();
+            mode = REPLAY;
+            LOG("replay: \"%s\"\n", name);
+            return true;
+        }
+
+        bool isActive() {
+            return mode != NONE;
+        }
+
+    // called once per Game::update right after Core::update, hash is a checksum of the simulation state
+        void frame(uint32 hash) {
+            if (mode == NONE)
+                return;
+
+            if (mode == RECORD) {
+                if (frameIndex)
+                    commit();
+
+                int32 ms = clamp(int32(Core::deltaTime * 1000.0f + 0.5f), 0, 0xFFFF);
+
+                cur->time       = uint16(ms);
+                cur->hasCheck   = (frameIndex % INPUT_RECORD_CHECK) == 0;
+                cur->check      = cur->hasCheck ? hash : 0;
+                cur->ticksCount = 0;
+                memset(cur->keys, 0, sizeof(cur->keys));
+                for (int i = 0; i <= ikBack; i++)
+                    if (down[i])
+                        cur->keys[i / 32] |= 1 << (i % 32);
+            }
+
+            if (mode == REPLAY) {
+                if (frameIndex && tickIndex != cur->ticksCount)
+                    mismatches++;
+
+                if (!readGroup()) {
+                    stop();
+                    return;
+                }
+
+                if (cur->hasCheck && cur->check != hash) {
+                    if (!mismatches)
+                        LOG("! replay: desync at frame %d\n", frameIndex);
+                    mismatches++;
+                }
+
+                for (int i = 0; i <= ikBack; i++)
+                    down[i] = (cur->keys[i / 32] & (1 << (i % 32))) != 0;
+            }
+
+        // exactly the value Core::update would produce for this delta
+            Core::deltaTime = cur->time * 0.001f;
+
+        // render and other frame rate dependent code share the same rand(), so restart the sequence every frame
+            srand(frameIndex);
+
+            tickIndex = 0;
+            frameIndex++;
+        }
+
+    // called by Input::update, returns true if the controls were set from the replay
+        bool tick() {
+            if (mode == RECORD) {
+                if (cur->ticksCount == INPUT_RECORD_MAX_TICKS) {
+                    LOG("! record: too many ticks per frame\n");
+                    stop();
+                    return false;
+                }
+
+                Tick &t = cur->ticks[cur->ticksCount++];
+                for (int j = 0; j < MAX_PLAYERS; j++) {
+                    Joystick &stick = joy[Core::settings.controls[j].joyIndex];
+                    t.state[j] = 0;
+                    for (int i = 0; i < cMAX; i++)
+                        if (state[j][i])
+                            t.state[j] |= 1 << i;
+                    t.L[j] = stick.L;
+                    t.R[j] = stick.R;
+                }
+                return false;
+            }
+
+            if (mode == REPLAY) {
+                if (tickIndex == cur->ticksCount) { // the simulation runs more ticks than were recorded
+                    mismatches++;
+                    return false;
+                }
+
+                const Tick &t = cur->ticks[tickIndex++];
+                for (int j = 0; j < MAX_PLAYERS; j++) {
+                    Joystick &stick = joy[Core::settings.controls[j].joyIndex];
+                    lastState[j] = cMAX;
+                    for (int i = 0; i < cMAX; i++)
+                        setState(j, ControlKey(i), (t.state[j] & (1 << i)) != 0);
+                    stick.L = t.L[j];
+                    stick.R = t.R[j];
+                }
+                return true;
+            }
+
+            return false;
+        }
+    }
+
     void update() {
+        if (Record::mode == Record::REPLAY && Record::tick())
+            return;
+
         bool newState[MAX_PLAYERS][cMAX];
 
         for (int j = 0; j < COUNT(Core::settings.controls); j++) {
@@ -338,6 +718,8 @@ namespace Input {
         for (int j = 0; j < COUNT(Core::settings.controls); j++)
             for (int i = 0; i < cMAX; i++)
                 setState(j, ControlKey(i), newState[j][i]);
+
+        Record::tick();
     }
 }
 
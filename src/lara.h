@@ -3791,21 +3791,10 @@ struct Lara : Character {
 
         vec3 target = vec3(float(sink.x), float(sink.y), float(sink.z));
 
-    #ifdef _DEBUG
-        //delete[] dbgBoxes;
-        //dbgBoxes = NULL;
-    #endif
-
-        if (box != sink.flags.boxIndex) {
-            uint16 *boxes;
-            uint16 count = game->findPath(0xFFFFFF, -0xFFFFFF, false, box, sink.flags.boxIndex, getZones(), &boxes);
-            if (count > 1) {
-            #ifdef _DEBUG
-                //dbgBoxesCount = count;
-                //dbgBoxes = new uint16[dbgBoxesCount];
-                //memcpy(dbgBoxes, boxes, sizeof(uint16) * dbgBoxesCount);
-            #endif
-                TR::Box &b = level->boxes[boxes[1]];
+        if (box != sink.flags.boxIndex && box != TR::NO_BOX) {
+            uint16 *flow = game->getFlowField(0xFFFFFF, -0xFFFFFF, false, sink.flags.boxIndex, getZones());
+            if (flow && flow[box] != TR::NO_BOX) {
+                TR::Box &b = level->boxes[flow[box]];
                 target.x = (b.minX + b.maxX) * 0.5f;
                 if (target.y > b.floor)
                     target.y = float(b.floor);
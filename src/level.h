@@ -22,6 +22,40 @@
     #include "debug.h"
 #endif
 
+// cache packed texture atlases of the level (requires synchronous cache i/o)
+#if defined(OS_FILEIO_CACHE) && !defined(SPLIT_BY_TILE)
+    #define LEVEL_BAKE
+#endif
+
+#define LEVEL_BAKE_MAGIC   FOURCC("OLBK")
+#define LEVEL_BAKE_VERSION 1
+
+// load the next level file in background while the current one is played
+#if defined(OS_PTHREAD_MT) && !defined(_OS_WEB)
+    #define LEVEL_PRELOAD
+#endif
+
+#ifndef LEVEL_PRELOAD_BUDGET
+    #define LEVEL_PRELOAD_BUDGET (32 * 1024 * 1024) // max estimated memory for the preloaded level data
+#endif
+
+// scale the render resolution down to hold the frame time budget
+#if defined(_GAPI_SW) && !defined(DYN_SCALE_OFF)
+    #define DYN_SCALE
+#endif
+
+#ifndef DYN_SCALE_BUDGET
+    #define DYN_SCALE_BUDGET 30.0f // max render time in ms
+#endif
+
+#ifndef DYN_SCALE_MIN
+    #define DYN_SCALE_MIN    0.5f  // the resolution setting is the upper bound
+#endif
+
+#define DYN_SCALE_STEP       0.05f
+#define DYN_SCALE_LOW        0.7f  // scale up only below this part of the budget
+#define DYN_SCALE_HOLD       30    // frames to settle after the change
+
 #define ANIM_TEX_TIMESTEP (10.0f / 30.0f)
 #define SKY_TIME_PERIOD   (1.0f / 0.005f)
 
@@ -31,6 +65,106 @@ extern Array<SaveSlot> saveSlots;
 extern SaveResult saveResult;
 extern int loadSlot;
 
+#ifdef LEVEL_PRELOAD
+namespace LevelPreload {
+    TR::LevelID   id = TR::LVL_MAX;
+    char          fileName[64];
+    Stream        *stream;
+    TR::Level     *data;
+    pthread_t     thread;
+    bool          cancelled;
+
+    bool isCancelled() {
+        return __atomic_load_n(&cancelled, __ATOMIC_ACQUIRE);
+    }
+
+    void streamAsync(Stream *stream, void *userData) {
+        LevelPreload::stream = stream;
+    }
+
+    void* loadThread(void *arg) {
+        stream = NULL;
+        data   = NULL;
+
+        new Stream(fileName, streamAsync);
+
+        if (!stream) return NULL;
+
+    // parsed level data is roughly twice the file size
+        if (stream->size * 2 > LEVEL_PRELOAD_BUDGET) {
+            LOG("preload: skip \"%s\" (%d bytes)\n", fileName, stream->size);
+            delete stream;
+            stream = NULL;
+            return NULL;
+        }
+
+        if (isCancelled()) return NULL;
+
+        data = new TR::Level(*stream, NULL, isCancelled);
+
+        if (isCancelled()) { // parsing stopped between stages
+            delete data;
+            data = NULL;
+            return NULL;
+        }
+
+        LOG("preload: \"%s\" is ready\n", fileName);
+
+        return NULL;
+    }
+
+    void free() {
+        if (id == TR::LVL_MAX) return;
+        pthread_join(thread, NULL);
+        delete data;
+        delete stream;
+        data   = NULL;
+        stream = NULL;
+        id     = TR::LVL_MAX;
+    }
+
+    void cancel() {
+        __atomic_store_n(&cancelled, true, __ATOMIC_RELEASE);
+        free();
+    }
+
+    void start(TR::LevelID id, TR::Version version) {
+        if (LevelPreload::id == id) return;
+        cancel();
+
+        TR::getGameLevelFile(fileName, version, id);
+        __atomic_store_n(&cancelled, false, __ATOMIC_RELEASE);
+
+        if (pthread_create(&thread, NULL, loadThread, NULL) == 0) {
+            LevelPreload::id = id;
+        }
+    }
+
+// wait for the preloaded level data, returns false if the level wasn't preloaded
+    bool take(TR::LevelID id, Stream *&stream, TR::Level *&data) {
+        if (LevelPreload::id != id) {
+            cancel();
+            return false;
+        }
+
+        pthread_join(thread, NULL);
+        LevelPreload::id = TR::LVL_MAX;
+
+        if (!LevelPreload::data) {
+            delete LevelPreload::stream;
+            LevelPreload::stream = NULL;
+            return false;
+        }
+
+        stream = LevelPreload::stream;
+        data   = LevelPreload::data;
+        LevelPreload::stream = NULL;
+        LevelPreload::data   = NULL;
+        return true;
+    }
+}
+#endif
+
 struct Level : IGame {
 
     TR::Level   level;
@@ -39,12 +173,54 @@ struct Level : IGame {
     Texture     *atlasSprites;
     Texture     *atlasGlyphs;
     MeshBuilder *mesh;
+    RenderList  renderList;
+    int         roomState; // pass, shader and medium of the last room params, -1 after any other shader binding
 
     Lara        *players[2], *player;
     Camera      *camera;
     Texture     *shadow[2];
     Texture     *scaleTex;
 
+#ifdef DYN_SCALE
+    struct DynScale {
+        float value; // current resolution scale
+        float time;  // smoothed render time
+        int   hold;
+
+        DynScale() : value(1.0f), time(0.0f), hold(0) {}
+
+        float get(float maxScale) const {
+            return clamp(value, min(DYN_SCALE_MIN, maxScale), maxScale);
+        }
+
+        void update(int renderTime, float maxScale) {
+            time = time * 0.8f + float(renderTime) * 0.2f;
+
+            value = get(maxScale);
+
+            if (hold > 0) {
+                hold--;
+                return;
+            }
+
+            float v = value;
+            if (time > DYN_SCALE_BUDGET) {
+            // fill rate is quadratic to the scale, jump down to the budget at once
+                v = min(v - DYN_SCALE_STEP, v * sqrtf(DYN_SCALE_BUDGET / time));
+            } else if (time < DYN_SCALE_BUDGET * DYN_SCALE_LOW) {
+                v += DYN_SCALE_STEP;
+            }
+            v = floorf(v / DYN_SCALE_STEP + 0.01f) * DYN_SCALE_STEP;
+            v = clamp(v, min(DYN_SCALE_MIN, maxScale), maxScale);
+
+            if (fabsf(v - value) > EPS) {
+                value = v;
+                hold  = DYN_SCALE_HOLD;
+            }
+        }
+    } dynScale;
+#endif
+
     struct Params {
         float   time;
         float   waterHeight;
@@ -54,6 +230,7 @@ struct Level : IGame {
     ZoneCache    *zoneCache;
     AmbientCache *ambientCache;
     WaterCache   *waterCache;
+    LightCache   *lightCache;
 
     Sound::Sample *sndTrack, *sndWater;
     bool waitTrack;
@@ -77,6 +254,9 @@ struct Level : IGame {
     float      animTexTimer;
     float      statsTimeDelta;
 
+    SnapshotRing snapshots;
+    int          snapshotFrame;
+
     vec3 underwaterColor;
     vec4 underwaterFogParams;
     vec4 levelFogParams;
@@ -90,16 +270,18 @@ struct Level : IGame {
         nextLevel = id;
     }
 
-    virtual void loadNextLevel() {
-        if (nextLevel != TR::LVL_MAX) return;
-
-        TR::LevelID id = TR::LVL_MAX;
+    TR::LevelID getNextLevelID() {
     //#ifdef _OS_WEB
     //    if (level.id == TR::LVL_TR1_2 && level.version != TR::VER_TR1_PC)
-    //        id = TR::LVL_TR1_TITLE;
-    //    else
+    //        return TR::LVL_TR1_TITLE;
     //#endif
-        id = (level.isEnd() || level.isHome()) ? level.getTitleId() : TR::LevelID(level.id + 1);
+        return (level.isEnd() || level.isHome()) ? level.getTitleId() : TR::LevelID(level.id + 1);
+    }
+
+    virtual void loadNextLevel() {
+        if (nextLevel != TR::LVL_MAX) return;
+
+        TR::LevelID id = getNextLevelID();
 
         TR::isGameEnded = level.isEnd();
 
@@ -123,15 +305,7 @@ struct Level : IGame {
         inventory->toggle(playerIndex, Inventory::Page(page));
     }
 
-    SaveSlot createSaveSlot(TR::LevelID id, bool checkpoint, bool dummy = false) {
-        SaveSlot slot;
-
-        // allocate oversized data for save slot
-        slot.data  = new uint8[sizeof(SaveStats) + sizeof(SaveItem) * inventory->itemsCount + // for every save
-                               sizeof(SaveState) + sizeof(SaveEntity) * level.entitiesCount]; // only for checkpoints
-
-        uint8 *ptr = slot.data;
-
+    uint8* writeSaveHeader(uint8 *ptr, TR::LevelID id, bool checkpoint, bool dummy) {
     // level progress stats
         SaveStats *stats = (SaveStats*)ptr;
         if (!checkpoint)
@@ -184,7 +358,21 @@ struct Level : IGame {
             SaveState *state = (SaveState*)ptr;
             ptr += sizeof(*state);
             *state = level.state;
+        }
+
+        return ptr;
+    }
+
+    SaveSlot createSaveSlot(TR::LevelID id, bool checkpoint, bool dummy = false) {
+        SaveSlot slot;
+
+        // allocate oversized data for save slot
+        slot.data  = new uint8[sizeof(SaveStats) + sizeof(int32) + sizeof(SaveItem) * inventory->itemsCount + // for every save
+                               sizeof(SaveState) + sizeof(int32) + sizeof(SaveEntity) * level.entitiesCount]; // only for checkpoints
+
+        uint8 *ptr = writeSaveHeader(slot.data, id, checkpoint, dummy);
 
+        if (checkpoint) {
         // level entities
             int32 *entitiesCount = (int32*)ptr;
             ptr += sizeof(*entitiesCount);
@@ -274,24 +462,58 @@ struct Level : IGame {
         statsTimeDelta = 0.0f;
     }
 
-    static void saveGameWriteAsync(Stream *stream, void *userData) {
-        if (stream != NULL) {
-            delete[] stream->data;
-            delete stream;
-            saveResult = SAVE_RESULT_SUCCESS;
-            UI::showHint(STR_HINT_SAVING_DONE, 1.0f);
-        } else {
-            saveResult = SAVE_RESULT_ERROR;
-            UI::showHint(STR_HINT_SAVING_ERROR, 3.0f);
+// apply checkpoint of the current level without reloading the level file
+// extra players are not saved and would be lost by clearEntities, reload the level in that case
+    bool canApplySaveSlot(const SaveSlot &slot) {
+        return slot.isCheckpoint() && slot.getLevelID() == level.id && !level.isTitle() && !players[1] && !Network::players.length;
+    }
+
+    void applySaveSlot(const SaveSlot &slot) {
+        ASSERT(canApplySaveSlot(slot));
+
+        if (level.state.flags.flipped) // parseSaveSlot expects the initial room geometry
+            flipMap();
+
+        parseSaveSlot(slot);
+
+        Core::resetTime();
+    }
+
+    void captureSnapshot() {
+        uint8 *ptr = writeSaveHeader(snapshots.begin(), level.id, true, false);
+        snapshots.setHeader(ptr);
+
+        SaveEntity entity;
+        for (int i = 0; i < level.entitiesCount; i++) {
+            Controller *controller = (Controller*)level.entities[i].controller;
+            if (!controller || !controller->getSaveData(entity)) continue;
+            snapshots.addEntity(i, entity);
         }
+
+        snapshots.end();
     }
 
-    virtual void saveGame(TR::LevelID id, bool checkpoint, bool updateStats) {
-        ASSERT(saveResult != SAVE_RESULT_WAIT);
+    bool rewind(int back) {
+        SaveSlot slot;
+        if (players[1] || Network::players.length || !snapshots.restore(back, slot))
+            return false;
 
-        if (saveResult == SAVE_RESULT_WAIT)
+        LOG("rewind %d (%d available, %d kb)\n", back, snapshots.getAvailable(), snapshots.getMemoryUsage() / 1024);
+        applySaveSlot(slot);
+        delete[] slot.data;
+
+        snapshotFrame = 0;
+        return true;
+    }
+
+    void updateSnapshots() {
+        if (!snapshots.entitiesCount || ++snapshotFrame < SNAPSHOT_PERIOD)
             return;
+        snapshotFrame = 0;
+        captureSnapshot();
+    }
 
+    virtual void saveGame(TR::LevelID id, bool checkpoint, bool updateStats) {
         LOG("Save Game...\n");
 
         SaveSlot slot;
@@ -317,9 +539,7 @@ struct Level : IGame {
             saveResult = SAVE_RESULT_WAIT;
             UI::showHint(STR_HINT_SAVING, 60.0f);
 
-            int size;
-            uint8 *data = writeSaveSlots(size);
-            osWriteSlot(new Stream(SAVE_FILENAME, (const char*)data, size, saveGameWriteAsync, this));
+            SaveWriter::write();
         }
     }
 
@@ -384,6 +604,10 @@ struct Level : IGame {
         bool rebuildShadows = settings.detail.shadows  != Core::settings.detail.shadows;
         bool rebuildWater   = settings.detail.water    != Core::settings.detail.water;
         bool switchModels   = settings.detail.simple   != Core::settings.detail.simple;
+    #ifndef SPLIT_BY_TILE
+        bool rebuildGlyphs  = settings.audio.language  != Core::settings.audio.language &&
+                              (UI::isWideLanguage(settings.audio.language + STR_LANG_EN) || UI::isWideLanguage(Core::settings.audio.language + STR_LANG_EN));
+    #endif
 
         bool rebuildShaders = rebuildWater || rebuildAmbient || rebuildShadows;
 
@@ -431,6 +655,11 @@ struct Level : IGame {
 
         if (switchModels)
             resetModels();
+
+    #ifndef SPLIT_BY_TILE
+        if (rebuildGlyphs)
+            initGlyphAtlas();
+    #endif
     }
 
     virtual TR::Level* getLevel() {
@@ -473,8 +702,12 @@ struct Level : IGame {
         return item->boxes[rand() % item->count];
     }
     
-    virtual uint16 findPath(int ascend, int descend, bool big, int boxStart, int boxEnd, uint16 *zones, uint16 **boxes) {
-        return zoneCache->findPath(ascend, descend, big, boxStart, boxEnd, zones, boxes);
+    virtual uint16* getFlowField(int ascend, int descend, bool big, int boxEnd, uint16 *zones) {
+        return zoneCache ? zoneCache->getFlowField(ascend, descend, big, boxEnd, zones) : NULL;
+    }
+
+    virtual void invalidatePaths() {
+        if (zoneCache) zoneCache->invalidate();
     }
 
     void updateBlocks(bool rise) {
@@ -514,9 +747,33 @@ struct Level : IGame {
     }
 
     virtual void setShader(Core::Pass pass, Shader::Type type, bool underwater = false, bool alphaTest = false) {
+        roomState = -1;
         shaderCache->bind(pass, type, (underwater ? ShaderCache::FX_UNDERWATER : 0) | (alphaTest ? ShaderCache::FX_ALPHA_TEST : 0));
     }
 
+// shader, fog and palette, skipped while the consecutive commands share the state
+    void setRoomState(Shader::Type type, bool water, bool alphaTest) {
+        int state = (int(Core::pass) << 16) | (int(type) << 8) | (int(water) << 1) | int(alphaTest);
+        if (roomState == state)
+            return;
+
+        setShader(Core::pass, type, (Core::pass == Core::passAmbient) ? false : water, alphaTest);
+
+        if (water) {
+            Core::setFog(underwaterFogParams);
+        } else {
+            Core::setFog(levelFogParams);
+        }
+
+        #ifdef _GAPI_SW
+            GAPI::setPalette(water ? GAPI::swPaletteWater : GAPI::swPaletteColor);
+            GAPI::setShading(true);
+            GAPI::setWaterLookup(NULL, NULL, 0, 0, vec4(0.0f));
+        #endif
+
+        roomState = state;
+    }
+
     virtual void setRoomParams(int roomIndex, Shader::Type type, float diffuse, float ambient, float specular, float alpha, bool alphaTest = false) {
         if (Core::pass == Core::passShadow) {
             setShader(Core::pass, type, false, alphaTest);
@@ -567,17 +824,10 @@ struct Level : IGame {
             material = vec4(diffuse, ambient, specular, alpha);
         }
         
-        setShader(Core::pass, type, (Core::pass == Core::passAmbient) ? false : room.flags.water, alphaTest);
-
-        if (room.flags.water) {
-            Core::setFog(underwaterFogParams);
-        } else {
-            Core::setFog(levelFogParams);
-        }
+        setRoomState(type, room.flags.water, alphaTest);
 
         #ifdef _GAPI_SW
-            GAPI::setPalette(room.flags.water ? GAPI::swPaletteWater : GAPI::swPaletteColor);
-            GAPI::setShading(true);
+            GAPI::setSectorLight(vec3(0.0f));
         #endif
 
         Core::setMaterial(material.x, material.y, material.z, material.w);
@@ -936,7 +1186,7 @@ struct Level : IGame {
     }
 //==============================
 
-    Level(Stream &stream) : level(stream), waitTrack(false), isEnded(false), cutsceneWaitTimer(0.0f), animTexTimer(0.0f), statsTimeDelta(0.0f) {
+    Level(Stream &stream, TR::Level *loaded = NULL) : level(stream, loaded), waitTrack(false), isEnded(false), cutsceneWaitTimer(0.0f), animTexTimer(0.0f), statsTimeDelta(0.0f) {
         paused = false;
 
         level.simpleItems = Core::settings.detail.simple == 1;
@@ -947,12 +1197,14 @@ struct Level : IGame {
     #endif
         nextLevel = TR::LVL_MAX;
         showStats = false;
+        roomState = -1;
 
         params = (Params*)&Core::params;
         params->time = 0.0f;
 
         memset(players, 0, sizeof(players));
-        player = NULL;
+        player    = NULL;
+        zoneCache = NULL;
 
         underwaterColor     = vec3(0.6f, 0.9f, 0.9f);
         underwaterFogParams = vec4(underwaterColor * 0.2f, 1.0f / (6 * 1024));
@@ -966,7 +1218,7 @@ struct Level : IGame {
             saveStats.level = level.id;
         }
 
-        initTextures();
+        initTextures(stream.size);
         mesh = new MeshBuilder(&level, atlasRooms);
         initEntities();
 
@@ -975,7 +1227,7 @@ struct Level : IGame {
         camera       = NULL;
         ambientCache = NULL;
         waterCache   = NULL;
-        zoneCache    = NULL;
+        lightCache   = NULL;
 
         needRedrawTitleBG = false;
         needRedrawReflections = true;
@@ -990,6 +1242,9 @@ struct Level : IGame {
             zoneCache    = new ZoneCache(this);
             ambientCache = Core::settings.detail.lighting > Core::Settings::MEDIUM ? new AmbientCache(this) : NULL;
             waterCache   = Core::settings.detail.water    > Core::Settings::LOW    ? new WaterCache(this)   : NULL;
+        #ifdef _GAPI_SW
+            lightCache   = new LightCache(this);
+        #endif
 
             if (ambientCache) { // at first calculate ambient cube for Lara
                 AmbientCache::Cube cube;
@@ -1045,8 +1300,21 @@ struct Level : IGame {
             loadSlot = -1;
         }
 
+        snapshotFrame = 0;
+        if (!level.isTitle() && !level.isCutsceneLevel())
+            snapshots.init(level.entitiesCount, sizeof(SaveStats) + sizeof(int32) + sizeof(SaveItem) * INV_MAX_ITEMS + sizeof(SaveState));
+
         Network::start(this);
 
+    #ifdef LEVEL_PRELOAD
+        if (level.id != TR::LVL_CUSTOM && !level.isTitle()) {
+            TR::LevelID id = getNextLevelID();
+            if (id < TR::LVL_MAX) {
+                LevelPreload::start(id, level.version);
+            }
+        }
+    #endif
+
         Core::resetTime();
     }
 
@@ -1064,6 +1332,7 @@ struct Level : IGame {
         delete ambientCache;
         delete waterCache;
         delete zoneCache;
+        delete lightCache;
 
         delete atlasRooms;
         #ifndef SPLIT_BY_TILE
@@ -1317,10 +1586,6 @@ struct Level : IGame {
     #define ATLAS_PAGE_GLYPHS 8192
 
     AtlasTile *tileData;
-    uint8 *glyphsRU;
-    uint8 *glyphsJA;
-    uint8 *glyphsGR;
-    uint8 *glyphsCN;
 
     static int getAdvGlyphPage(int index) {
         index -= UI::advGlyphsStart;
@@ -1397,26 +1662,15 @@ struct Level : IGame {
                     if (id < UI::advGlyphsStart) {
                         level->fillObjectTexture(owner->tileData, tile.uv, tile.tex);
                     } else {
+                    #ifndef SPLIT_BY_TILE
                         int page = getAdvGlyphPage(id);
                         int offset = ATLAS_PAGE_GLYPHS + page * 256;
                         short4 uv = tile.uv;
                         uv.y -= offset;
                         uv.w -= offset;
-                        Color32 *glyphsData = NULL;
-
-                        switch (page) {
-                            case 0  : glyphsData = (Color32*)owner->glyphsRU; break;
-                            case 1  :
-                            case 2  : glyphsData = (Color32*)owner->glyphsJA + (page - 1) * 256 * 256; break;
-                            case 3  : glyphsData = (Color32*)owner->glyphsGR; break;
-                            case 4  :
-                            case 5  :
-                            case 6  :
-                            case 7  : glyphsData = (Color32*)owner->glyphsCN + (page - 4) * 256 * 256; break;
-                            default : ASSERT(false);
-                        }
-
-                        level->fillObjectTexture32(owner->tileData, glyphsData, uv, tile.tex);
+                        UI::fillGlyphs(owner->tileData, page, uv);
+                        level->premultiplyAlpha(owner->tileData->color, uv);
+                    #endif
                     }
                 }
             } else { // common (generated) textures
@@ -1587,50 +1841,291 @@ struct Level : IGame {
     }
 #endif
 
-    void initTextures() {
-    #ifndef SPLIT_BY_TILE
+#ifndef SPLIT_BY_TILE
+    bool isGlyphSprite(int index) {
+        if (level.extra.glyphs == -1)
+            return false;
+        TR::SpriteSequence &seq = level.spriteSequences[level.extra.glyphs];
+        return (index >= seq.sStart && index < seq.sStart + seq.sCount) || index >= UI::advGlyphsStart;
+    }
 
-        #if defined(_GAPI_SW) || defined(_GAPI_GU)
-            #error atlas packing is not allowed for this platform
-        #endif
+    short4 getSpriteAtlasUV(int index) {
+        TR::TextureInfo &t = level.spriteTextures[index];
 
-        #ifdef _DEBUG
-            //dumpGlyphs();
-            //dumpKanji();
-        #endif
+        short4 uv;
+        uv.x = t.texCoord[0].x;
+        uv.y = t.texCoord[0].y;
+        uv.z = t.texCoord[1].x + 1;
+        uv.w = t.texCoord[1].y + 1;
 
-        UI::patchGlyphs(level);
+        if (index >= UI::advGlyphsStart) {
+         // add virtual UV offset for additional glyph sprites
+            int offset = ATLAS_PAGE_GLYPHS + getAdvGlyphPage(index) * 256;
+            uv.y += offset;
+            uv.w += offset;
+        }
+        return uv;
+    }
 
-        {
-            uint32 glyphsW, glyphsH;
-            Stream stream(NULL, GLYPH_RU, size_GLYPH_RU);
-            glyphsRU = Texture::LoadPNG(stream, glyphsW, glyphsH);
+    void addCommonTexture(Atlas *atlas, int index) {
+        const short2 CommonTexOffset[] = { short2(1, 5), short2(1, 5), short2(1, 5), short2(5, 5), short2(1, 1), short2(1, 1), short2(1, 1) };
+        ASSERT(COUNT(CommonTexOffset) == CTEX_MAX);
+        atlas->add(level.objectTexturesCount + level.spriteTexturesCount + index, short4(index * 32, ATLAS_PAGE_BARS, index * 32 + CommonTexOffset[index].x, ATLAS_PAGE_BARS + CommonTexOffset[index].y), &CommonTex[index]);
+    }
+
+    // glyphs atlas contains only additional glyphs used by the current language
+    // and should be rebuilt on language change (see applySettings)
+    void initGlyphAtlas() {
+        delete atlasGlyphs;
+
+        int maxTiles = level.spriteTexturesCount + CTEX_MAX;
+        Atlas *gAtlas = new Atlas(maxTiles, short4(0, 0, 1, 1), this, fillCallback);
+
+        for (int i = 0; i < level.spriteTexturesCount; i++) {
+            TR::TextureInfo &t = level.spriteTextures[i];
+            if (t.tile == 0xFFFF || !isGlyphSprite(i)) continue;
+            if (i >= UI::advGlyphsStart && !UI::isAdvGlyphUsed(i)) continue;
+        // reset UV after the previous packing
+            t.texCoordAtlas[0] = t.texCoord[0];
+            t.texCoordAtlas[1] = t.texCoord[1];
+            gAtlas->add(level.objectTexturesCount + i, getSpriteAtlasUV(i), &t);
         }
 
-        {
-            uint32 glyphsW, glyphsH;
-            Stream stream(NULL, GLYPH_JA, size_GLYPH_JA);
-            glyphsJA = Texture::LoadBMP(stream, glyphsW, glyphsH);
+        for (int i = 0; i < CTEX_MAX; i++) {
+            if (i == CTEX_FLASH || i == CTEX_WHITE_OBJECT || i == CTEX_WHITE_ROOM) continue;
+            for (int j = 0; j < COUNT(CommonTex[i].texCoordAtlas); j++)
+                CommonTex[i].texCoordAtlas[j] = short2(0, 0);
+            addCommonTexture(gAtlas, i);
         }
 
-        {
-            uint32 glyphsW, glyphsH;
-            Stream stream(NULL, GLYPH_GR, size_GLYPH_GR);
-            glyphsGR = Texture::LoadBMP(stream, glyphsW, glyphsH);
+        bool ownTileData = tileData == NULL;
+        if (ownTileData) {
+            tileData = new AtlasTile();
         }
 
-        {
-            uint32 glyphsW, glyphsH;
-            Stream stream(NULL, GLYPH_CN, size_GLYPH_CN);
-            glyphsCN = Texture::LoadBMP(stream, glyphsW, glyphsH);
+        atlasGlyphs = gAtlas->pack(0);
+        atlasGlyphs->setFilterQuality(Core::Settings::MEDIUM);
+
+        if (ownTileData) {
+            delete tileData;
+            tileData = NULL;
+        }
+
+        delete gAtlas;
+
+        LOG("glyphs  : %d x %d\n", atlasGlyphs->width, atlasGlyphs->height);
+        PROFILE_LABEL(TEXTURE, atlasGlyphs->ID, "atlas_glyphs");
+    }
+
+#ifdef LEVEL_BAKE
+    struct BakeHeader {
+        uint32 magic;
+        uint16 version;
+        uint16 colorSize;
+        int32  sourceSize;
+        uint32 sourceHash;
+        int32  objectTexturesCount;
+        int32  spriteTexturesCount;
+    };
+
+    void getBakeName(char *name) {
+        sprintf(name, "%s_%X.bake", TR::LEVEL_INFO[level.id].name, level.version);
+    }
+
+    // hash of the texture descriptors used to pack atlases
+    uint32 getBakeHash() {
+        uint32 hash = fnv32((char*)&level.version, sizeof(level.version));
+        for (int i = 0; i < level.objectTexturesCount; i++) {
+            TR::TextureInfo &t = level.objectTextures[i];
+            hash = fnv32((char*)&t.tile,     sizeof(t.tile),     hash);
+            hash = fnv32((char*)&t.clut,     sizeof(t.clut),     hash);
+            hash = fnv32((char*)&t.texCoord, sizeof(t.texCoord), hash);
         }
+        for (int i = 0; i < level.spriteTexturesCount; i++) {
+            TR::TextureInfo &t = level.spriteTextures[i];
+            hash = fnv32((char*)&t.tile,     sizeof(t.tile),     hash);
+            hash = fnv32((char*)&t.clut,     sizeof(t.clut),     hash);
+            hash = fnv32((char*)&t.texCoord, sizeof(t.texCoord[0]) * 2, hash);
+        }
+
+    // source pixels, retextured level of the same file size must not reuse the bake
+        int32 tiles = 0;
+        for (int i = 0; i < level.objectTexturesCount; i++) {
+            tiles = max(tiles, int32(level.objectTextures[i].tile) + 1);
+        }
+        for (int i = 0; i < level.spriteTexturesCount; i++) {
+            tiles = max(tiles, int32(level.spriteTextures[i].tile) + 1);
+        }
+
+        if (level.tiles4)    hash = fnv32((char*)level.tiles4,    tiles * sizeof(Tile4),   hash);
+        if (level.tiles8)    hash = fnv32((char*)level.tiles8,    tiles * sizeof(Tile8),   hash);
+        if (level.tiles16)   hash = fnv32((char*)level.tiles16,   tiles * sizeof(Tile16),  hash);
+        if (level.tiles32)   hash = fnv32((char*)level.tiles32,   tiles * sizeof(Tile32),  hash);
+        if (level.palette)   hash = fnv32((char*)level.palette,   256   * sizeof(Color24), hash);
+        if (level.palette32) hash = fnv32((char*)level.palette32, 256   * sizeof(Color32), hash);
+        if (level.cluts)     hash = fnv32((char*)level.cluts, level.clutsCount * sizeof(CLUT), hash);
+
+        return hash;
+    }
+
+    Texture* readBakeAtlas(Stream &stream, uint32 opt) {
+        int32 width, height;
+        if (stream.pos + int(sizeof(width) + sizeof(height)) > stream.size)
+            return NULL;
+        stream.read(width);
+        stream.read(height);
+        int size = width * height * sizeof(AtlasColor);
+        if (width <= 0 || height <= 0 || stream.pos + size > stream.size)
+            return NULL;
+    // texture is created right from the cache data
+        Texture *atlas = new Texture(width, height, 1, ATLAS_FORMAT, opt, stream.data + stream.pos);
+        stream.seek(size);
+        return atlas;
+    }
+
+    static void readBakeAsync(Stream *stream, void *userData) {
+        if (!stream) return;
+
+        Level *owner = (Level*)userData;
+        int32 sourceSize = owner->bakeSourceSize;
 
-    // repack texture tiles
+        BakeHeader header;
+        if (stream->size > int(sizeof(header))) {
+            stream->raw(&header, sizeof(header));
+        } else {
+            header.magic = 0;
+        }
+
+        TR::Level &level = owner->level;
+
+        if (header.magic               != LEVEL_BAKE_MAGIC    ||
+            header.version             != LEVEL_BAKE_VERSION  ||
+            header.colorSize           != sizeof(AtlasColor)  ||
+            header.sourceSize          != sourceSize          ||
+            header.objectTexturesCount != level.objectTexturesCount ||
+            header.spriteTexturesCount != level.spriteTexturesCount ||
+            header.sourceHash          != owner->getBakeHash()) {
+            LOG("! level bake is outdated\n");
+            delete stream;
+            return;
+        }
+
+        Texture *rooms   = owner->readBakeAtlas(*stream, OPT_MIPMAPS | OPT_VRAM_3DS);
+        Texture *objects = rooms   ? owner->readBakeAtlas(*stream, OPT_MIPMAPS) : NULL;
+        Texture *sprites = objects ? owner->readBakeAtlas(*stream, OPT_MIPMAPS) : NULL;
+
+        int uvSize = level.objectTexturesCount * sizeof(level.objectTextures[0].texCoordAtlas) + 
+                     level.spriteTexturesCount * sizeof(level.spriteTextures[0].texCoordAtlas[0]) * 2 +
+                     CTEX_MAX * sizeof(CommonTex[0].texCoordAtlas);
+
+        if (!sprites || stream->pos + uvSize != stream->size) {
+            LOG("! level bake is corrupted\n");
+            delete rooms;
+            delete objects;
+            delete sprites;
+            delete stream;
+            return;
+        }
+
+        for (int i = 0; i < level.objectTexturesCount; i++) {
+            stream->raw(level.objectTextures[i].texCoordAtlas, sizeof(level.objectTextures[i].texCoordAtlas));
+        }
+
+        for (int i = 0; i < level.spriteTexturesCount; i++) {
+            stream->raw(level.spriteTextures[i].texCoordAtlas, sizeof(level.spriteTextures[i].texCoordAtlas[0]) * 2);
+        }
+
+        for (int i = 0; i < CTEX_MAX; i++) {
+            TR::TextureInfo &t = CommonTex[i];
+            t.type      = t.dataType = TR::TEX_TYPE_SPRITE;
+            t.index     = t.clut = t.tile = 0;
+            t.attribute = t.animated = 0;
+            t.l = t.t = t.r = t.b = 0;
+            t.i5        = 0;
+            for (int j = 0; j < 4; j++) {
+                t.texCoord[j] = short2(0, 0);
+                t.sub[j]      = 0;
+            }
+            stream->raw(t.texCoordAtlas, sizeof(t.texCoordAtlas));
+        }
+
+        owner->atlasRooms   = rooms;
+        owner->atlasObjects = objects;
+        owner->atlasSprites = sprites;
+
+        delete stream;
+    }
+
+    int32 bakeSourceSize;
+
+    void loadBake(int32 sourceSize) {
+        char name[64];
+        getBakeName(name);
+        bakeSourceSize = sourceSize;
+        Stream::cacheRead(name, readBakeAsync, this);
+    }
+
+    void saveBake(int32 sourceSize, Atlas *rAtlas, Atlas *oAtlas, Atlas *sAtlas) {
+        Atlas *atlas[] = { rAtlas, oAtlas, sAtlas };
+
+        int size = sizeof(BakeHeader);
+        for (int i = 0; i < COUNT(atlas); i++) {
+            size += sizeof(int32) * 2 + atlas[i]->width * atlas[i]->height * sizeof(AtlasColor);
+        }
+        size += level.objectTexturesCount * sizeof(level.objectTextures[0].texCoordAtlas) + 
+                level.spriteTexturesCount * sizeof(level.spriteTextures[0].texCoordAtlas[0]) * 2 +
+                CTEX_MAX * sizeof(CommonTex[0].texCoordAtlas);
+
+        char *data = new char[size];
+        char *ptr  = data;
+
+        BakeHeader &header = *(BakeHeader*)ptr;
+        header.magic               = LEVEL_BAKE_MAGIC;
+        header.version             = LEVEL_BAKE_VERSION;
+        header.colorSize           = sizeof(AtlasColor);
+        header.sourceSize          = sourceSize;
+        header.sourceHash          = getBakeHash();
+        header.objectTexturesCount = level.objectTexturesCount;
+        header.spriteTexturesCount = level.spriteTexturesCount;
+        ptr += sizeof(header);
+
+        #define BAKE_WRITE(src, sz) { memcpy(ptr, src, sz); ptr += sz; }
+
+        for (int i = 0; i < COUNT(atlas); i++) {
+            BAKE_WRITE(&atlas[i]->width,  sizeof(int32));
+            BAKE_WRITE(&atlas[i]->height, sizeof(int32));
+            BAKE_WRITE(atlas[i]->data, atlas[i]->width * atlas[i]->height * sizeof(AtlasColor));
+        }
+
+        for (int i = 0; i < level.objectTexturesCount; i++) {
+            BAKE_WRITE(level.objectTextures[i].texCoordAtlas, sizeof(level.objectTextures[i].texCoordAtlas));
+        }
+
+        for (int i = 0; i < level.spriteTexturesCount; i++) {
+            BAKE_WRITE(level.spriteTextures[i].texCoordAtlas, sizeof(level.spriteTextures[i].texCoordAtlas[0]) * 2);
+        }
+
+        for (int i = 0; i < CTEX_MAX; i++) {
+            BAKE_WRITE(CommonTex[i].texCoordAtlas, sizeof(CommonTex[i].texCoordAtlas));
+        }
+
+        #undef BAKE_WRITE
+
+        ASSERT(ptr - data == size);
+
+        char name[64];
+        getBakeName(name);
+        Stream::cacheWrite(name, data, size);
+
+        delete[] data;
+    }
+#endif
+
+    void packAtlases(int32 sourceSize) {
         int maxTiles = level.objectTexturesCount + level.spriteTexturesCount + CTEX_MAX;
         Atlas *rAtlas = new Atlas(maxTiles, short4(4, 4, 4, 4), this, fillCallback);
         Atlas *oAtlas = new Atlas(maxTiles, short4(4, 4, 4, 4), this, fillCallback);
         Atlas *sAtlas = new Atlas(maxTiles, short4(4, 4, 4, 4), this, fillCallback);
-        Atlas *gAtlas = new Atlas(maxTiles, short4(0, 0, 1, 1), this, fillCallback);
         // add textures
         for (int i = 0; i < level.objectTexturesCount; i++) {
             TR::TextureInfo &t = level.objectTextures[i];
@@ -1647,41 +2142,21 @@ struct Level : IGame {
             else
                 oAtlas->add(i, uv, &t);
         }
-        // add sprites
+        // add sprites (glyphs are packed separately)
         for (int i = 0; i < level.spriteTexturesCount; i++) {
             TR::TextureInfo &t = level.spriteTextures[i];
-            if (t.tile == 0xFFFF) continue;
-
-            short4 uv;
-            uv.x = t.texCoord[0].x;
-            uv.y = t.texCoord[0].y;
-            uv.z = t.texCoord[1].x + 1;
-            uv.w = t.texCoord[1].y + 1;
-
-            if (i >= UI::advGlyphsStart) {
-             // add virtual UV offset for additional glyph sprites
-                int offset = ATLAS_PAGE_GLYPHS + getAdvGlyphPage(i) * 256;
-                uv.y += offset;
-                uv.w += offset;
-            }
-
-            if (level.extra.glyphs != -1) {
-                TR::SpriteSequence &seq = level.spriteSequences[level.extra.glyphs];
-                if ((i >= seq.sStart && i < seq.sStart + seq.sCount) || i >= UI::advGlyphsStart) {
-                    gAtlas->add(level.objectTexturesCount + i, uv, &t);
-                    continue;
-                }
-            }
-            sAtlas->add(level.objectTexturesCount + i, uv, &t);
+            if (t.tile == 0xFFFF || isGlyphSprite(i)) continue;
+            sAtlas->add(level.objectTexturesCount + i, getSpriteAtlasUV(i), &t);
         }
         // add common textures
-        const short2 CommonTexOffset[] = { short2(1, 5), short2(1, 5), short2(1, 5), short2(5, 5), short2(1, 1), short2(1, 1), short2(1, 1) };
-        ASSERT(COUNT(CommonTexOffset) == CTEX_MAX);
         memset(CommonTex, 0, sizeof(CommonTex));
         for (int i = 0; i < CTEX_MAX; i++) {
             CommonTex[i].type = CommonTex[i].dataType = TR::TEX_TYPE_SPRITE;
-            Atlas *dst = (i == CTEX_FLASH || i == CTEX_WHITE_OBJECT) ? oAtlas : ((i == CTEX_WHITE_ROOM) ? rAtlas : gAtlas);
-            dst->add(level.objectTexturesCount + level.spriteTexturesCount + i, short4(i * 32, ATLAS_PAGE_BARS, i * 32 + CommonTexOffset[i].x, ATLAS_PAGE_BARS + CommonTexOffset[i].y), &CommonTex[i]);
+            if (i == CTEX_FLASH || i == CTEX_WHITE_OBJECT) {
+                addCommonTexture(oAtlas, i);
+            } else if (i == CTEX_WHITE_ROOM) {
+                addCommonTexture(rAtlas, i);
+            }
         }
 
         // get result texture
@@ -1690,7 +2165,6 @@ struct Level : IGame {
         atlasRooms   = rAtlas->pack(OPT_MIPMAPS | OPT_VRAM_3DS);
         atlasObjects = oAtlas->pack(OPT_MIPMAPS);
         atlasSprites = sAtlas->pack(OPT_MIPMAPS);
-        atlasGlyphs  = gAtlas->pack(0);
 
     #ifdef _OS_3DS
         ASSERT(atlasRooms->width   <= 1024 && atlasRooms->height   <= 1024);
@@ -1701,34 +2175,54 @@ struct Level : IGame {
         delete[] tileData;
         tileData = NULL;
 
-        delete[] glyphsRU;
-        delete[] glyphsJA;
-        delete[] glyphsGR;
-        delete[] glyphsCN;
+    #ifdef LEVEL_BAKE
+        saveBake(sourceSize, rAtlas, oAtlas, sAtlas);
+    #endif
+
+        delete rAtlas;
+        delete oAtlas;
+        delete sAtlas;
+    }
+
+#endif
+
+    void initTextures(int32 sourceSize) {
+    #ifndef SPLIT_BY_TILE
+
+        #if defined(_GAPI_SW) || defined(_GAPI_GU)
+            #error atlas packing is not allowed for this platform
+        #endif
+
+        #ifdef _DEBUG
+            //dumpGlyphs();
+            //dumpKanji();
+        #endif
+
+        UI::patchGlyphs(level);
+
+        atlasRooms = atlasObjects = atlasSprites = atlasGlyphs = NULL;
+
+    #ifdef LEVEL_BAKE
+        loadBake(sourceSize);
+        if (!atlasRooms) {
+            packAtlases(sourceSize);
+        }
+    #else
+        packAtlases(sourceSize);
+    #endif
 
-        glyphsRU = NULL;
-        glyphsJA = NULL;
-        glyphsGR = NULL;
-        glyphsCN = NULL;
+        initGlyphAtlas();
 
         atlasRooms->setFilterQuality(Core::settings.detail.filter);
         atlasObjects->setFilterQuality(Core::settings.detail.filter);
         atlasSprites->setFilterQuality(Core::settings.detail.filter);
-        atlasGlyphs->setFilterQuality(Core::Settings::MEDIUM);
-
-        delete rAtlas;
-        delete oAtlas;
-        delete sAtlas;
-        delete gAtlas;
 
         LOG("rooms   : %d x %d\n", atlasRooms->width, atlasRooms->height);
         LOG("objects : %d x %d\n", atlasObjects->width, atlasObjects->height);
         LOG("sprites : %d x %d\n", atlasSprites->width, atlasSprites->height);
-        LOG("glyphs  : %d x %d\n", atlasGlyphs->width, atlasGlyphs->height);
         PROFILE_LABEL(TEXTURE, atlasRooms->ID, "atlas_rooms");
         PROFILE_LABEL(TEXTURE, atlasObjects->ID, "atlas_objects");
         PROFILE_LABEL(TEXTURE, atlasSprites->ID, "atlas_sprites");
-        PROFILE_LABEL(TEXTURE, atlasGlyphs->ID, "atlas_glyphs");
 
     #else
         ASSERT(level.tilesCount);
@@ -1985,22 +2479,14 @@ struct Level : IGame {
         return s;
     }
 
-    void renderRooms(RoomDesc *roomsList, int roomsCount, int transp) {
-        PROFILE_MARKER("ROOMS");
+    void recordRooms(RoomDesc *roomsList, int roomsCount, int transp) {
+        renderList.reset();
 
-        if (Core::pass == Core::passShadow)
+        if (!roomsCount)
             return;
 
-        Basis basis;
-        basis.identity();
-
-        Core::mModel.identity();
-
-        switch (transp) {
-            case 0 : Core::setBlendMode(bmNone);    break;
-            case 1 : Core::setBlendMode(bmPremult); break;
-            case 2 : Core::setBlendMode(bmAdd);   Core::setDepthWrite(false); break;
-        }
+    // opaque rooms in the medium of the nearest one go first, so both groups stay front to back
+        bool water = level.rooms[roomsList[0].index].flags.water;
 
         int i     = 0;
         int end   = roomsCount;
@@ -2012,8 +2498,6 @@ struct Level : IGame {
             dir = -1;
         }
 
-        atlasRooms->bind(sDiffuse);
-
         short4 vp = Core::scissor;
 
         while (i != end) {
@@ -2025,97 +2509,157 @@ struct Level : IGame {
                 continue;
             }
 
-            Core::setScissor(getPortalRect(roomsList[i].portal, vp));
-
             const TR::Room &room = level.rooms[roomIndex];
 
             vec3 center = room.getCenter();
             int ambient = room.getAmbient(int(center.x), int(center.y), int(center.z));
 
-            setRoomParams(roomIndex, Shader::ROOM, 1.0f, intensityf(ambient), 0.0f, 1.0f, transp == 1);
+            RenderCommand &cmd = renderList.add(RenderCommand::ROOM, transp, roomIndex, transp ? 0 : (room.flags.water != water), getPortalRect(roomsList[i].portal, vp));
+            cmd.ambient = intensityf(ambient);
 
-            basis.pos = room.getOffset();
-            Core::setBasis(&basis, 1);
+            i += dir;
+        }
 
-            Core::mModel.setPos(basis.pos);
+        if (transp == 1) {
+            for (int i = 0; i < roomsCount; i++) {
+                int roomIndex = roomsList[i].index;
+                level.rooms[roomIndex].flags.visible = true;
 
-            mesh->transparent = transp;
-            mesh->renderRoomGeometry(roomIndex);
+                if (!mesh->rooms[roomIndex].sprites.iCount)
+                    continue;
 
-            i += dir;
+                renderList.add(RenderCommand::ROOM_SPRITES, transp, roomIndex, 0, getPortalRect(roomsList[i].portal, vp));
+            }
         }
 
-        Core::setDepthWrite(true);
+        if (!transp)
+            renderList.sort();
+    }
 
-        if (transp == 1) {
-            atlasSprites->bind(sDiffuse);
+    void submitRooms() {
+        Basis basis;
+        basis.identity();
 
-            Core::setBlendMode(bmPremult);
+        Core::mModel.identity();
 
-            #ifdef MERGE_SPRITES
-                basis.rot = Core::mViewInv.getRot();
-            #else
-                basis.rot = quat(0, 0, 0, 1);
-            #endif
+        short4 vp   = Core::scissor;
+        int    type = -1;
 
-            for (int i = 0; i < roomsCount; i++) {
-                int roomIndex = roomsList[i].index;
-                level.rooms[roomIndex].flags.visible = true;
+        roomState = -1;
 
-                MeshBuilder::RoomRange &range = mesh->rooms[roomIndex];
+        for (int i = 0; i < renderList.length; i++) {
+            const RenderCommand &cmd = renderList[i];
 
-                if (!range.sprites.iCount)
-                    continue;
+            if (cmd.type != type) {
+                type = cmd.type;
+
+                if (type == RenderCommand::ROOM) {
+                    switch (cmd.transp) {
+                        case 0 : Core::setBlendMode(bmNone);    break;
+                        case 1 : Core::setBlendMode(bmPremult); break;
+                        case 2 : Core::setBlendMode(bmAdd);   Core::setDepthWrite(false); break;
+                    }
+                    atlasRooms->bind(sDiffuse);
+                    basis.rot = quat(0, 0, 0, 1);
+                } else {
+                    Core::setDepthWrite(true);
+                    Core::setBlendMode(bmPremult);
+                    atlasSprites->bind(sDiffuse);
+                    #ifdef MERGE_SPRITES
+                        basis.rot = Core::mViewInv.getRot();
+                    #else
+                        basis.rot = quat(0, 0, 0, 1);
+                    #endif
+                }
+            }
+
+            Core::setScissor(cmd.scissor);
 
-                Core::setScissor(getPortalRect(roomsList[i].portal, vp));
+            basis.pos = level.rooms[cmd.index].getOffset();
 
-                setRoomParams(roomIndex, Shader::SPRITE, 1.0f, 1.0f, 0.0f, 1.0f, true);
+            if (type == RenderCommand::ROOM) {
+                setRoomParams(cmd.index, Shader::ROOM, 1.0f, cmd.ambient, 0.0f, 1.0f, cmd.transp == 1);
+                Core::setBasis(&basis, 1);
+                Core::mModel.setPos(basis.pos);
 
-                basis.pos = level.rooms[roomIndex].getOffset();
+                mesh->transparent = cmd.transp;
+                mesh->renderRoomGeometry(cmd.index);
+            } else {
+                setRoomParams(cmd.index, Shader::SPRITE, 1.0f, 1.0f, 0.0f, 1.0f, true);
                 Core::setBasis(&basis, 1);
 
-                mesh->renderRoomSprites(roomIndex);
+                mesh->renderRoomSprites(cmd.index);
             }
         }
 
+        Core::setDepthWrite(true);
         Core::setScissor(vp);
         Core::setBlendMode(bmNone);
     }
 
-    void renderEntity(const TR::Entity &entity) {
-        //if (entity.room != lara->getRoomIndex()) return;
-        if (Core::pass == Core::passShadow && !entity.castShadow()) return;
+    void renderRooms(RoomDesc *roomsList, int roomsCount, int transp) {
+        PROFILE_MARKER("ROOMS");
+
+        if (Core::pass == Core::passShadow)
+            return;
+
+        recordRooms(roomsList, roomsCount, transp);
+        submitRooms();
+    }
+
+// returns false if the entity has nothing to draw in the current pass
+    bool getEntityShader(const TR::Entity &entity, Shader::Type &type) {
+        //if (entity.room != lara->getRoomIndex()) return false;
+        if (Core::pass == Core::passShadow && !entity.castShadow()) return false;
 
         Controller *controller = (Controller*)entity.controller;
-        int roomIndex = controller->getRoomIndex();
-        TR::Room &room = level.rooms[roomIndex];
+        TR::Room &room = level.rooms[controller->getRoomIndex()];
 
         if (controller->flags.invisible)
-            return;
+            return false;
 
         if (!entity.isLara() && !entity.isActor() && !room.flags.visible)
-            return;
+            return false;
 
         bool isModel;
 
         if (entity.type != TR::Entity::TRAP_LAVA_EMITTER) {
             isModel = entity.modelIndex > 0;
             if (isModel) {
-                if (!mesh->models[controller->getModel()->index].geometry[mesh->transparent].count) return;
+                if (!mesh->models[controller->getModel()->index].geometry[mesh->transparent].count) return false;
             } else {
-                if (level.spriteSequences[-(entity.modelIndex + 1)].transp != mesh->transparent) return;
+                if (level.spriteSequences[-(entity.modelIndex + 1)].transp != mesh->transparent) return false;
             }
         } else {
             if (mesh->transparent != 2) {
-                return;
+                return false;
             }
             isModel = false;
         }
 
-        Shader::Type type = isModel ? Shader::ENTITY : Shader::SPRITE;
+        type = isModel ? Shader::ENTITY : Shader::SPRITE;
         if (entity.type == TR::Entity::CRYSTAL)
             type = Shader::MIRROR;
 
+        return true;
+    }
+
+    void renderEntity(const TR::Entity &entity, Shader::Type type) {
+        Controller *controller = (Controller*)entity.controller;
+        int roomIndex = controller->getRoomIndex();
+        TR::Room &room = level.rooms[roomIndex];
+
+        bool isModel = type != Shader::SPRITE;
+
+        #ifdef _GAPI_SW
+            if (isModel && GAPI::isOccluded(controller->getBoundingBox())) {
+                MeshBuilder::Geometry &geom = mesh->models[controller->getModel()->index].geometry[mesh->transparent];
+                for (int i = 0; i < geom.count; i++)
+                    Core::stats.culled += geom.ranges[i].iCount / 3;
+                return;
+            }
+        #endif
+
         if (isModel) { // model
             ASSERT(controller->intensity >= 0.0f);
 
@@ -2123,6 +2667,12 @@ struct Level : IGame {
             setRoomParams(roomIndex, type, 1.0f, controller->intensity, controller->specular, 1.0f, mesh->transparent == 1);
 
             vec3 pos = controller->getPos();
+
+            #ifdef _GAPI_SW
+                if (lightCache && !level.isCutsceneLevel()) {
+                    GAPI::setSectorLight(lightCache->getLight(roomIndex, pos));
+                }
+            #endif
             if (ambientCache) {
                 if (!entity.isDoor() && !entity.isBlock() && !entity.isPickup()) { // no advanced ambient lighting for secret (all) doors and blocks
                     AmbientCache::Cube cube;
@@ -2156,6 +2706,15 @@ struct Level : IGame {
 
     void loadNextLevelData() {
         isEnded = true;
+    #ifdef LEVEL_PRELOAD
+        Stream    *stream;
+        TR::Level *data;
+        if (LevelPreload::take(nextLevel, stream, data)) {
+            nextLevel = TR::LVL_MAX;
+            loadLevelAsync(stream, data);
+            return;
+        }
+    #endif
         char buf[64];
         TR::getGameLevelFile(buf, level.version, nextLevel);
         nextLevel = TR::LVL_MAX;
@@ -2240,7 +2799,15 @@ struct Level : IGame {
             if (inventory->isActive())
                 return;
 
-            loadLevel(saveSlots[loadSlot].getLevelID());
+            const SaveSlot &slot = saveSlots[loadSlot];
+            if (canApplySaveSlot(slot)) {
+                applySaveSlot(slot);
+                snapshots.reset();
+                loadSlot = -1;
+                return;
+            }
+
+            loadLevel(slot.getLevelID());
             return;
         }
 
@@ -2279,6 +2846,7 @@ struct Level : IGame {
 
                 if (animTexTimer > timeStep) {
                     level.shiftAnimTex();
+                    mesh->animTexFrame++;
                     animTexTimer -= timeStep;
                 }
 
@@ -2287,6 +2855,7 @@ struct Level : IGame {
                 Controller *c = Controller::first;
                 while (c) {
                     Controller *next = c->next;
+                    c->storePose();
                     c->update();
                     c = next;
                 }
@@ -2301,6 +2870,9 @@ struct Level : IGame {
 
             Controller::clearInactive();
 
+            if (!paused && !level.isCutsceneLevel())
+                updateSnapshots();
+
         // underwater ambient sound volume control
             if (camera->isUnderwater()) {
                 if (!sndWater && !level.isCutsceneLevel()) {
@@ -2340,6 +2912,10 @@ struct Level : IGame {
             Input::down[ikY] = false;
         }
     #endif        
+        if (Input::down[ikBack]) {
+            rewind(1);
+            Input::down[ikBack] = false;
+        }
     #endif
 
     #ifdef GEOMETRY_EXPORT
@@ -2390,16 +2966,45 @@ struct Level : IGame {
         setupBinding();
     }
 
+    void recordEntities(int transp) {
+        renderList.reset();
+
+        short4 vp = Core::scissor;
+
+        for (int i = 0; i < level.entitiesCount; i++) {
+            const TR::Entity &e = level.entities[i];
+            if (!e.controller || e.modelIndex == 0) continue;
+
+            Shader::Type type;
+            if (!getEntityShader(e, type)) continue;
+
+        // opaque entities are grouped by the shader and the room medium
+            bool water = level.rooms[((Controller*)e.controller)->getRoomIndex()].flags.water;
+
+            RenderCommand &cmd = renderList.add(RenderCommand::ENTITY, transp, i, transp ? 0 : ((type << 1) | int(water)), vp);
+            cmd.shader = uint8(type);
+        }
+
+        if (!transp)
+            renderList.sort();
+    }
+
+    void submitEntities() {
+        roomState = -1;
+
+        for (int i = 0; i < renderList.length; i++) {
+            const RenderCommand &cmd = renderList[i];
+            renderEntity(level.entities[cmd.index], Shader::Type(cmd.shader));
+        }
+    }
+
     void renderEntitiesTransp(int transp) {
         mesh->dynBegin();
         mesh->transparent = transp;
 
         atlasObjects->bind(sDiffuse);
-        for (int i = 0; i < level.entitiesCount; i++) {
-            TR::Entity &e = level.entities[i];
-            if (!e.controller || e.modelIndex == 0) continue;
-            renderEntity(e);
-        }
+        recordEntities(transp);
+        submitEntities();
 
         {
             PROFILE_MARKER("ENTITY_SPRITES");
@@ -3352,18 +3957,31 @@ struct Level : IGame {
         short4         oldViewport = Core::viewportDef;
         GAPI::Texture *oldTarget   = Core::defaultTarget;
 
-        bool upscale = !invBG && Core::settings.detail.scale != Core::Settings::SCALE_100;
+        float maxScale = float((Core::settings.detail.scale + 1) * 25) * 0.01f;
+        float scale    = maxScale;
+    #ifdef DYN_SCALE
+        scale = dynScale.get(maxScale);
+        int renderTime = Core::getTime();
+    #endif
+
+        bool upscale = !invBG && scale < 1.0f;
+
+        if (!invBG) {
+            Core::stats.scale = int(scale * 100.0f + 0.5f);
+        }
 
         if (upscale) {
-            int scale = (Core::settings.detail.scale + 1) * 25;
-            int w = Core::width  * scale / 100;
-            int h = Core::height * scale / 100;
-            if (!scaleTex || scaleTex->width != w || scaleTex->height != h) {
+            int w = int(Core::width  * scale);
+            int h = int(Core::height * scale);
+            if (!scaleTex || scaleTex->origWidth != w || scaleTex->origHeight != h) {
                 delete scaleTex;
                 scaleTex = new Texture(w, h, 1, FMT_RGBA, OPT_TARGET);
             }
             Core::defaultTarget = scaleTex;
             Core::viewportDef   = short4(0, 0, w, h);
+        #ifdef _GAPI_SW
+            GAPI::setUpscaleTarget(scaleTex);
+        #endif
         }
 
         if (Core::eye == 0.0f && Core::settings.detail.isStereo()) {
@@ -3401,6 +4019,12 @@ struct Level : IGame {
         Core::viewportDef   = oldViewport;
 
         if (upscale) {
+        #ifdef _GAPI_SW
+            Core::setTarget(NULL, NULL, RT_STORE_COLOR);
+            Core::validateRenderState();
+            GAPI::upscale(scaleTex);
+            GAPI::setUpscaleTarget(NULL);
+        #else
             mat4 mProj, mView;
             mView.identity();
             mProj = GAPI::ortho(-1, +1, -1, +1, 0, 1);
@@ -3415,8 +4039,15 @@ struct Level : IGame {
             mesh->renderQuad();
             Core::setDepthTest(true);
             Core::setDepthWrite(true);
+        #endif
         }
 
+    #ifdef DYN_SCALE
+        if (!invBG) {
+            dynScale.update(Core::getTime() - renderTime, maxScale);
+        }
+    #endif
+
         // TODO render all UI with native resolution here
     }
 
@@ -3426,6 +4057,8 @@ struct Level : IGame {
         #ifdef _GAPI_SW
             GAPI::setPalette(GAPI::swPaletteColor);
             GAPI::setShading(false);
+            GAPI::setWaterLookup(NULL, NULL, 0, 0, vec4(0.0f));
+            GAPI::setSectorLight(vec3(0.0f));
         #endif
 
         Core::pushLights();
@@ -3500,6 +4133,10 @@ struct Level : IGame {
         Core::pushLights();
         Core::resetLights();
 
+        #ifdef _GAPI_SW
+            GAPI::setSectorLight(vec3(0.0f));
+        #endif
+
         if (inventory->video) {
             inventory->render(1.0);
 
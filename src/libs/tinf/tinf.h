@@ -35,6 +35,9 @@ void TINFCC tinf_init();
 int TINFCC tinf_uncompress(void *dest, unsigned int *destLen,
                            const void *source, unsigned int sourceLen);
 
+int TINFCC tinf_uncompress_bounded(void *dest, unsigned int *destLen, unsigned int destSize,
+                                   const void *source, unsigned int sourceLen);
+
 int TINFCC tinf_gzip_uncompress(void *dest, unsigned int *destLen,
                                 const void *source, unsigned int sourceLen);
 
@@ -31,6 +31,11 @@
  *    any source distribution.
  */
 
+/*
+ * Altered for OpenLara: tinf_uncompress_bounded limits the source
+ * and destination buffers and rejects invalid codes.
+ */
+
 #include "tinf.h"
 
 /* ------------------------------ *
@@ -44,10 +49,13 @@ typedef struct {
 
 typedef struct {
    const unsigned char *source;
+   const unsigned char *sourceEnd; /* NULL if unbounded */
    unsigned int tag;
    unsigned int bitcount;
 
    unsigned char *dest;
+   unsigned char *destStart;
+   unsigned char *destEnd; /* NULL if unbounded */
    unsigned int *destLen;
 
    TINF_TREE ltree; /* dynamic length/symbol tree */
@@ -162,8 +170,9 @@ static int tinf_getbit(TINF_DATA *d)
    /* check if tag is empty */
    if (!d->bitcount--)
    {
-      /* load next tag */
-      d->tag = *d->source++;
+      /* load next tag, zeros past the end of a bounded source */
+      d->tag = (!d->sourceEnd || d->source < d->sourceEnd) ? *d->source : 0;
+      d->source++;
       d->bitcount = 7;
    }
 
@@ -207,13 +216,16 @@ static int tinf_decode_symbol(TINF_DATA *d, TINF_TREE *t)
       sum += t->table[len];
       cur -= t->table[len];
 
-   } while (cur >= 0);
+   } while (cur >= 0 && len < 15);
+
+   /* code is not in the tree */
+   if (cur >= 0) return -1;
 
    return t->trans[sum + cur];
 }
 
 /* given a data stream, decode dynamic trees from it */
-static void tinf_decode_trees(TINF_DATA *d, TINF_TREE *lt, TINF_TREE *dt)
+static int tinf_decode_trees(TINF_DATA *d, TINF_TREE *lt, TINF_TREE *dt)
 {
    TINF_TREE code_tree;
    unsigned char lengths[288+32];
@@ -248,13 +260,19 @@ static void tinf_decode_trees(TINF_DATA *d, TINF_TREE *lt, TINF_TREE *dt)
    {
       int sym = tinf_decode_symbol(d, &code_tree);
 
+      if (sym < 0) return TINF_DATA_ERROR;
+
       switch (sym)
       {
       case 16:
          /* copy previous code length 3-6 times (read 2 bits) */
          {
-            unsigned char prev = lengths[num - 1];
-            for (length = tinf_read_bits(d, 2, 3); length; --length)
+            unsigned char prev;
+            if (num == 0) return TINF_DATA_ERROR;
+            prev = lengths[num - 1];
+            length = tinf_read_bits(d, 2, 3);
+            if (num + length > hlit + hdist) return TINF_DATA_ERROR;
+            for (; length; --length)
             {
                lengths[num++] = prev;
             }
@@ -262,14 +280,18 @@ static void tinf_decode_trees(TINF_DATA *d, TINF_TREE *lt, TINF_TREE *dt)
          break;
       case 17:
          /* repeat code length 0 for 3-10 times (read 3 bits) */
-         for (length = tinf_read_bits(d, 3, 3); length; --length)
+         length = tinf_read_bits(d, 3, 3);
+         if (num + length > hlit + hdist) return TINF_DATA_ERROR;
+         for (; length; --length)
          {
             lengths[num++] = 0;
          }
          break;
       case 18:
          /* repeat code length 0 for 11-138 times (read 7 bits) */
-         for (length = tinf_read_bits(d, 7, 11); length; --length)
+         length = tinf_read_bits(d, 7, 11);
+         if (num + length > hlit + hdist) return TINF_DATA_ERROR;
+         for (; length; --length)
          {
             lengths[num++] = 0;
          }
@@ -284,6 +306,8 @@ static void tinf_decode_trees(TINF_DATA *d, TINF_TREE *lt, TINF_TREE *dt)
    /* build dynamic trees */
    tinf_build_tree(lt, lengths, hlit);
    tinf_build_tree(dt, lengths + hlit, hdist);
+
+   return TINF_OK;
 }
 
 /* ----------------------------- *
@@ -300,6 +324,8 @@ static int tinf_inflate_block_data(TINF_DATA *d, TINF_TREE *lt, TINF_TREE *dt)
    {
       int sym = tinf_decode_symbol(d, lt);
 
+      if (sym < 0) return TINF_DATA_ERROR;
+
       /* check for end of block */
       if (sym == 256)
       {
@@ -309,6 +335,8 @@ static int tinf_inflate_block_data(TINF_DATA *d, TINF_TREE *lt, TINF_TREE *dt)
 
       if (sym < 256)
       {
+         if (d->destEnd && d->dest >= d->destEnd) return TINF_DATA_ERROR;
+
          *d->dest++ = sym;
 
       } else {
@@ -318,14 +346,21 @@ static int tinf_inflate_block_data(TINF_DATA *d, TINF_TREE *lt, TINF_TREE *dt)
 
          sym -= 257;
 
+         if (sym > 28) return TINF_DATA_ERROR;
+
          /* possibly get more bits from length code */
          length = tinf_read_bits(d, length_bits[sym], length_base[sym]);
 
          dist = tinf_decode_symbol(d, dt);
 
+         if (dist < 0 || dist > 29) return TINF_DATA_ERROR;
+
          /* possibly get more bits from distance code */
          offs = tinf_read_bits(d, dist_bits[dist], dist_base[dist]);
 
+         if (offs > d->dest - d->destStart) return TINF_DATA_ERROR;
+         if (d->destEnd && length > d->destEnd - d->dest) return TINF_DATA_ERROR;
+
          /* copy match */
          for (i = 0; i < length; ++i)
          {
@@ -343,6 +378,8 @@ static int tinf_inflate_uncompressed_block(TINF_DATA *d)
    unsigned int length, invlength;
    unsigned int i;
 
+   if (d->sourceEnd && d->sourceEnd - d->source < 4) return TINF_DATA_ERROR;
+
    /* get length */
    length = d->source[1];
    length = 256*length + d->source[0];
@@ -356,6 +393,9 @@ static int tinf_inflate_uncompressed_block(TINF_DATA *d)
 
    d->source += 4;
 
+   if (d->sourceEnd && (unsigned int)(d->sourceEnd - d->source) < length) return TINF_DATA_ERROR;
+   if (d->destEnd && (unsigned int)(d->destEnd - d->dest) < length) return TINF_DATA_ERROR;
+
    /* copy block */
    for (i = length; i; --i) *d->dest++ = *d->source++;
 
@@ -378,7 +418,7 @@ static int tinf_inflate_fixed_block(TINF_DATA *d)
 static int tinf_inflate_dynamic_block(TINF_DATA *d)
 {
    /* decode trees from stream */
-   tinf_decode_trees(d, &d->ltree, &d->dtree);
+   if (tinf_decode_trees(d, &d->ltree, &d->dtree) != TINF_OK) return TINF_DATA_ERROR;
 
    /* decode block using decoded trees */
    return tinf_inflate_block_data(d, &d->ltree, &d->dtree);
@@ -406,15 +446,25 @@ void tinf_init()
 /* inflate stream from source to dest */
 int tinf_uncompress(void *dest, unsigned int *destLen,
                     const void *source, unsigned int sourceLen)
+{
+   return tinf_uncompress_bounded(dest, destLen, 0, source, 0);
+}
+
+/* inflate stream from source to dest, fails if either buffer is exceeded (0 = unbounded) */
+int tinf_uncompress_bounded(void *dest, unsigned int *destLen, unsigned int destSize,
+                            const void *source, unsigned int sourceLen)
 {
    TINF_DATA d;
    int bfinal;
 
    /* initialise data */
    d.source = (const unsigned char *)source;
+   d.sourceEnd = sourceLen ? d.source + sourceLen : 0;
    d.bitcount = 0;
 
    d.dest = (unsigned char *)dest;
+   d.destStart = d.dest;
+   d.destEnd = destSize ? d.dest + destSize : 0;
    d.destLen = destLen;
 
    *destLen = 0;
@@ -453,5 +503,8 @@ int tinf_uncompress(void *dest, unsigned int *destLen,
 
    } while (!bfinal);
 
+   /* ran past the end of the source */
+   if (d.sourceEnd && d.source > d.sourceEnd) return TINF_DATA_ERROR;
+
    return TINF_OK;
 }
@@ -24,6 +24,7 @@ TR::TextureInfo &whiteSprite = CommonTex[CTEX_WHITE_SPRITE];
 #define CIRCLE_SEGS  16
 
 #define DYN_MESH_FACES     2048
+#define ANIM_TEX_MAX_PHASES 16     // animated faces with longer cycles are rebuilt every frame
 #define DOUBLE_SIDED       2
 
 #define WATER_VOLUME_HEIGHT (768 * 2)
@@ -51,6 +52,43 @@ struct Mesh : GAPI::Mesh {
     }
 };
 
+// render commands
+// scene traversal records what to draw without touching GAPI, the level sorts and submits them
+// the high half of the key is the render state (shader, medium), the low half is the recording order,
+// so opaque commands with the same state stay front to back, blended lists are not sorted
+struct RenderCommand {
+    enum Type { ROOM, ROOM_SPRITES, ENTITY };
+
+    uint32 key;
+    uint8  type;
+    uint8  transp;
+    uint8  shader;
+    int16  index; // room or entity
+    short4 scissor;
+    float  ambient;
+
+    static int cmp(const RenderCommand &a, const RenderCommand &b) {
+        return a.key < b.key ? -1 : (a.key > b.key ? 1 : 0);
+    }
+};
+
+struct RenderList : Array<RenderCommand> {
+
+    RenderList() : Array<RenderCommand>(256) {}
+
+    RenderCommand& add(RenderCommand::Type type, int transp, int index, uint16 state, const short4 &scissor) {
+        RenderCommand cmd;
+        cmd.key     = (uint32(state) << 16) | uint16(length);
+        cmd.type    = uint8(type);
+        cmd.transp  = uint8(transp);
+        cmd.shader  = 0;
+        cmd.index   = int16(index);
+        cmd.scissor = scissor;
+        cmd.ambient = 1.0f;
+        return items[push(cmd)];
+    }
+};
+
 #define CHECK_ROOM_NORMAL(f) \
             vec3 o = d.vertices[f.vertices[0]].pos;\
             vec3 a = o - d.vertices[f.vertices[1]].pos;\
@@ -151,8 +189,10 @@ struct MeshBuilder {
     };
 
     struct Dynamic {
-        uint16 count;
-        uint16 *faces;
+        uint16   count;
+        uint16   *faces;
+        uint16   phases;
+        Geometry *frames;  // prebuilt geometry for every animTexFrame % phases
     };
 
     struct RoomRange {
@@ -176,6 +216,10 @@ struct MeshBuilder {
     MeshRange plane;
 
     int transparent;
+    int animTexFrame;   // number of TR::Level::shiftAnimTex calls since the geometry was built
+
+    int16  *animTexGroup; // build time only, animated texture group and position of object textures
+    uint16 *animTexPos;
 
     #ifdef SPLIT_BY_TILE
         uint16 curTile, curClut;
@@ -199,6 +243,11 @@ struct MeshBuilder {
         int iCount = 0, vCount = 0;
 
     // sort room faces by material
+        TR::gObjectTextures      = level->objectTextures;
+        TR::gSpriteTextures      = level->spriteTextures;
+        TR::gObjectTexturesCount = level->objectTexturesCount;
+        TR::gSpriteTexturesCount = level->spriteTexturesCount;
+
         for (int i = 0; i < level->roomsCount; i++) {
             TR::Room::Data &data = level->rooms[i].data;
             sort(data.faces, data.fCount);
@@ -212,6 +261,19 @@ struct MeshBuilder {
             sort(mesh.faces, mesh.fCount);
         }
 
+    // animated texture groups
+        animTexFrame = 0;
+        animTexGroup = new int16[level->objectTexturesCount];
+        animTexPos   = new uint16[level->objectTexturesCount];
+        memset(animTexGroup, 0xFF, sizeof(int16) * level->objectTexturesCount);
+        for (int i = 0; i < level->animTexturesCount; i++) {
+            TR::AnimTexture &animTex = level->animTextures[i];
+            for (int j = 0; j < animTex.count; j++) {
+                animTexGroup[animTex.textures[j]] = i;
+                animTexPos[animTex.textures[j]]   = j;
+            }
+        }
+
     // get size of mesh for rooms (geometry & sprites)
         int vStartRoom = vCount;
 
@@ -254,6 +316,15 @@ struct MeshBuilder {
             vCount += d.sCount * 4;
         #endif
 
+            for (int transp = 0; transp < 3; transp++) {
+                int rCount, tCount;
+                int phases = getAnimPhases(d, getBlendMask(transp), rCount, tCount);
+                if (phases <= ANIM_TEX_MAX_PHASES) {
+                    iCount += (rCount * 6 + tCount * 3) * DOUBLE_SIDED * phases;
+                    vCount += (rCount * 4 + tCount * 3) * phases;
+                }
+            }
+
             if (vCount - vStartRoom > 0xFFFF) {
                 vStartRoom = vStartCount;
                 rooms[i].split = true;
@@ -366,6 +437,9 @@ struct MeshBuilder {
                 }
 
                 geom.finish(iCount);
+
+            // animated faces for every step of the texture animation
+                buildAnimFrames(range.dynamic[transp], blendMask, room, level, indices, vertices, iCount, vCount, vStartRoom);
             }
 
         // rooms sprites
@@ -603,6 +677,11 @@ struct MeshBuilder {
         delete[] indices;
         delete[] vertices;
 
+        delete[] animTexGroup;
+        delete[] animTexPos;
+        animTexGroup = NULL;
+        animTexPos   = NULL;
+
         PROFILE_LABEL(BUFFER, mesh->ID[0], "Geometry indices");
         PROFILE_LABEL(BUFFER, mesh->ID[1], "Geometry vertices");
 
@@ -619,10 +698,16 @@ struct MeshBuilder {
             }
 
             RoomRange &r = rooms[i];
-            for (int j = 0; j < 3; j++)
+            for (int j = 0; j < 3; j++) {
                 for (int k = 0; k < r.geometry[j].count; k++)
                     r.geometry[j].ranges[k].aIndex = rangeRoom.aIndex;
 
+                Dynamic &dyn = r.dynamic[j];
+                for (int f = 0; f < dyn.phases; f++)
+                    for (int k = 0; k < dyn.frames[f].count; k++)
+                        dyn.frames[f].ranges[k].aIndex = rangeRoom.aIndex;
+            }
+
             r.sprites.aIndex = rangeRoom.aIndex;
             r.waterVolume.aIndex = rangeRoom.aIndex;
         }
@@ -649,8 +734,10 @@ struct MeshBuilder {
 
     ~MeshBuilder() {
         for (int i = 0; i < level->roomsCount; i++)
-            for (int j = 0; j < COUNT(rooms[i].dynamic); j++)
+            for (int j = 0; j < COUNT(rooms[i].dynamic); j++) {
                 delete[] rooms[i].dynamic[j].faces;
+                delete[] rooms[i].dynamic[j].frames;
+            }
 
         delete[] rooms;
         delete[] models;
@@ -1008,8 +1095,10 @@ struct MeshBuilder {
         const TR::Room::Data &d = room.data;
 
         if (dyn) {
-            dyn->count = 0;
-            dyn->faces = NULL;
+            dyn->count  = 0;
+            dyn->faces  = NULL;
+            dyn->phases = 0;
+            dyn->frames = NULL;
         }
 
         for (int j = 0; j < d.fCount; j++) {
@@ -1056,6 +1145,83 @@ struct MeshBuilder {
         }
     }
 
+    static int gcd(int a, int b) {
+        while (b) {
+            int t = a % b;
+            a = b;
+            b = t;
+        }
+        return a;
+    }
+
+    // the animated faces repeat their look after lcm of their animation lengths
+    int getAnimPhases(const TR::Room::Data &d, int blendMask, int &rCount, int &tCount) {
+        int phases = 1;
+        rCount = tCount = 0;
+
+        for (int j = 0; j < d.fCount; j++) {
+            const TR::Face        &f = d.faces[j];
+            const TR::TextureInfo &t = level->objectTextures[f.flags.texture];
+
+            if (f.water || !t.animated || !(blendMask & getBlendMask(t.attribute)))
+                continue;
+
+            if (f.triangle)
+                tCount++;
+            else
+                rCount++;
+
+            int group = animTexGroup[f.flags.texture];
+            if (group != -1) {
+                int count = level->animTextures[group].count;
+                phases = phases / gcd(phases, count) * count;
+                phases = min(phases, ANIM_TEX_MAX_PHASES + 1);
+            }
+        }
+
+        return phases;
+    }
+
+    // texture of the face after the given number of TR::Level::shiftAnimTex calls
+    TR::TextureInfo& getAnimTexture(int texture, int phase) {
+        int group = animTexGroup[texture];
+        if (group == -1)
+            return level->objectTextures[texture];
+        TR::AnimTexture &animTex = level->animTextures[group];
+        return level->objectTextures[animTex.textures[(animTexPos[texture] + phase) % animTex.count]];
+    }
+
+    void buildAnimFrames(Dynamic &dyn, int blendMask, const TR::Room &room, TR::Level *level, Index *indices, Vertex *vertices, int &iCount, int &vCount, int vStart) {
+        if (!dyn.count)
+            return;
+
+        const TR::Room::Data &d = room.data;
+
+        int rCount, tCount;
+        int phases = getAnimPhases(d, blendMask, rCount, tCount);
+        if (phases > ANIM_TEX_MAX_PHASES)
+            return;
+
+        dyn.phases = phases;
+        dyn.frames = new Geometry[phases];
+
+        for (int k = 0; k < phases; k++) {
+            Geometry &geom = dyn.frames[k];
+
+            for (int i = 0; i < dyn.count; i++) {
+                TR::Face        &f = d.faces[dyn.faces[i]];
+                TR::TextureInfo &t = getAnimTexture(f.flags.texture, k);
+
+                if (!geom.validForTile(t.tile, t.clut))
+                    geom.getNextRange(vStart, iCount, t.tile, t.clut);
+
+                ADD_ROOM_FACE(indices, iCount, vCount, vStart, vertices, f, t);
+            }
+
+            geom.finish(iCount);
+        }
+    }
+
     bool buildMesh(Geometry &geom, int blendMask, const TR::Mesh &mesh, TR::Level *level, Index *indices, Vertex *vertices, int &iCount, int &vCount, int vStart, int16 joint, int x, int y, int z, int dir, const Color32 &light, bool useRoomTex, bool forceOpaque) {
         bool isOpaque = true;
 
@@ -1430,7 +1596,18 @@ struct MeshBuilder {
         }
 
         Dynamic &dyn = rooms[roomIndex].dynamic[transparent];
-        if (dyn.count) {
+        if (dyn.phases) {
+            Geometry &frame = dyn.frames[animTexFrame % dyn.phases];
+            for (int i = 0; i < frame.count; i++) {
+                MeshRange &range = frame.ranges[i];
+
+            #ifdef SPLIT_BY_TILE
+                atlas->bindTile(range.tile, range.clut);
+            #endif
+
+                mesh->render(range);
+            }
+        } else if (dyn.count) {
         #ifdef SPLIT_BY_TILE
             uint16 tile = 0xFFFF, clut = 0xFFFF;
         #endif
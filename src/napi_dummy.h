@@ -10,6 +10,7 @@ namespace NAPI {
     void deinit() {}
     void listen(uint16 port) {}
     int  send(const Peer &to, const void *data, int size) { return 0; }
+    void flush() {}
     int  recv(Peer &from, void *data, int size) { return 0; }
     void broadcast(const void *data, int size) {}
 }
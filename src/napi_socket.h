@@ -5,8 +5,48 @@
 
 #ifdef _OS_WIN
     #include "winsock.h"
+
+    typedef int socklen_t;
+#else
+    #include <sys/socket.h>
+    #include <sys/ioctl.h>
+    #include <netinet/in.h>
+    #include <arpa/inet.h>
+    #include <netdb.h>
+    #include <unistd.h>
+    #include <errno.h>
+
+    typedef int SOCKET;
+
+    #define INVALID_SOCKET  (-1)
+    #define closesocket     close
+    #define ioctlsocket     ioctl
+#endif
+
+#if defined(OS_PTHREAD_MT) && defined(_OS_LINUX)
+    #define NAPI_IO_THREAD
 #endif
 
+#ifdef NAPI_IO_THREAD
+    #include <poll.h>
+    #include <pthread.h>
+
+    #define NAPI_LOAD(x)        __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+    #define NAPI_STORE(x, v)    __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+    #define NAPI_ADD(x, v)      __atomic_fetch_add(&(x), (v), __ATOMIC_RELAXED)
+    #define NAPI_TAKE(x)        __atomic_exchange_n(&(x), 0, __ATOMIC_RELAXED)
+#else
+    #define NAPI_LOAD(x)        (x)
+    #define NAPI_STORE(x, v)    (x) = (v)
+    #define NAPI_ADD(x, v)      (x) += (v)
+    #define NAPI_TAKE(x)        NAPI::takeValue(x)
+#endif
+
+#define NAPI_MTU            1400    // max size of coalesced outgoing datagram
+#define NAPI_MAX_DATAGRAM   1500
+#define NAPI_QUEUE_SIZE     256     // power of two
+#define NAPI_BATCH          32      // datagrams per recvmmsg/sendmmsg call
+
 namespace NAPI {
 
     static struct {
@@ -49,6 +89,69 @@ namespace NAPI {
         }
     };
 
+    struct Datagram {
+        Peer   peer;
+        int32  size;
+        uint8  data[NAPI_MAX_DATAGRAM];
+
+    // datagram is a sequence of [uint16 size][message] records
+        bool append(const void *msg, int msgSize) {
+            if (size + 2 + msgSize > NAPI_MTU)
+                return false;
+            uint16 len = msgSize;
+            memcpy(data + size, &len, 2);
+            memcpy(data + size + 2, msg, msgSize);
+            size += 2 + msgSize;
+            return true;
+        }
+    };
+
+// single producer / single consumer ring of datagrams
+    struct Queue {
+        Datagram items[NAPI_QUEUE_SIZE];
+        uint32   head;  // written by consumer
+        uint32   tail;  // written by producer
+
+        void reset() {
+            head = tail = 0;
+        }
+
+        Datagram& operator [] (uint32 index) {
+            return items[index & (NAPI_QUEUE_SIZE - 1)];
+        }
+    };
+
+    struct Stats {
+        uint32 packetsSent;  // datagrams
+        uint32 packetsRecv;
+        uint32 messagesSent;
+        uint32 messagesRecv;
+        uint32 bytesSent;
+        uint32 bytesRecv;
+        uint32 dropsSent;    // send queue overflow or socket error
+        uint32 dropsRecv;    // recv queue overflow or malformed datagram
+    } stats; // updated by both the game and I/O threads, use takeStats to read
+
+#ifndef NAPI_IO_THREAD
+    uint32 takeValue(uint32 &x) {
+        uint32 v = x;
+        x = 0;
+        return v;
+    }
+#endif
+
+// read and reset the counters
+    void takeStats(Stats &s) {
+        s.packetsSent  = NAPI_TAKE(stats.packetsSent);
+        s.packetsRecv  = NAPI_TAKE(stats.packetsRecv);
+        s.messagesSent = NAPI_TAKE(stats.messagesSent);
+        s.messagesRecv = NAPI_TAKE(stats.messagesRecv);
+        s.bytesSent    = NAPI_TAKE(stats.bytesSent);
+        s.bytesRecv    = NAPI_TAKE(stats.bytesRecv);
+        s.dropsSent    = NAPI_TAKE(stats.dropsSent);
+        s.dropsRecv    = NAPI_TAKE(stats.dropsRecv);
+    }
+
     SOCKET       sock;
     sockaddr_in  addr;
     uint16       port;
@@ -56,27 +159,209 @@ namespace NAPI {
     Peer         peer;
     bool         waitAddress;
 
+    Queue        sendQueue;
+    Queue        recvQueue;
+    uint32       sendReserved;  // [sendQueue.tail, sendReserved) are datagrams being filled for the current tick
+    Datagram     *recvCurrent;  // datagram being split into messages
+    int32        recvOffset;
+
+#ifdef NAPI_IO_THREAD
+    pthread_t    ioThread;
+    int          ioWake[2];     // pipe to wake up the thread when outgoing datagrams are queued
+    bool         ioRunning;
+#endif
+
+    void setAddr(sockaddr_in &a, const Peer &p) {
+        memset(&a, 0, sizeof(a));
+        a.sin_family      = AF_INET;
+        a.sin_addr.s_addr = p.ip;
+        a.sin_port        = p.port;
+    }
+
+    void sendDatagram(const Datagram &d) {
+        sockaddr_in a;
+        setAddr(a, d.peer);
+        if (sendto(sock, (const char*)d.data, d.size, 0, (sockaddr*)&a, sizeof(a)) == d.size) {
+            NAPI_ADD(stats.packetsSent, 1);
+            NAPI_ADD(stats.bytesSent, d.size);
+        } else {
+            NAPI_ADD(stats.dropsSent, 1);
+        }
+    }
+
+#ifdef NAPI_IO_THREAD
+    void ioSend() {
+        mmsghdr     msgs[NAPI_BATCH];
+        iovec       iov[NAPI_BATCH];
+        sockaddr_in addrs[NAPI_BATCH];
+
+        uint32 head = sendQueue.head;
+        uint32 tail = NAPI_LOAD(sendQueue.tail);
+
+        while (head != tail) {
+            int count = min(int(tail - head), NAPI_BATCH);
+
+            for (int i = 0; i < count; i++) {
+                Datagram &d = sendQueue[head + i];
+                setAddr(addrs[i], d.peer);
+                iov[i].iov_base = d.data;
+                iov[i].iov_len  = d.size;
+                memset(&msgs[i], 0, sizeof(msgs[i]));
+                msgs[i].msg_hdr.msg_name    = &addrs[i];
+                msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+                msgs[i].msg_hdr.msg_iov     = &iov[i];
+                msgs[i].msg_hdr.msg_iovlen  = 1;
+            }
+
+            int sent = sendmmsg(sock, msgs, count, MSG_DONTWAIT);
+            if (sent <= 0) {
+                if (errno == EAGAIN || errno == EWOULDBLOCK)
+                    break; // socket buffer is full, retry on next wakeup
+                NAPI_ADD(stats.dropsSent, 1);
+                sent = 1;  // skip the failed datagram
+            } else {
+                for (int i = 0; i < sent; i++) {
+                    NAPI_ADD(stats.bytesSent, sendQueue[head + i].size);
+                }
+                NAPI_ADD(stats.packetsSent, sent);
+            }
+
+            head += sent;
+            NAPI_STORE(sendQueue.head, head);
+        }
+    }
+
+    void ioRecv() {
+        mmsghdr     msgs[NAPI_BATCH];
+        iovec       iov[NAPI_BATCH];
+        sockaddr_in addrs[NAPI_BATCH];
+
+        while (1) {
+            uint32 head = NAPI_LOAD(recvQueue.head);
+            uint32 tail = recvQueue.tail;
+            int count = min(int(NAPI_QUEUE_SIZE - (tail - head)), NAPI_BATCH);
+
+            if (!count) { // game thread doesn't keep up, drop incoming datagrams
+                uint8 data[NAPI_MAX_DATAGRAM]; // queue slots may still be parsed by the game thread
+                while (::recv(sock, (char*)data, sizeof(data), MSG_DONTWAIT) > 0)
+                    NAPI_ADD(stats.dropsRecv, 1);
+                return;
+            }
+
+            for (int i = 0; i < count; i++) {
+                Datagram &d = recvQueue[tail + i];
+                iov[i].iov_base = d.data;
+                iov[i].iov_len  = sizeof(d.data);
+                memset(&msgs[i], 0, sizeof(msgs[i]));
+                msgs[i].msg_hdr.msg_name    = &addrs[i];
+                msgs[i].msg_hdr.msg_namelen = sizeof(addrs[i]);
+                msgs[i].msg_hdr.msg_iov     = &iov[i];
+                msgs[i].msg_hdr.msg_iovlen  = 1;
+            }
+
+            int recvd = recvmmsg(sock, msgs, count, MSG_DONTWAIT, NULL);
+            if (recvd <= 0)
+                return;
+
+            for (int i = 0; i < recvd; i++) {
+                Datagram &d = recvQueue[tail + i];
+                d.peer.ip   = addrs[i].sin_addr.s_addr;
+                d.peer.port = addrs[i].sin_port;
+                d.size      = msgs[i].msg_len;
+                NAPI_ADD(stats.bytesRecv, d.size);
+            }
+            NAPI_ADD(stats.packetsRecv, recvd);
+
+            NAPI_STORE(recvQueue.tail, tail + recvd);
+
+            if (recvd < count)
+                return;
+        }
+    }
+
+    void* ioProc(void *arg) {
+        pollfd fds[2];
+        fds[0].fd     = sock;
+        fds[0].events = POLLIN;
+        fds[1].fd     = ioWake[0];
+        fds[1].events = POLLIN;
+
+        while (ioRunning) {
+            if (poll(fds, 2, 100) < 0)
+                continue;
+
+            if (fds[1].revents & POLLIN) {
+                char buf[64];
+                while (read(ioWake[0], buf, sizeof(buf)) > 0);
+            }
+
+            ioSend();
+            ioRecv();
+        }
+        return NULL;
+    }
+
+    void ioStart() {
+        ioRunning = false;
+
+        if (pipe(ioWake) < 0) {
+            LOG("! network: failed to create wake pipe\n");
+            return;
+        }
+        u_long on = 1;
+        ioctl(ioWake[0], FIONBIO, &on);
+
+        ioRunning = true;
+        if (pthread_create(&ioThread, NULL, ioProc, NULL) != 0) {
+            LOG("! network: failed to start IO thread\n");
+            ioRunning = false;
+            close(ioWake[0]);
+            close(ioWake[1]);
+        }
+    }
+
+    void ioStop() {
+        if (!ioRunning) return;
+        ioRunning = false;
+        char c = 0;
+        write(ioWake[1], &c, 1);
+        pthread_join(ioThread, NULL);
+        close(ioWake[0]);
+        close(ioWake[1]);
+    }
+#endif
+
     void init() {
         sock = INVALID_SOCKET;
-
+        memset(&stats, 0, sizeof(stats));
+        sendQueue.reset();
+        recvQueue.reset();
+        sendReserved = 0;
+        recvCurrent  = NULL;
+    #ifdef NAPI_IO_THREAD
+        ioRunning = false;
+    #endif
+    #ifdef _OS_WIN
         WSAData wData;
         WSAStartup(0x0101, &wData);
+    #endif
     }
 
     void deinit() {
         if (sock != INVALID_SOCKET) {
+        #ifdef NAPI_IO_THREAD
+            ioStop();
+        #endif
             shutdown(sock, 1);
-        #ifdef _OS_WIN
             closesocket(sock);
-        #else
-            close(sock);
-        #endif
         }
+    #ifdef _OS_WIN
         WSACleanup();
+    #endif
     }
 
     void handleAddress(const uint8 *data, int size) {
-        if (size < sizeof(stun_header))
+        if (size < int(sizeof(stun_header)))
             return;
         stun_header *hdr = (stun_header*)data;
         data += sizeof(stun_header);
@@ -86,7 +371,7 @@ namespace NAPI {
             size = i;
         
         while (size) {
-            if (size < sizeof(stun_attr))
+            if (size < int(sizeof(stun_attr)))
                 return;
 
             stun_attr *attr = (stun_attr*)data;
@@ -108,32 +393,134 @@ namespace NAPI {
         }
     }
 
+// messages to the same peer are coalesced into one datagram until flush
     int send(const Peer &to, const void *data, int size) {
         if (sock == INVALID_SOCKET) return false;
+    #ifdef _DEBUG
         LOG("network: -> %s:%d (%d)\n", inet_ntoa(*(in_addr*)&to.ip), ntohs(to.port), size);
+    #endif
 
-        addr.sin_addr.s_addr = to.ip;
-        addr.sin_port        = to.port;
-        return sendto(sock, (const char*)data, size, 0, (sockaddr*)&addr, sizeof(addr));
+        for (uint32 i = sendQueue.tail; i != sendReserved; i++) {
+            Datagram &d = sendQueue[i];
+            if (d.peer == to && d.append(data, size)) {
+                NAPI_ADD(stats.messagesSent, 1);
+                return size;
+            }
+        }
+
+        if (sendReserved - NAPI_LOAD(sendQueue.head) >= NAPI_QUEUE_SIZE) {
+            NAPI_ADD(stats.dropsSent, 1);
+            return 0;
+        }
+
+        Datagram &d = sendQueue[sendReserved];
+        d.peer = to;
+        d.size = 0;
+        if (!d.append(data, size)) {
+            ASSERT(false);
+            NAPI_ADD(stats.dropsSent, 1);
+            return 0;
+        }
+        sendReserved++;
+        NAPI_ADD(stats.messagesSent, 1);
+        return size;
     }
 
-    int recv(Peer &from, void *data, int size) {
-        if (sock == INVALID_SOCKET) return false;
+// send datagrams queued during the tick
+    void flush() {
+        if (sock == INVALID_SOCKET) return;
 
-        int i = sizeof(addr);
-        int count = recvfrom(sock, (char*)data, size, 0, (sockaddr*)&addr,  &i);
-        if (count > 0) {
-            from.ip   = addr.sin_addr.s_addr;
-            from.port = addr.sin_port;
-            LOG("network: <- %s:%d (%d)\n", inet_ntoa(*(in_addr*)&from.ip), ntohs(from.port), size);
+        NAPI_STORE(sendQueue.tail, sendReserved);
+
+    #ifdef NAPI_IO_THREAD
+        if (ioRunning) {
+            char c = 0;
+            write(ioWake[1], &c, 1);
+            return;
         }
+    #endif
 
-        if (waitAddress) {
-            handleAddress((uint8*)data, size);
-            return 0;
+        while (sendQueue.head != sendQueue.tail) {
+            sendDatagram(sendQueue[sendQueue.head]);
+            NAPI_STORE(sendQueue.head, sendQueue.head + 1);
         }
+    }
+
+    bool nextDatagram() {
+    #ifdef NAPI_IO_THREAD
+        if (ioRunning) {
+            if (recvQueue.head == NAPI_LOAD(recvQueue.tail))
+                return false;
+            recvCurrent = &recvQueue[recvQueue.head];
+            return true;
+        }
+    #endif
+        Datagram &d = recvQueue[0];
+        socklen_t i = sizeof(addr);
+        int count = recvfrom(sock, (char*)d.data, sizeof(d.data), 0, (sockaddr*)&addr, &i);
+        if (count <= 0)
+            return false;
+        d.peer.ip   = addr.sin_addr.s_addr;
+        d.peer.port = addr.sin_port;
+        d.size      = count;
+        NAPI_ADD(stats.packetsRecv, 1);
+        NAPI_ADD(stats.bytesRecv, count);
+        recvCurrent = &d;
+        return true;
+    }
+
+    void freeDatagram() {
+    #ifdef NAPI_IO_THREAD
+        if (ioRunning) {
+            NAPI_STORE(recvQueue.head, recvQueue.head + 1);
+        }
+    #endif
+        recvCurrent = NULL;
+    }
+
+    int recv(Peer &from, void *data, int size) {
+        if (sock == INVALID_SOCKET) return false;
 
-        return count;
+        while (1) {
+            if (!recvCurrent) {
+                if (!nextDatagram())
+                    return 0;
+                recvOffset = 0;
+
+                if (waitAddress) {
+                    handleAddress(recvCurrent->data, recvCurrent->size);
+                    freeDatagram();
+                    return 0;
+                }
+            }
+
+            Datagram &d = *recvCurrent;
+
+            if (recvOffset + 2 > d.size) {
+                freeDatagram();
+                continue;
+            }
+
+            uint16 len;
+            memcpy(&len, d.data + recvOffset, 2);
+            recvOffset += 2;
+
+            if (recvOffset + len > d.size || len > size) {
+                NAPI_ADD(stats.dropsRecv, 1);
+                freeDatagram();
+                continue;
+            }
+
+            memcpy(data, d.data + recvOffset, len);
+            recvOffset += len;
+            from = d.peer;
+            NAPI_ADD(stats.messagesRecv, 1);
+
+        #ifdef _DEBUG
+            LOG("network: <- %s:%d (%d)\n", inet_ntoa(*(in_addr*)&from.ip), ntohs(from.port), len);
+        #endif
+            return len;
+        }
     }
 
     void broadcast(const void *data, int size) {
@@ -162,7 +549,13 @@ namespace NAPI {
         Peer peer;
         peer.ip   = *(uint32*)hostinfo->h_addr;
         peer.port = htons(stunServers[stunIndex].port);
-        send(peer, &req, sizeof(req));
+
+    // STUN is not framed, send it directly
+        Datagram d;
+        d.peer = peer;
+        d.size = sizeof(req);
+        memcpy(d.data, &req, sizeof(req));
+        sendDatagram(d);
 
         waitAddress = true;
     }
@@ -203,7 +596,14 @@ namespace NAPI {
         if (setsockopt(sock, SOL_SOCKET, SO_BROADCAST, (const char*)&on, sizeof(on)))
             LOG("! network: unable to enable broadcasting\n");
 
+    #ifdef NAPI_IO_THREAD
+        ioStart();
+    #endif
+
+    // dedicated server is addressed directly, don't wait for a STUN response
+    #ifndef _OS_SERVER
         requestAddress();
+    #endif
     }
 }
 
@@ -7,19 +7,25 @@
 #include "controller.h"
 #include "ui.h"
 
-#define NET_PROTOCOL            1
+#define NET_PROTOCOL            2
 #define NET_PORT                21468
 
 #define NET_PING_TIMEOUT        ( 1000 * 10   )
 #define NET_PING_PERIOD         ( 1000 * 3    )
 #define NET_SYMC_INPUT_PERIOD   ( 1000 / 25   )
-#define NET_SYMC_STATE_PERIOD   ( 1000 / 1000 )
+#define NET_SYMC_STATE_PERIOD   ( 1000 / 20   )
+
+#define NET_MTU                 1200
+#define NET_SNAPSHOT_SIZE       (NET_MTU - 4 - 8)
+#define NET_SNAPSHOT_PARTS      8
+#define NET_SNAPSHOT_HISTORY    16              // snapshots kept to decode deltas (power of two)
+#define NET_NO_SNAPSHOT         0xFFFF
 
 namespace Network {
 
     struct Packet {
         enum Type {
-            HELLO, INFO, PING, PONG, JOIN, ACCEPT, REJECT, INPUT, STATE,
+            HELLO, INFO, PING, PONG, JOIN, ACCEPT, REJECT, INPUT, STATE, SNAPSHOT, ACK,
         };
 
         uint16 type;
@@ -72,6 +78,19 @@ namespace Network {
                 uint8  stand;
                 uint16 animIndex;
             } state;
+
+            struct {
+                uint16 seq;
+                uint16 base;    // baseline snapshot or NET_NO_SNAPSHOT
+                uint8  part;
+                uint8  parts;
+                uint16 size;
+                uint8  data[NET_SNAPSHOT_SIZE];
+            } snapshot;
+
+            struct {
+                uint16 seq;
+            } ack;
         };
 
         int getSize() const {
@@ -85,8 +104,13 @@ namespace Network {
                 sizeof(reject),
                 sizeof(input),
                 sizeof(state),
+                sizeof(snapshot),
+                sizeof(ack),
             };
 
+            if (type == SNAPSHOT)
+                return 2 + 2 + (sizeof(snapshot) - sizeof(snapshot.data)) + min(int(snapshot.size), NET_SNAPSHOT_SIZE);
+
             if (type >= 0 && type < COUNT(sizes))
                 return 2 + 2 + sizes[type];
             ASSERT(false);
@@ -96,11 +120,126 @@ namespace Network {
 
     IGame *game;
 
+// quantized state of a level entity (absolute values, base entities only)
+    struct NetEntity {
+        int32  x, y, z;
+        uint16 rotation;
+        uint16 flags;
+        uint16 animIndex;
+        uint16 animFrame;
+        int16  timer;
+        int16  health;
+        uint16 room;
+        uint16 present;
+    };
+
+// ring of the last snapshots states, used as baselines for delta compression
+    struct SnapshotHistory {
+        uint16    seq[NET_SNAPSHOT_HISTORY];
+        uint32    parts[NET_SNAPSHOT_HISTORY]; // received parts mask (client side)
+        NetEntity *states;
+        int       count;
+
+        void init(int count) {
+            this->count = count;
+            states = new NetEntity[count * NET_SNAPSHOT_HISTORY];
+            memset(states, 0, sizeof(NetEntity) * count * NET_SNAPSHOT_HISTORY);
+            memset(seq, 0xFF, sizeof(seq));
+            memset(parts, 0, sizeof(parts));
+        }
+
+        void free() {
+            delete[] states;
+            states = NULL;
+        }
+
+        NetEntity* get(uint16 index) {
+            if (index == NET_NO_SNAPSHOT || seq[index % NET_SNAPSHOT_HISTORY] != index)
+                return NULL;
+            return states + (index % NET_SNAPSHOT_HISTORY) * count;
+        }
+
+        NetEntity* reset(uint16 index, uint16 base) {
+            int slot = index % NET_SNAPSHOT_HISTORY;
+            NetEntity *dst = states + slot * count;
+            NetEntity *src = get(base);
+            if (src)
+                memcpy(dst, src, sizeof(NetEntity) * count);
+            else
+                memset(dst, 0, sizeof(NetEntity) * count);
+            seq[slot]   = index;
+            parts[slot] = 0;
+            return dst;
+        }
+    };
+
+// bit-packed snapshot stream
+    struct BitPacker {
+        uint8 *data;
+        int   size;
+        int   pos;
+
+        BitPacker(uint8 *data, int size) : data(data), size(size * 8), pos(0) {}
+
+        bool write(uint32 value, int bits) {
+            if (pos + bits > size) {
+                pos = size + 1; // overflow
+                return false;
+            }
+            for (int i = 0; i < bits; i++, pos++) {
+                uint8 &b = data[pos >> 3];
+                b = (b & ~(1 << (pos & 7))) | (((value >> i) & 1) << (pos & 7));
+            }
+            return true;
+        }
+
+        uint32 read(int bits) {
+            uint32 value = 0;
+            for (int i = 0; i < bits && pos < size; i++, pos++) {
+                value |= ((data[pos >> 3] >> (pos & 7)) & 1) << i;
+            }
+            return value;
+        }
+
+    // 5-bit length prefix + value
+        void writeVar(uint32 value) {
+            int bits = 0;
+            while (bits < 31 && (value >> bits)) bits++;
+            write(bits, 5);
+            write(value, bits);
+        }
+
+        uint32 readVar() {
+            return read(read(5));
+        }
+
+        void writeSigned(int32 value) {
+            writeVar(uint32((value << 1) ^ (value >> 31))); // zigzag
+        }
+
+        int32 readSigned() {
+            uint32 value = readVar();
+            return int32(value >> 1) ^ -int32(value & 1);
+        }
+
+        bool overflow() const {
+            return pos > size;
+        }
+
+        int getBytes() const {
+            return (pos + 7) >> 3;
+        }
+    };
+
     struct Player {
         NAPI::Peer peer;
         int        pingTime;
         int        pingIndex;
         Controller *controller;
+        uint16     ackSeq;
+        int32      bytesSent;
+        int32      bytesRecv;
+        SnapshotHistory history;
     };
 
     Array<Player> players;
@@ -108,14 +247,43 @@ namespace Network {
     int syncInputTime;
     int syncStateTime;
 
+    uint16          snapshotSeq;
+    NetEntity       *snapshotState;  // current state of entities (server side)
+    SnapshotHistory clientHistory;   // received snapshots (client side)
+    NAPI::Peer      server;
+    bool            hasServer;
+    int             serverPingTime;  // last packet from the server
+
+    void freePlayer(Player &player) {
+        player.history.free();
+    }
+
+    void resetServer() {
+        memset(&server, 0, sizeof(server));
+        hasServer = false;
+    }
+
     void start(IGame *game) {
         Network::game = game;
         NAPI::listen(NET_PORT);
         syncInputTime = syncStateTime = Core::getTime();
+        resetServer();
+
+        int count = game->getLevel()->entitiesBaseCount;
+        snapshotSeq   = 0;
+        snapshotState = new NetEntity[count];
+        clientHistory.init(count);
     }
 
     void stop() {
+        for (int i = 0; i < players.length; i++)
+            freePlayer(players[i]);
         players.clear();
+
+        delete[] snapshotState;
+        snapshotState = NULL;
+        clientHistory.free();
+        resetServer();
     }
 
     bool sendPacket(const NAPI::Peer &to, const Packet &packet) {
@@ -158,6 +326,7 @@ namespace Network {
             int delta = time - players[i].pingTime;
 
             if (delta > NET_PING_TIMEOUT) {
+                freePlayer(players[i]);
                 players.removeFast(i);
                 continue;
             }
@@ -172,6 +341,13 @@ namespace Network {
         }
     }
 
+    void pingServer(int time) {
+        if (hasServer && time - serverPingTime > NET_PING_TIMEOUT) {
+            LOG("server connection lost\n");
+            resetServer();
+        }
+    }
+
     void syncInput(int time) {
         Lara *lara = (Lara*)game->getLara();
         if (!lara) return;
@@ -189,12 +365,299 @@ namespace Network {
         syncInputTime = time;
     }
 
+    void getNetEntity(Controller *controller, NetEntity &state) {
+        SaveEntity data;
+        memset(&state, 0, sizeof(state));
+        if (!controller->getSaveData(data))
+            return;
+
+        const TR::Entity &e = controller->getEntity();
+    // base entities are saved as xor with initial state
+        state.x         = e.x ^ data.x;
+        state.y         = e.y ^ data.y;
+        state.z         = e.z ^ data.z;
+        state.rotation  = e.rotation.value ^ data.rotation;
+        state.room      = e.room ^ data.room;
+        state.flags     = e.flags.value ^ data.flags;
+        state.animIndex = data.animIndex;
+        state.animFrame = data.animFrame;
+        state.timer     = data.timer;
+        state.health    = (data.extraSize == sizeof(data.extra.enemy)) ? int16(data.extra.enemy.health) : 0;
+        state.present   = 1;
+    }
+
+    void setNetEntity(Controller *controller, const NetEntity &state) {
+        SaveEntity data;
+        if (!controller->getSaveData(data)) // keep the extra data we don't replicate
+            return;
+
+        const TR::Entity &e = controller->getEntity();
+        data.x         = e.x ^ state.x;
+        data.y         = e.y ^ state.y;
+        data.z         = e.z ^ state.z;
+        data.rotation  = e.rotation.value ^ state.rotation;
+        data.room      = e.room ^ state.room;
+        data.flags     = e.flags.value ^ state.flags;
+        data.animIndex = state.animIndex;
+        data.animFrame = state.animFrame;
+        data.timer     = state.timer;
+        if (data.extraSize == sizeof(data.extra.enemy))
+            data.extra.enemy.health = float(state.health);
+
+        bool linked = controller->flags.state != TR::Entity::asNone;
+
+        controller->setSaveData(data);
+
+        if (controller->flags.state != TR::Entity::asNone) {
+            if (!linked) {
+                controller->next = Controller::first;
+                Controller::first = controller;
+            }
+        } else if (linked) {
+            controller->flags.state = TR::Entity::asInactive; // will be removed from the list by clearInactive
+        }
+    }
+
+    bool isReplicated(int index) {
+        TR::Entity &e = game->getLevel()->entities[index];
+        return e.controller && !e.isLara();
+    }
+
+    bool isInterestRoom(const uint8 *rooms, int roomIndex) {
+        return (rooms[roomIndex >> 3] >> (roomIndex & 7)) & 1;
+    }
+
+// player room and its neighbours through portals
+    void getInterestRooms(Controller *controller, uint8 *rooms) {
+        TR::Level *level = game->getLevel();
+        memset(rooms, 0, (level->roomsCount + 7) / 8);
+
+        TR::Room &room = level->rooms[controller->getRoomIndex()];
+        rooms[controller->getRoomIndex() >> 3] |= 1 << (controller->getRoomIndex() & 7);
+        for (int i = 0; i < room.portalsCount; i++) {
+            int index = room.portals[i].roomIndex;
+            rooms[index >> 3] |= 1 << (index & 7);
+        }
+    }
+
+    enum {
+        NET_FIELD_POS       = 1 << 0,
+        NET_FIELD_ROTATION  = 1 << 1,
+        NET_FIELD_FLAGS     = 1 << 2,
+        NET_FIELD_ANIM      = 1 << 3,
+        NET_FIELD_TIMER     = 1 << 4,
+        NET_FIELD_HEALTH    = 1 << 5,
+        NET_FIELD_ROOM      = 1 << 6,
+        NET_FIELD_COUNT     = 7,
+    };
+
+    void writeEntity(BitPacker &bits, int indexDelta, const NetEntity &state, const NetEntity &base) {
+        bits.writeVar(indexDelta);
+        bits.write(state.present, 1);
+        if (!state.present) return;
+
+        uint32 mask = 0;
+        if (state.x != base.x || state.y != base.y || state.z != base.z)     mask |= NET_FIELD_POS;
+        if (state.rotation  != base.rotation)                                 mask |= NET_FIELD_ROTATION;
+        if (state.flags     != base.flags)                                    mask |= NET_FIELD_FLAGS;
+        if (state.animIndex != base.animIndex || state.animFrame != base.animFrame) mask |= NET_FIELD_ANIM;
+        if (state.timer     != base.timer)                                    mask |= NET_FIELD_TIMER;
+        if (state.health    != base.health)                                   mask |= NET_FIELD_HEALTH;
+        if (state.room      != base.room)                                     mask |= NET_FIELD_ROOM;
+
+        bits.write(mask, NET_FIELD_COUNT);
+
+        if (mask & NET_FIELD_POS) {
+            bits.writeSigned(state.x - base.x);
+            bits.writeSigned(state.y - base.y);
+            bits.writeSigned(state.z - base.z);
+        }
+        if (mask & NET_FIELD_ROTATION) bits.write(state.rotation >> 4, 12); // 0.09 degree precision
+        if (mask & NET_FIELD_FLAGS)    bits.write(state.flags, 16);
+        if (mask & NET_FIELD_ANIM) {
+            bits.writeVar(state.animIndex);
+            bits.writeVar(state.animFrame);
+        }
+        if (mask & NET_FIELD_TIMER)    bits.writeSigned(state.timer);
+        if (mask & NET_FIELD_HEALTH)   bits.writeSigned(state.health);
+        if (mask & NET_FIELD_ROOM)     bits.writeVar(state.room);
+    }
+
+    void readEntity(BitPacker &bits, NetEntity &state) {
+        state.present = bits.read(1);
+        if (!state.present) return;
+
+        uint32 mask = bits.read(NET_FIELD_COUNT);
+
+        if (mask & NET_FIELD_POS) {
+            state.x += bits.readSigned();
+            state.y += bits.readSigned();
+            state.z += bits.readSigned();
+        }
+        if (mask & NET_FIELD_ROTATION) state.rotation = bits.read(12) << 4;
+        if (mask & NET_FIELD_FLAGS)    state.flags    = bits.read(16);
+        if (mask & NET_FIELD_ANIM) {
+            state.animIndex = bits.readVar();
+            state.animFrame = bits.readVar();
+        }
+        if (mask & NET_FIELD_TIMER)    state.timer    = bits.readSigned();
+        if (mask & NET_FIELD_HEALTH)   state.health   = bits.readSigned();
+        if (mask & NET_FIELD_ROOM)     state.room     = bits.readVar();
+    }
+
+    bool isStateEqual(const NetEntity &a, const NetEntity &b) {
+        if (a.present != b.present) return false;
+        if (!a.present) return true;
+        return a.x == b.x && a.y == b.y && a.z == b.z && (a.rotation >> 4) == (b.rotation >> 4) && a.flags == b.flags &&
+               a.animIndex == b.animIndex && a.animFrame == b.animFrame && a.timer == b.timer && a.health == b.health && a.room == b.room;
+    }
+
+    void sendSnapshot(Player &player, const uint8 *rooms) {
+        int count = game->getLevel()->entitiesBaseCount;
+
+        uint16 seq = snapshotSeq;
+    // use the last acknowledged snapshot as a baseline if we still have it
+        uint16 base = player.ackSeq;
+        if (base != NET_NO_SNAPSHOT && uint16(seq - base) >= NET_SNAPSHOT_HISTORY)
+            base = NET_NO_SNAPSHOT;
+
+        NetEntity  zero;
+        memset(&zero, 0, sizeof(zero));
+
+        NetEntity *baseStates = player.history.get(base);
+        if (!baseStates)
+            base = NET_NO_SNAPSHOT;
+
+        NetEntity *states = player.history.reset(seq, base);
+
+        Packet packets[NET_SNAPSHOT_PARTS];
+        int parts = 0;
+        int prev  = -1;
+        BitPacker bits(packets[0].snapshot.data, NET_SNAPSHOT_SIZE);
+
+        for (int i = 0; i < count; i++) {
+            NetEntity state;
+            if (isReplicated(i) && isInterestRoom(rooms, snapshotState[i].room) && snapshotState[i].present)
+                state = snapshotState[i];
+            else
+                memset(&state, 0, sizeof(state));
+
+            const NetEntity &prevState = baseStates ? baseStates[i] : zero;
+            if (isStateEqual(state, prevState))
+                continue;
+
+        // try to write the entity into the current datagram
+            BitPacker saved = bits;
+            writeEntity(bits, i - prev, state, prevState);
+
+            if (bits.overflow()) {
+                bits = saved;
+                bits.writeVar(0); // end of part
+                packets[parts].snapshot.size = bits.getBytes();
+
+                if (++parts == NET_SNAPSHOT_PARTS) // out of budget, other entities will be sent next time
+                    break;
+
+                prev = -1;
+                bits = BitPacker(packets[parts].snapshot.data, NET_SNAPSHOT_SIZE);
+                writeEntity(bits, i - prev, state, prevState);
+            }
+
+            prev = i;
+            states[i] = state;
+        }
+
+        if (parts < NET_SNAPSHOT_PARTS) {
+            bits.writeVar(0); // end of part
+            packets[parts].snapshot.size = bits.getBytes();
+            parts++;
+        }
+
+        for (int i = 0; i < parts; i++) {
+            Packet &packet = packets[i];
+            packet.type           = Packet::SNAPSHOT;
+            packet.snapshot.seq   = seq;
+            packet.snapshot.base  = base;
+            packet.snapshot.part  = i;
+            packet.snapshot.parts = parts;
+            sendPacket(player.peer, packet);
+            player.bytesSent += packet.getSize();
+        }
+    }
+
+    void recvSnapshot(const Packet &packet) {
+        NetEntity *states;
+        uint16 seq  = packet.snapshot.seq;
+        uint16 base = packet.snapshot.base;
+
+        if (!clientHistory.get(seq)) {
+            if (base != NET_NO_SNAPSHOT && !clientHistory.get(base))
+                return; // lost baseline, wait for the next one
+            states = clientHistory.reset(seq, base);
+        } else
+            states = clientHistory.get(seq);
+
+        uint32 &parts = clientHistory.parts[seq % NET_SNAPSHOT_HISTORY];
+        if (parts & (1 << packet.snapshot.part))
+            return;
+        parts |= 1 << packet.snapshot.part;
+
+        TR::Level *level = game->getLevel();
+        BitPacker bits((uint8*)packet.snapshot.data, packet.snapshot.size);
+
+        int index = -1;
+        while (!bits.overflow()) {
+            int delta = bits.readVar();
+            if (!delta) break;
+            index += delta;
+            if (index >= clientHistory.count) break;
+
+            NetEntity &state = states[index];
+            readEntity(bits, state);
+
+            Controller *controller = (Controller*)level->entities[index].controller;
+            if (state.present && controller && !level->entities[index].isLara())
+                setNetEntity(controller, state);
+        }
+
+        if (parts == (1U << packet.snapshot.parts) - 1) {
+            Packet response;
+            response.type    = Packet::ACK;
+            response.ack.seq = seq;
+            sendPacket(server, response);
+        }
+    }
+
     void syncState(int time) {
         if ((time - syncStateTime) < NET_SYMC_STATE_PERIOD)
             return;
-        // TODO    
         syncStateTime = time;
-    } 
+
+        if (!players.length || hasServer || !snapshotState)
+            return;
+
+    // snapshot state is shared by all clients, interest filtering is per client
+        int count = game->getLevel()->entitiesBaseCount;
+        for (int i = 0; i < count; i++) {
+            if (isReplicated(i))
+                getNetEntity((Controller*)game->getLevel()->entities[i].controller, snapshotState[i]);
+            else
+                snapshotState[i].present = 0;
+        }
+
+        uint8 rooms[1024 / 8];
+
+        for (int i = 0; i < players.length; i++) {
+            Player &player = players[i];
+            if (!player.controller) continue;
+            getInterestRooms(player.controller, rooms);
+            sendSnapshot(player, rooms);
+        }
+
+        snapshotSeq++; // wraps as uint16 to keep the sequence distances valid
+        if (snapshotSeq == NET_NO_SNAPSHOT)
+            snapshotSeq++;
+    }
 
     Player* getPlayerByPeer(const NAPI::Peer &peer) {
         for (int i = 0; i < players.length; i++)
@@ -220,8 +683,14 @@ namespace Network {
 
         while ( (count = recvPacket(from, packet)) > 0 ) {
             Player *player = getPlayerByPeer(from);
-            if (player)
-                player->pingTime = time;
+            if (player) {
+                player->pingTime   = time;
+                player->bytesRecv += packet.getSize();
+            }
+
+            if (hasServer && from == server) {
+                serverPingTime = time;
+            }
 
             switch (packet.type) {
                 case Packet::HELLO :
@@ -276,6 +745,10 @@ namespace Network {
                         newPlayer.pingIndex  = 0;
                         newPlayer.pingTime   = time;
                         newPlayer.controller = game->addEntity(TR::Entity::LARA, roomIndex, pos, angle);
+                        newPlayer.ackSeq     = NET_NO_SNAPSHOT;
+                        newPlayer.bytesSent  = 0;
+                        newPlayer.bytesRecv  = 0;
+                        newPlayer.history.init(game->getLevel()->entitiesBaseCount);
                         players.push(newPlayer);
 
                         ((Lara*)newPlayer.controller)->networkInput = 0;
@@ -304,6 +777,9 @@ namespace Network {
 
                 case Packet::ACCEPT : {
                     LOG("accept!\n");
+                    server         = from;
+                    hasServer      = true;
+                    serverPingTime = time;
                     game->loadLevel(TR::LevelID(packet.accept.level));
                     inventory->toggle();
                     break;
@@ -328,6 +804,10 @@ namespace Network {
                         newPlayer.pingIndex  = 0;
                         newPlayer.pingTime   = time;
                         newPlayer.controller = game->addEntity(TR::Entity::LARA, roomIndex, pos, angle);
+                        newPlayer.ackSeq     = NET_NO_SNAPSHOT;
+                        newPlayer.bytesSent  = 0;
+                        newPlayer.bytesRecv  = 0;
+                        newPlayer.history.init(game->getLevel()->entitiesBaseCount);
                         players.push(newPlayer);
 
                         ((Lara*)newPlayer.controller)->networkInput = 0;
@@ -342,12 +822,26 @@ namespace Network {
 
                 case Packet::STATE :
                     break;
+
+                case Packet::SNAPSHOT :
+                    if (hasServer && from == server && !game->getLevel()->isTitle())
+                        recvSnapshot(packet);
+                    break;
+
+                case Packet::ACK :
+                    if (player && uint16(snapshotSeq - packet.ack.seq) <= NET_SNAPSHOT_HISTORY)
+                        if (player->ackSeq == NET_NO_SNAPSHOT || uint16(packet.ack.seq - player->ackSeq) < NET_SNAPSHOT_HISTORY)
+                            player->ackSeq = packet.ack.seq;
+                    break;
             }
         }
 
         pingPlayers(time);
+        pingServer(time);
         syncInput(time);
         syncState(time);
+
+        NAPI::flush();
     }
 }
 
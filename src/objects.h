@@ -72,6 +72,8 @@ struct KeyItemInv : Controller {
 #define DART_DAMAGE 50
 
 struct Dart : Controller {
+    DECL_POOL(Dart, 8);
+
     vec3 velocity;
     vec3 dir;
     bool armed;
@@ -131,6 +133,7 @@ struct TrapDartEmitter : Controller {
 #define FLAME_BURN_DAMAGE 150
 
 struct Flame : Sprite {
+    DECL_POOL(Flame, 16);
 
     static Flame* add(IGame *game, Controller *owner, int jointIndex) {
         ASSERT(owner);
@@ -227,6 +230,8 @@ struct TrapFlameEmitter : Controller {
 #define FLASH_LIGHT_COLOR   vec4(0.6f, 0.5f, 0.1f, 1.0f / 3072.0f)
 
 struct MuzzleFlash : Controller {
+    DECL_POOL(MuzzleFlash, 8);
+
     Controller *owner;
     int        joint;
     int        lightIndex;
@@ -704,7 +709,8 @@ struct Door : Controller {
             sectors[1] = level->getSector(roomIndex[1], nx, nz, sectorIndex[1]);
         }
 
-        void set(TR::Level *level) {
+        bool set(TR::Level *level) {
+            bool changed = false;
             for (int i = 0; i < 2; i++)
                 if (roomIndex[i] != TR::NO_ROOM) {
                     TR::Room::Sector &s = level->rooms[roomIndex[i]].sectors[sectorIndex[i]];
@@ -718,22 +724,29 @@ struct Door : Controller {
                     if (sectors[i].boxIndex != TR::NO_BOX) {
                         ASSERT(sectors[i].boxIndex < level->boxesCount);
                         TR::Box &box = level->boxes[sectors[i].boxIndex];
-                        if (box.overlap.blockable)
+                        if (box.overlap.blockable && !box.overlap.block) {
                             box.overlap.block = true;
+                            changed = true;
+                        }
                     }
                 }
+            return changed;
         }
 
-        void reset(TR::Level *level) {
+        bool reset(TR::Level *level) {
+            bool changed = false;
             for (int i = 0; i < 2; i++)
                 if (roomIndex[i] != TR::NO_ROOM) {
                     level->rooms[roomIndex[i]].sectors[sectorIndex[i]] = sectors[i];
                     if (sectors[i].boxIndex != TR::NO_BOX) {
                         TR::Box &box = level->boxes[sectors[i].boxIndex];
-                        if (box.overlap.blockable)
+                        if (box.overlap.blockable && box.overlap.block) {
                             box.overlap.block = false;
+                            changed = true;
+                        }
                     }
                 }
+            return changed;
         }
 
     } block[2];
@@ -746,12 +759,17 @@ struct Door : Controller {
     }
 
     void updateBlock(bool open) {
+        bool changed;
         if (open) {
-            block[0].reset(level);
-            block[1].reset(level);
+            changed  = block[0].reset(level);
+            changed |= block[1].reset(level);
         } else {
-            block[0].set(level);
-            block[1].set(level);
+            changed  = block[0].set(level);
+            changed |= block[1].set(level);
+        }
+
+        if (changed) {
+            game->invalidatePaths();
         }
     }
     
@@ -1636,6 +1654,8 @@ struct Waterfall : Controller {
 };
 
 struct Bubble : Sprite {
+    DECL_POOL(Bubble, 16);
+
     float speed;
 
     Bubble(IGame *game, int entity) : Sprite(game, entity, true, Sprite::FRAME_RANDOM) {
@@ -1676,6 +1696,7 @@ struct Bubble : Sprite {
 
 
 struct Explosion : Sprite {
+    DECL_POOL(Explosion, 8);
 
     Explosion(IGame *game, int entity) : Sprite(game, entity, true, Sprite::FRAME_ANIMATED) {
         game->playSound(TR::SND_EXPLOSION, pos, Sound::PAN);
@@ -1760,6 +1781,8 @@ struct StoneItem : Controller {
 #define MUTANT_BULLET_DAMAGE  30.0f
 
 struct Bullet : Controller {
+    DECL_POOL(Bullet, 8);
+
     vec3 velocity;
 
     Bullet(IGame *game, int entity) : Controller(game, entity) {
@@ -19,61 +19,219 @@
 // timing
 unsigned int startTime;
 
+// offline rendering drives the game clock from the number of mixed frames instead of the wall clock
+bool offline;
+int  offlineTime;
+
 int osGetTimeMS() {
+    if (offline)
+        return offlineTime;
     timeval t;
     gettimeofday(&t, NULL);
     return int((t.tv_sec - startTime) * 1000 + t.tv_usec / 1000);
 }
 
+int64 getTimeUS() {
+    timeval t;
+    gettimeofday(&t, NULL);
+    return int64(t.tv_sec) * 1000000 + t.tv_usec;
+}
+
 // sound
-#define SND_FRAME_SIZE  4
-#define SND_DATA_SIZE   (2352 * SND_FRAME_SIZE)
+#define SND_FRAME_SIZE      4
+#define SND_FREQ            44100
+#define SND_PERIOD          2352    // default period in frames (~53 ms)
+#define SND_PERIOD_LOW      256     // default period of the low latency sink (~6 ms)
+#define SND_PERIOD_MIN      64
+#define SND_OFFLINE_STEP    16      // ms of game time per offline update
+
+// audio sink, consumes the frames produced by Sound::fill
+struct SoundSink {
+    int  period;    // frames per write
+    bool blocking;  // write waits for the device, otherwise the caller paces itself
+
+    SoundSink(int period, bool blocking) : period(period), blocking(blocking) {}
+    virtual ~SoundSink() {}
+    virtual bool open() { return true; }
+    virtual void write(const Sound::Frame *frames, int count) {}
+};
+
+struct SoundSinkPulse : SoundSink {
+    pa_simple *out;
+    bool      lowLatency;
+
+    SoundSinkPulse(int period, bool lowLatency) : SoundSink(period, true), out(NULL), lowLatency(lowLatency) {}
+
+    virtual ~SoundSinkPulse() {
+        if (out) {
+            pa_simple_drain(out, NULL);
+            pa_simple_free(out);
+        }
+    }
+
+    virtual bool open() {
+        pa_sample_spec spec;
+        spec.format   = PA_SAMPLE_S16LE;
+        spec.rate     = SND_FREQ;
+        spec.channels = 2;
+
+        uint32 size = period * SND_FRAME_SIZE;
+
+    // the low latency sink keeps only two periods in the server buffer
+        pa_buffer_attr attr;
+        attr.maxlength = size * 4;
+        attr.tlength   = lowLatency ? size * 2 : 0xFFFFFFFF;
+        attr.prebuf    = lowLatency ? size : 0xFFFFFFFF;
+        attr.minreq    = size;
+        attr.fragsize  = 0xFFFFFFFF;
+
+        int error;
+        if (!(out = pa_simple_new(NULL, WND_TITLE, PA_STREAM_PLAYBACK, NULL, "game", &spec, NULL, &attr, &error))) {
+            LOG("pa_simple_new() failed: %s\n", pa_strerror(error));
+            return false;
+        }
+        return true;
+    }
+
+    virtual void write(const Sound::Frame *frames, int count) {
+        pa_simple_write(out, frames, count * SND_FRAME_SIZE, NULL);
+    }
+};
+
+// 16-bit stereo PCM file, the sizes are patched on close
+struct SoundSinkWAV : SoundSink {
+    const char *fileName;
+    FILE       *f;
+    uint32     frames;
+
+    struct Header {
+        uint32 riff, riffSize, wave;
+        uint32 fmt, fmtSize;
+        uint16 format, channels;
+        uint32 rate, byteRate;
+        uint16 align, bits;
+        uint32 data, dataSize;
+    };
+
+    SoundSinkWAV(int period, const char *fileName) : SoundSink(period, false), fileName(fileName), f(NULL), frames(0) {}
+
+    virtual ~SoundSinkWAV() {
+        if (!f) return;
+        Header header = getHeader();
+        fseek(f, 0, SEEK_SET);
+        fwrite(&header, sizeof(header), 1, f);
+        fclose(f);
+        LOG("sound: %d frames written to %s\n", frames, fileName);
+    }
+
+    Header getHeader() {
+        Header h;
+        h.riff     = FOURCC("RIFF");
+        h.riffSize = sizeof(h) - 8 + frames * SND_FRAME_SIZE;
+        h.wave     = FOURCC("WAVE");
+        h.fmt      = FOURCC("fmt ");
+        h.fmtSize  = 16;
+        h.format   = 1;
+        h.channels = 2;
+        h.rate     = SND_FREQ;
+        h.byteRate = SND_FREQ * SND_FRAME_SIZE;
+        h.align    = SND_FRAME_SIZE;
+        h.bits     = 16;
+        h.data     = FOURCC("data");
+        h.dataSize = frames * SND_FRAME_SIZE;
+        return h;
+    }
 
-pa_simple *sndOut;
-pthread_t sndThread;
+    virtual bool open() {
+        if (!(f = fopen(fileName, "wb"))) {
+            LOG("! sound: can't create %s\n", fileName);
+            return false;
+        }
+        Header header = getHeader();
+        fwrite(&header, sizeof(header), 1, f);
+        return true;
+    }
+
+    virtual void write(const Sound::Frame *frames, int count) {
+        fwrite(frames, SND_FRAME_SIZE, count, f);
+        this->frames += count;
+    }
+};
 
+SoundSink    *sndSink;
 Sound::Frame *sndData;
+pthread_t    sndThread;
+bool         sndRunning;
 
 void* sndFill(void *arg) {
-    while (1) {
-        Sound::fill(sndData, SND_DATA_SIZE / SND_FRAME_SIZE);
-        pa_simple_write(sndOut, sndData, SND_DATA_SIZE, NULL);
+    int64 next = getTimeUS();
+    int64 periodUS = int64(sndSink->period) * 1000000 / SND_FREQ;
+
+    while (sndRunning) {
+        Sound::fill(sndData, sndSink->period);
+        sndSink->write(sndData, sndSink->period);
+
+        if (!sndSink->blocking) { // pace non-device sinks to real time
+            next += periodUS;
+            int64 now = getTimeUS();
+            if (next > now)
+                usleep(useconds_t(next - now));
+            else
+                next = now;
+        }
     }
     return NULL;
 }
 
-void sndInit() {
-    static const pa_sample_spec spec = {
-        .format   = PA_SAMPLE_S16LE,
-        .rate     = 44100,
-        .channels = 2
-    };
+SoundSink* sndCreate(const char *name, int period, const char *fileName) {
+    if (!strcmp(name, "null"))
+        return new SoundSink(period ? period : SND_PERIOD, false);
+    if (!strcmp(name, "wav"))
+        return new SoundSinkWAV(period ? period : SND_PERIOD, fileName ? fileName : "openlara.wav");
+    if (!strcmp(name, "low"))
+        return new SoundSinkPulse(period ? period : SND_PERIOD_LOW, true);
+    if (strcmp(name, "pulse"))
+        LOG("! sound: unknown sink \"%s\", use pulse\n", name);
+    return new SoundSinkPulse(period ? period : SND_PERIOD, false);
+}
 
-    static const pa_buffer_attr attr = {
-        .maxlength  = SND_DATA_SIZE * 4,
-        .tlength    = 0xFFFFFFFF,
-        .prebuf     = 0xFFFFFFFF,
-        .minreq     = SND_DATA_SIZE,
-        .fragsize   = 0xFFFFFFFF,
-    };
+void sndInit(SoundSink *sink) {
+    sndSink    = sink;
+    sndData    = NULL;
+    sndRunning = false;
 
-    int error;
-    if (!(sndOut = pa_simple_new(NULL, WND_TITLE, PA_STREAM_PLAYBACK, NULL, "game", &spec, NULL, &attr, &error))) {
-        LOG("pa_simple_new() failed: %s\n", pa_strerror(error));
-        sndData = NULL;
+    if (!sndSink->open()) {
+        delete sndSink;
+        sndSink = NULL;
         return;
     }
 
-    sndData = new Sound::Frame[SND_DATA_SIZE / SND_FRAME_SIZE];
+    sndData = new Sound::Frame[sndSink->period];
+
+    if (offline) // mixed by the main loop
+        return;
+
+    sndRunning = true;
     pthread_create(&sndThread, NULL, sndFill, NULL);
 }
 
 void sndFree() {
-    if (sndOut) {
-        pthread_cancel(sndThread);
-    //    pa_simple_flush(sndOut, NULL);
-    //    pa_simple_free(sndOut);
-        delete[] sndData;
+    if (sndRunning) {
+        sndRunning = false;
+        pthread_join(sndThread, NULL);
+    }
+    delete sndSink;
+    delete[] sndData;
+    sndSink = NULL;
+}
+
+// mix all frames due up to the current offline time
+void sndOffline(int64 &framesDone) {
+    int64 framesDue = int64(offlineTime) * SND_FREQ / 1000;
+    while (sndSink && framesDone + sndSink->period <= framesDue) {
+        Sound::fill(sndData, sndSink->period);
+        sndSink->write(sndData, sndSink->period);
+        framesDone += sndSink->period;
     }
 }
 
@@ -520,10 +678,64 @@ int main(int argc, char **argv) {
     fsInit();
 
     joyInit();
-    sndInit();
-    Game::init(argc > 1 ? argv[1] : NULL);
+
+    const char *levelName     = NULL;
+    const char *sinkName      = "pulse";
+    const char *sinkFile      = NULL;
+    int         sinkPeriod    = 0;
+    float       offlineLength = 0.0f;
+    bool        replay        = false;
+
+    for (int i = 1; i < argc; i++) {
+        if (!strcmp(argv[i], "--record") && i + 1 < argc)
+            Input::Record::startRecord(argv[++i]);
+        else if (!strcmp(argv[i], "--replay") && i + 1 < argc)
+            replay = Input::Record::startReplay(argv[++i]);
+        else if (!strcmp(argv[i], "--snd-sink") && i + 1 < argc)
+            sinkName = argv[++i];
+        else if (!strcmp(argv[i], "--snd-file") && i + 1 < argc)
+            sinkFile = argv[++i];
+        else if (!strcmp(argv[i], "--snd-period") && i + 1 < argc)
+            sinkPeriod = max(SND_PERIOD_MIN, atoi(argv[++i]));
+        else if (!strcmp(argv[i], "--snd-offline") && i + 1 < argc)
+            offlineLength = float(atof(argv[++i]));
+        else if (!levelName)
+            levelName = argv[i];
+    }
+
+// offline mode mixes the audio of a scripted (replayed) scene as fast as possible into a file or nowhere,
+// useful as the mixer throughput benchmark and to compare the output with a reference file
+    if (offlineLength > 0.0f) {
+        offline        = true;
+        offlineTime    = 0;
+        Sound::offline = true;
+        if (!strcmp(sinkName, "pulse") || !strcmp(sinkName, "low"))
+            sinkName = sinkFile ? "wav" : "null";
+    }
+
+    sndInit(sndCreate(sinkName, sinkPeriod, sinkFile));
+
+    Game::init(levelName);
+
+    int64 offlineFrames = 0;
+    int64 offlineStart  = getTimeUS();
+    int64 offlineMixer  = 0;
+    int   offlineTicks  = 0;
 
     while (!Core::isQuit) {
+        if (offline) {
+            if (offlineTime >= int(offlineLength * 1000.0f) || (replay && !Input::Record::isActive()))
+                break;
+
+            offlineTime = ++offlineTicks * SND_OFFLINE_STEP;
+            Game::update();
+
+            int64 mixStart = getTimeUS();
+            sndOffline(offlineFrames);
+            offlineMixer += getTimeUS() - mixStart;
+            continue;
+        }
+
         if (XPending(dpy)) {
             XEvent event;
             XNextEvent(dpy, &event);
@@ -541,6 +753,14 @@ int main(int argc, char **argv) {
         }
     };
 
+    if (offline) {
+        float total  = (getTimeUS() - offlineStart) * 0.000001f;
+        float length = float(offlineFrames) / SND_FREQ;
+        LOG("offline: %.2f sec of audio in %.2f sec (x%.1f), mixer %.2f sec (x%.1f)\n",
+            length, total, length / max(total, 0.001f),
+            offlineMixer * 0.000001f, length / max(offlineMixer * 0.000001f, 0.001f));
+    }
+
     joyFree();
     sndFree();
     Game::deinit();
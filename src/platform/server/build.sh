@@ -0,0 +1,2 @@
+set -e
+clang++ -std=c++11 -O2 -s -fno-exceptions -fno-rtti -ffunction-sections -fdata-sections -Wl,--gc-sections -Wno-invalid-source-encoding -D__SERVER__ -DNDEBUG -D_POSIX_THREADS -D_POSIX_READER_WRITER_LOCKS main.cpp ../../libs/tinf/tinflate.c -I../../ -o../../../bin/OpenLaraServer -lm -lpthread
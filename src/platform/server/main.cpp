@@ -0,0 +1,373 @@
+#include <string.h>
+#include <stdlib.h>
+#include <signal.h>
+#include <sys/time.h>
+#include <sys/stat.h>
+#include <dirent.h>
+#include <unistd.h>
+#include <pwd.h>
+
+#include "game.h"
+
+#define SERVER_TICK_RATE        30      // simulation ticks per second
+#define SERVER_REPORT_PERIOD    5       // seconds between stat reports
+#define SERVER_MAX_LAG          10      // ticks behind real time before the clock is resynced
+#define SERVER_MAX_BOTS         64
+#define SERVER_SCREEN_WIDTH     320
+#define SERVER_SCREEN_HEIGHT    240
+
+// timing
+// the simulation runs on its own clock that advances exactly by one tick per Game::update,
+// so Core::deltaTime is fixed regardless of host load
+int   serverTime;
+int64 serverTicks;
+
+int osGetTimeMS() {
+    return serverTime;
+}
+
+int64 getTimeUS() {
+    timeval t;
+    gettimeofday(&t, NULL);
+    return int64(t.tv_sec) * 1000000 + t.tv_usec;
+}
+
+// input
+bool osJoyReady(int index) {
+    return false;
+}
+
+void osJoyVibrate(int index, float L, float R) {}
+
+char command[256];
+
+// filesystem
+#define MAX_FILES 4096
+char* gFiles[MAX_FILES];
+int32 gFilesCount;
+
+void addDir(char* path)
+{
+    char* fileName;
+    struct dirent* e;
+    DIR* dir = opendir(path);
+
+    int32 pathLen = strlen(path);
+    path[pathLen] = '/';
+
+    while ((e = readdir(dir)))
+    {
+        if (e->d_type == DT_DIR)
+        {
+            if (e->d_name[0] != '.')
+            {
+                strcpy(path + 1 + pathLen, e->d_name);
+                addDir(path);
+            }
+        }
+        else
+        {
+            ASSERT(gFilesCount < MAX_FILES);
+            if (gFilesCount < MAX_FILES)
+            {
+                strcpy(path + 1 + pathLen, e->d_name);
+                fileName = (char*)malloc(strlen(path) + 1 - 2);
+                gFiles[gFilesCount++] = strcpy(fileName, path + 2);
+            }
+        }
+    }
+
+    closedir(dir);
+    path[pathLen] = '\0';
+}
+
+void fsInit()
+{
+    char path[1024];
+    strcpy(path, ".");
+    addDir(path);
+    LOG("scan %d files\n", gFilesCount);
+}
+
+void fsFree()
+{
+    int32 i;
+    for (i = 0; i < gFilesCount; i++)
+    {
+        free(gFiles[i]);
+    }
+}
+
+const char* osFixFileName(const char* fileName)
+{
+    int32 i;
+    for (i = 0; i < gFilesCount; i++)
+    {
+        if (!strcasecmp(fileName, gFiles[i]))
+        {
+            return gFiles[i];
+        }
+    }
+    return NULL;
+}
+
+// bots
+// local clients connected over loopback, they send random input and acknowledge snapshots
+// like a real client would, so the server can be load-tested without running the game
+struct Bot {
+    SOCKET      sock;
+    sockaddr_in addr;
+    uint16      mask;
+    int         maskTime;
+    uint16      seq;
+    uint32      parts;
+    int32       bytesRecv;
+};
+
+Bot bots[SERVER_MAX_BOTS];
+int botsCount;
+
+void botsInit(int count) {
+    botsCount = 0;
+    for (int i = 0; i < min(count, SERVER_MAX_BOTS); i++) {
+        Bot &bot = bots[botsCount];
+        memset(&bot, 0, sizeof(bot));
+
+        bot.sock = socket(AF_INET, SOCK_DGRAM, IPPROTO_UDP);
+        if (bot.sock == INVALID_SOCKET) {
+            LOG("! bot: failed to create socket\n");
+            break;
+        }
+
+        u_long on = 1;
+        ioctlsocket(bot.sock, FIONBIO, &on);
+
+        bot.addr.sin_family      = AF_INET;
+        bot.addr.sin_port        = htons(NET_PORT);
+        bot.addr.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+        bot.seq                  = NET_NO_SNAPSHOT;
+        botsCount++;
+    }
+    LOG("bots: %d\n", botsCount);
+}
+
+void botsFree() {
+    for (int i = 0; i < botsCount; i++)
+        closesocket(bots[i].sock);
+    botsCount = 0;
+}
+
+void botSend(Bot &bot, const Network::Packet &packet) {
+    NAPI::Datagram d;
+    d.size = 0;
+    d.append(&packet, packet.getSize());
+    sendto(bot.sock, (const char*)d.data, d.size, 0, (sockaddr*)&bot.addr, sizeof(bot.addr));
+}
+
+void botRecv(Bot &bot, const Network::Packet &packet) {
+    if (packet.type == Network::Packet::PING) {
+        Network::Packet response;
+        response.type = Network::Packet::PONG;
+        botSend(bot, response);
+    }
+
+    if (packet.type == Network::Packet::SNAPSHOT) {
+        if (packet.snapshot.seq != bot.seq) {
+            bot.seq   = packet.snapshot.seq;
+            bot.parts = 0;
+        }
+        bot.parts |= 1 << packet.snapshot.part;
+
+        if (bot.parts == (1U << packet.snapshot.parts) - 1) {
+            Network::Packet response;
+            response.type    = Network::Packet::ACK;
+            response.ack.seq = bot.seq;
+            botSend(bot, response);
+        }
+    }
+}
+
+void botsUpdate(int time) {
+    static const uint16 moves[] = {
+        0,
+        Character::FORTH,
+        Character::FORTH | Character::LEFT,
+        Character::FORTH | Character::RIGHT,
+        Character::FORTH | Character::JUMP,
+        Character::BACK,
+        Character::LEFT,
+        Character::RIGHT,
+        Character::WALK  | Character::FORTH,
+        Character::ACTION,
+    };
+
+    Network::Packet packet;
+    NAPI::Datagram  d;
+
+    for (int i = 0; i < botsCount; i++) {
+        Bot &bot = bots[i];
+
+        while ((d.size = recv(bot.sock, (char*)d.data, sizeof(d.data), 0)) > 0) {
+            bot.bytesRecv += d.size;
+
+        // split coalesced datagram into packets
+            int offset = 0;
+            while (offset + 2 <= d.size) {
+                uint16 len;
+                memcpy(&len, d.data + offset, 2);
+                offset += 2;
+                if (offset + len > d.size || len > sizeof(packet))
+                    break;
+                memcpy(&packet, d.data + offset, len);
+                offset += len;
+                botRecv(bot, packet);
+            }
+        }
+
+        if (time >= bot.maskTime) {
+            bot.mask     = moves[rand() % COUNT(moves)];
+            bot.maskTime = time + 500 + rand() % 1500;
+        }
+
+        packet.type       = Network::Packet::INPUT;
+        packet.input.mask = bot.mask;
+        botSend(bot, packet);
+    }
+}
+
+// stats
+struct Stats {
+    int64 tickTotal;
+    int64 tickMax;
+    int   ticks;
+    int   lagTicks;
+} stats;
+
+void statsReport(float seconds) {
+    if (!stats.ticks) return;
+
+    LOG("tick: avg %.2f ms, max %.2f ms, budget %.2f ms, late %d, players %d\n",
+        float(stats.tickTotal) / stats.ticks * 0.001f,
+        float(stats.tickMax) * 0.001f,
+        1000.0f / SERVER_TICK_RATE,
+        stats.lagTicks,
+        Network::players.length);
+
+    for (int i = 0; i < Network::players.length; i++) {
+        Network::Player &player = Network::players[i];
+        LOG("  client %s:%d out %.2f KB/s in %.2f KB/s ack %d\n",
+            inet_ntoa(*(in_addr*)&player.peer.ip), ntohs(player.peer.port),
+            player.bytesSent / 1024.0f / seconds,
+            player.bytesRecv / 1024.0f / seconds,
+            player.ackSeq == NET_NO_SNAPSHOT ? -1 : int(player.ackSeq));
+        player.bytesSent = player.bytesRecv = 0;
+    }
+
+    NAPI::Stats net;
+    NAPI::takeStats(net);
+    LOG("  socket: sent %d/%d (packets/messages) %.2f KB, recv %d/%d %.2f KB, drops %d/%d\n",
+        net.packetsSent, net.messagesSent, net.bytesSent / 1024.0f,
+        net.packetsRecv, net.messagesRecv, net.bytesRecv / 1024.0f,
+        net.dropsSent, net.dropsRecv);
+
+    memset(&stats, 0, sizeof(stats));
+}
+
+void sigHandler(int sig) {
+    Core::quit();
+}
+
+int main(int argc, char **argv) {
+    if (argc < 2) {
+        printf("usage: %s <level file> [bots count] [--record <file>] [--replay <file>]\n", argv[0]);
+        return 1;
+    }
+
+    cacheDir[0] = saveDir[0] = contentDir[0] = 0;
+
+    const char *home;
+    if (!(home = getenv("HOME")))
+        home = getpwuid(getuid())->pw_dir;
+    strcat(cacheDir, home);
+    strcat(cacheDir, "/.openlara/");
+
+    struct stat st = {0};
+    if (stat(cacheDir, &st) == -1 && mkdir(cacheDir, 0777) == -1)
+        cacheDir[0] = 0;
+    strcpy(saveDir, cacheDir);
+
+    signal(SIGINT,  sigHandler);
+    signal(SIGTERM, sigHandler);
+
+    serverTime  = 0;
+    serverTicks = 0;
+
+    Core::width   = SERVER_SCREEN_WIDTH;
+    Core::height  = SERVER_SCREEN_HEIGHT;
+    Core::defLang = 0;
+
+    fsInit();
+
+    int  botsRequested = 0;
+    bool replay        = false;
+    for (int i = 2; i < argc; i++) {
+        if (!strcmp(argv[i], "--record") && i + 1 < argc)
+            Input::Record::startRecord(argv[++i]);
+        else if (!strcmp(argv[i], "--replay") && i + 1 < argc)
+            replay = Input::Record::startReplay(argv[++i]);
+        else
+            botsRequested = atoi(argv[i]);
+    }
+
+    Game::init(argv[1]);
+    GAPI::resize();
+
+    botsInit(botsRequested);
+
+    const int tickUS   = 1000000 / SERVER_TICK_RATE;
+    int64 nextTick     = getTimeUS();
+    int64 nextReport   = nextTick + SERVER_REPORT_PERIOD * 1000000;
+
+    memset(&stats, 0, sizeof(stats));
+
+    while (!Core::isQuit) {
+    // replays run as fast as possible and quit when the input stream ends
+        if (replay && !Input::Record::isActive())
+            break;
+
+        int64 now = getTimeUS();
+        if (now < nextTick && !replay) {
+            usleep(useconds_t(nextTick - now));
+            continue;
+        }
+
+        serverTime = int(++serverTicks * 1000 / SERVER_TICK_RATE); // keep the average tick exact in whole ms
+
+        botsUpdate(serverTime);
+
+        int64 tickStart = getTimeUS();
+        Game::update();
+        int64 tickTime  = getTimeUS() - tickStart;
+
+        stats.tickTotal += tickTime;
+        stats.tickMax    = max(stats.tickMax, tickTime);
+        stats.ticks++;
+
+        nextTick += tickUS;
+        if (now - nextTick > SERVER_MAX_LAG * tickUS) { // can't keep up, drop the backlog
+            nextTick = now;
+            stats.lagTicks++;
+        }
+
+        if (now >= nextReport) {
+            statsReport(float(SERVER_REPORT_PERIOD));
+            nextReport += SERVER_REPORT_PERIOD * 1000000;
+        }
+    }
+
+    botsFree();
+    Game::deinit();
+    fsFree();
+
+    return 0;
+}
@@ -8,6 +8,12 @@
 
 #define SAVE_FILENAME       "savegame.dat"
 #define SAVE_MAGIC          FOURCC("OLS2")
+#define SAVE_MAGIC_PACKED   FOURCC("OLSZ")  // uint32 raw size + deflate stream of OLS2 data
+#define SAVE_MAX_RAW_SIZE   (16 * 1024 * 1024) // unpacked size limit, the header comes from the file
+
+#define SNAPSHOT_COUNT      32      // rewind depth
+#define SNAPSHOT_PERIOD     15      // level updates between snapshots
+#define SNAPSHOT_KEYFRAME   8       // every Nth snapshot keeps all entities
 
 enum SaveResult {
     SAVE_RESULT_SUCCESS,
@@ -110,6 +116,230 @@ struct SaveSlot {
     }
 };
 
+// in-memory ring of level states for instant rewind
+// snapshot is a save slot header (stats, items, level state) followed by [index, size, SaveEntity] records
+// of the entities changed since the previous snapshot (size 0 - entity was removed), keyframes keep all entities
+struct SnapshotRing {
+    struct Snapshot {
+        uint8  *data;
+        int32  size;
+        int32  headerSize;
+        bool   keyframe;
+    };
+
+    struct Record {
+        uint16 index;
+        uint16 size;
+    };
+
+    Snapshot   items[SNAPSHOT_COUNT];
+    int        first;
+    int        count;
+    int        sinceKeyframe;
+
+    int        entitiesCount;
+    SaveEntity *state;      // entities state at the last snapshot
+    uint8      *present;
+    uint8      *seen;
+
+    uint8      *buffer;     // capture scratch
+    uint8      *ptr;
+    int32      headerSize;
+    int32      maxHeaderSize;
+
+    SnapshotRing() : first(0), count(0), entitiesCount(0), state(NULL), present(NULL), seen(NULL), buffer(NULL), ptr(NULL) {}
+
+    ~SnapshotRing() {
+        free();
+    }
+
+    static int getEntitySize(const SaveEntity &e) {
+        return (sizeof(SaveEntity) - sizeof(SaveEntity::Extra)) + e.extraSize;
+    }
+
+    void init(int entitiesCount, int maxHeaderSize) {
+        free();
+        this->entitiesCount = entitiesCount;
+        this->maxHeaderSize = maxHeaderSize;
+        state   = new SaveEntity[entitiesCount];
+        present = new uint8[entitiesCount];
+        seen    = new uint8[entitiesCount];
+        buffer  = new uint8[maxHeaderSize + (sizeof(Record) + sizeof(SaveEntity)) * entitiesCount];
+        reset();
+    }
+
+    void free() {
+        reset();
+        delete[] state;
+        delete[] present;
+        delete[] seen;
+        delete[] buffer;
+        state   = NULL;
+        present = seen = buffer = NULL;
+        entitiesCount = 0;
+    }
+
+    void reset() {
+        while (count)
+            drop(count - 1);
+        first = 0;
+        sinceKeyframe = SNAPSHOT_KEYFRAME;
+        if (present)
+            memset(present, 0, entitiesCount);
+    }
+
+    Snapshot& get(int index) {
+        return items[(first + index) % SNAPSHOT_COUNT];
+    }
+
+    void drop(int index) { // only the oldest or the newest
+        Snapshot &snap = get(index);
+        delete[] snap.data;
+        snap.data = NULL;
+        if (index == 0)
+            first = (first + 1) % SNAPSHOT_COUNT;
+        count--;
+    }
+
+// oldest restorable snapshot must be a keyframe
+    int getAvailable() {
+        int i = 0;
+        while (i < count && !get(i).keyframe)
+            i++;
+        return count - i;
+    }
+
+// capture
+    uint8* begin() {
+        memset(seen, 0, entitiesCount);
+        return buffer;
+    }
+
+    void setHeader(uint8 *end) {
+        headerSize = int32(end - buffer);
+        ASSERT(headerSize <= maxHeaderSize);
+        ptr = buffer + headerSize;
+    }
+
+    void addEntity(int index, const SaveEntity &e) {
+        ASSERT(ptr && index < entitiesCount);
+
+        int size = getEntitySize(e);
+        seen[index] = 1;
+
+        if (sinceKeyframe < SNAPSHOT_KEYFRAME && present[index] && !memcmp(&state[index], &e, size))
+            return; // not changed
+
+        Record rec;
+        rec.index = index;
+        rec.size  = size;
+        memcpy(ptr, &rec, sizeof(rec));
+        memcpy(ptr + sizeof(rec), &e, size);
+        ptr += sizeof(rec) + size;
+
+        memcpy(&state[index], &e, size);
+        present[index] = 1;
+    }
+
+    void end() {
+        bool keyframe = sinceKeyframe >= SNAPSHOT_KEYFRAME;
+
+        for (int i = 0; i < entitiesCount; i++) {
+            if (present[i] && !seen[i]) {
+                present[i] = 0;
+                if (keyframe) continue;
+                Record rec;
+                rec.index = i;
+                rec.size  = 0;
+                memcpy(ptr, &rec, sizeof(rec));
+                ptr += sizeof(rec);
+            }
+        }
+
+        if (count == SNAPSHOT_COUNT)
+            drop(0);
+
+        Snapshot &snap = get(count++);
+        snap.size       = int32(ptr - buffer);
+        snap.headerSize = headerSize;
+        snap.keyframe   = keyframe;
+        snap.data       = new uint8[snap.size];
+        memcpy(snap.data, buffer, snap.size);
+
+        sinceKeyframe = keyframe ? 1 : sinceKeyframe + 1;
+        ptr = NULL;
+    }
+
+// compose the save slot of the snapshot "back" steps before the newest one
+// newer snapshots are dropped, the ring continues from the restored state
+    bool restore(int back, SaveSlot &slot) {
+        if (back < 0 || back >= getAvailable())
+            return false;
+
+        int target = count - 1 - back;
+        int key    = target;
+        while (!get(key).keyframe)
+            key--;
+
+        memset(present, 0, entitiesCount);
+        for (int i = key; i <= target; i++) {
+            Snapshot &snap = get(i);
+            uint8 *p = snap.data + snap.headerSize;
+            while (p < snap.data + snap.size) {
+                Record rec;
+                memcpy(&rec, p, sizeof(rec));
+                p += sizeof(rec);
+                present[rec.index] = rec.size != 0;
+                if (rec.size)
+                    memcpy(&state[rec.index], p, rec.size);
+                p += rec.size;
+            }
+        }
+
+        Snapshot &snap = get(target);
+
+        int size = snap.headerSize + sizeof(int32);
+        for (int i = 0; i < entitiesCount; i++)
+            if (present[i])
+                size += getEntitySize(state[i]);
+
+        slot.size = size;
+        slot.data = new uint8[size];
+
+        uint8 *ptr = slot.data;
+        memcpy(ptr, snap.data, snap.headerSize);
+        ptr += snap.headerSize;
+
+        int32 *entities = (int32*)ptr;
+        ptr += sizeof(*entities);
+        *entities = 0;
+
+        for (int i = 0; i < entitiesCount; i++) {
+            if (!present[i]) continue;
+            int entitySize = getEntitySize(state[i]);
+            memcpy(ptr, &state[i], entitySize);
+            ptr += entitySize;
+            (*entities)++;
+        }
+
+        while (count - 1 > target)
+            drop(count - 1);
+
+    // entity indices of the restored dynamic entities may change, next snapshot is a keyframe
+        sinceKeyframe = SNAPSHOT_KEYFRAME;
+        memset(present, 0, entitiesCount);
+
+        return true;
+    }
+
+    int getMemoryUsage() {
+        int size = 0;
+        for (int i = 0; i < count; i++)
+            size += get(i).size;
+        return size;
+    }
+};
+
 Array<SaveSlot> saveSlots;
 SaveResult      saveResult;
 int             loadSlot;
@@ -123,23 +353,55 @@ void freeSaveSlots() {
 
 void readSaveSlots(Stream *stream) {
     uint32 magic;
-    if (stream->size < 4 || stream->read(magic) != SAVE_MAGIC)
+    if (stream->size < 4)
+        return;
+
+    stream->read(magic);
+
+#ifdef USE_INFLATE
+    if (magic == SAVE_MAGIC_PACKED && stream->data && stream->size >= 8) {
+        uint32 rawSize;
+        stream->read(rawSize);
+
+        if (rawSize < 4 || rawSize > SAVE_MAX_RAW_SIZE || stream->pos >= stream->size) {
+            LOG("! corrupted save data\n");
+            return;
+        }
+
+        uint8 *raw = new uint8[rawSize];
+        uint32 size = 0;
+        if (tinf_uncompress_bounded(raw, &size, rawSize, stream->data + stream->pos, stream->size - stream->pos) == TINF_OK && size == rawSize) {
+            Stream unpacked(NULL, raw, rawSize);
+            readSaveSlots(&unpacked);
+        } else {
+            LOG("! corrupted save data\n");
+        }
+        delete[] raw;
+        return;
+    }
+#endif
+
+    if (magic != SAVE_MAGIC)
         return;
 
     freeSaveSlots();
 
     SaveSlot slot;
-    while (stream->pos < stream->size) {
+    while (stream->pos + 4 <= stream->size) {
         stream->read(slot.size);
+        if (slot.size < sizeof(SaveStats) || slot.size > uint32(stream->size - stream->pos)) {
+            LOG("! corrupted save slot\n");
+            break;
+        }
         stream->read(slot.data, slot.size);
         saveSlots.push(slot);
     }
 }
 
-uint8* writeSaveSlots(int &size) {
+uint8* writeSaveSlots(const SaveSlot *slots, int count, int &size) {
     size = 4;
-    for (int i = 0; i < saveSlots.length; i++)
-        size += 4 + saveSlots[i].size;
+    for (int i = 0; i < count; i++)
+        size += 4 + slots[i].size;
 
     uint8 *data = new uint8[size];
     uint8 *ptr  = data;
@@ -148,8 +410,8 @@ uint8* writeSaveSlots(int &size) {
     ptr += sizeof(*magic);
     *magic = SAVE_MAGIC;
 
-    for (int i = 0; i < saveSlots.length; i++) {
-        SaveSlot &s = saveSlots[i];
+    for (int i = 0; i < count; i++) {
+        const SaveSlot &s = slots[i];
         memcpy(ptr + 0, &s.size,  4);
         memcpy(ptr + 4, s.data,   s.size);
         ptr += 4 + s.size;
@@ -158,6 +420,215 @@ uint8* writeSaveSlots(int &size) {
     return data;
 }
 
+uint8* writeSaveSlots(int &size) {
+    return writeSaveSlots(saveSlots.items, saveSlots.length, size);
+}
+
+#ifdef USE_INFLATE
+// compress OLS2 data into OLSZ, returns NULL if it doesn't get smaller
+uint8* packSaveSlots(const uint8 *data, int size, int &packedSize) {
+    int maxSize = size - 8;
+    if (maxSize <= 0)
+        return NULL;
+
+    uint8 *packed = new uint8[size];
+    int count = Deflate::compress(data, size, packed + 8, maxSize);
+    if (count < 0) {
+        delete[] packed;
+        return NULL;
+    }
+
+    uint32 magic   = SAVE_MAGIC_PACKED;
+    uint32 rawSize = size;
+    memcpy(packed + 0, &magic,   4);
+    memcpy(packed + 4, &rawSize, 4);
+    packedSize = 8 + count;
+    return packed;
+}
+#endif
+
+// saves are serialized, compressed and written in the background
+// game thread only hands over a copy of the slots, a save requested while the writer is busy
+// replaces the pending one, so rapid checkpoints result in a single write of the latest state
+namespace SaveWriter {
+    struct Job {
+        SaveSlot *slots;
+        int      count;
+    };
+
+    Job  *pending;
+    bool busy;
+    bool done;
+    SaveResult result;
+
+#ifdef OS_PTHREAD_MT
+    pthread_t       thread;
+    pthread_mutex_t mutex;
+    pthread_cond_t  cond;
+    bool            running;
+#endif
+
+    void freeJob(Job *job) {
+        if (!job) return;
+        for (int i = 0; i < job->count; i++)
+            delete[] job->slots[i].data;
+        delete[] job->slots;
+        delete job;
+    }
+
+    void writeCallback(Stream *stream, void *userData) {
+        uint8 *data = (uint8*)userData;
+        delete[] data;
+
+        SaveResult res = stream ? SAVE_RESULT_SUCCESS : SAVE_RESULT_ERROR;
+        delete stream;
+
+    #ifdef OS_PTHREAD_MT
+        pthread_mutex_lock(&mutex);
+    #endif
+        result = res;
+        done   = true;
+        busy   = false;
+    #ifdef OS_PTHREAD_MT
+        pthread_mutex_unlock(&mutex);
+    #endif
+    }
+
+    void process(Job *job) {
+        int size;
+        uint8 *data = writeSaveSlots(job->slots, job->count, size);
+        freeJob(job);
+
+    #ifdef USE_INFLATE
+        int packedSize;
+        uint8 *packed = packSaveSlots(data, size, packedSize);
+        if (packed) {
+            LOG("save: %d -> %d bytes\n", size, packedSize);
+            delete[] data;
+            data = packed;
+            size = packedSize;
+        }
+    #endif
+
+        osWriteSlot(new Stream(SAVE_FILENAME, (const char*)data, size, writeCallback, data));
+    }
+
+#ifdef OS_PTHREAD_MT
+    void* writeThread(void *arg) {
+        pthread_mutex_lock(&mutex);
+        while (1) {
+            while (running && !pending)
+                pthread_cond_wait(&cond, &mutex);
+
+            if (!pending) // stopped and nothing left to write
+                break;
+
+            Job *job = pending;
+            pending  = NULL;
+            busy     = true;
+            pthread_mutex_unlock(&mutex);
+
+            process(job);
+
+            pthread_mutex_lock(&mutex);
+        }
+        pthread_mutex_unlock(&mutex);
+        return NULL;
+    }
+#endif
+
+    void init() {
+        pending = NULL;
+        busy    = false;
+        done    = false;
+        result  = SAVE_RESULT_SUCCESS;
+    #ifdef OS_PTHREAD_MT
+        pthread_mutex_init(&mutex, NULL);
+        pthread_cond_init(&cond, NULL);
+        running = pthread_create(&thread, NULL, writeThread, NULL) == 0;
+    #endif
+    }
+
+// finish pending writes
+    void deinit() {
+    #ifdef OS_PTHREAD_MT
+        if (running) {
+            pthread_mutex_lock(&mutex);
+            running = false;
+            pthread_cond_signal(&cond);
+            pthread_mutex_unlock(&mutex);
+            pthread_join(thread, NULL);
+        }
+        pthread_cond_destroy(&cond);
+        pthread_mutex_destroy(&mutex);
+    #endif
+        if (pending) {
+            process(pending);
+            pending = NULL;
+        }
+    }
+
+// snapshot the current slots and queue them for writing
+    void write() {
+        Job *job   = new Job();
+        job->count = saveSlots.length;
+        job->slots = new SaveSlot[job->count];
+        for (int i = 0; i < job->count; i++) {
+            SaveSlot &src = saveSlots[i];
+            job->slots[i].size = src.size;
+            job->slots[i].data = new uint8[src.size];
+            memcpy(job->slots[i].data, src.data, src.size);
+        }
+
+    #ifdef OS_PTHREAD_MT
+        if (running) {
+            pthread_mutex_lock(&mutex);
+            if (pending) {
+                LOG("save: coalesce pending write\n");
+            }
+            freeJob(pending);
+            pending = job;
+            pthread_cond_signal(&cond);
+            pthread_mutex_unlock(&mutex);
+            return;
+        }
+    #endif
+
+        freeJob(pending);
+        pending = job;
+    }
+
+// returns true when the last requested save is written
+    bool update(SaveResult &res) {
+    #ifdef OS_PTHREAD_MT
+        if (running) {
+            pthread_mutex_lock(&mutex);
+            bool complete = done && !busy && !pending;
+            if (complete) {
+                res  = result;
+                done = false;
+            }
+            pthread_mutex_unlock(&mutex);
+            return complete;
+        }
+    #endif
+    // single threaded, write on the game thread one at a time
+        if (!busy && pending) {
+            Job *job = pending;
+            pending = NULL;
+            busy    = true;
+            process(job);
+        }
+
+        if (done && !busy && !pending) {
+            res  = result;
+            done = false;
+            return true;
+        }
+        return false;
+    }
+}
+
 void removeSaveSlot(TR::LevelID levelID, bool checkpoint) {
     TR::Version version = TR::getGameVersionByLevel(levelID);
 
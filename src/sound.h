@@ -1,7 +1,7 @@
 #ifndef H_SOUND
 #define H_SOUND
 
-#ifdef _OS_TNS
+#if defined(_OS_TNS) || defined(_OS_SERVER)
     #define NO_SOUND
 #endif
 
@@ -15,6 +15,11 @@
     #if !defined(_OS_PSP) && !defined(_OS_WEB) && !defined(_OS_PSV) && !defined(_OS_3DS) && !defined(_OS_XBOX) && !defined(_OS_XB1)
         #define DECODE_MP3
     #endif
+
+    #if defined(OS_PTHREAD_MT) && !defined(_OS_WEB)
+        #define DECODE_THREAD // music is decoded ahead on a worker thread
+        #include <pthread.h>
+    #endif
 #endif
 
 #include "utils.h"
@@ -39,6 +44,12 @@
 #define SND_PAN_FACTOR      0.7f
 #define SND_FACING_FACTOR   0.3f
 
+#define SND_STREAM_CHUNK    (16 * 1024)         // compressed data read from the stream at once
+#define SND_STREAM_MAX      (1024 * 1024)       // window limit for oversized headers (cover art in ogg comments)
+#define SND_PREFETCH_FRAMES (1 << 15)           // decoded frames kept ahead per music channel (~0.75 sec)
+#define SND_PREFETCH_CHUNK  2048
+#define SND_PREFETCH_SLEEP  5                   // ms between decoder thread checks
+
 namespace Sound {
 
     static const int8 SPU_POS[] = { 0, 60, 115,  98, 122 };
@@ -218,97 +229,153 @@ namespace Sound {
         virtual ~Decoder() { delete stream; }
         virtual int decode(Frame *frames, int count) { return 0; }
         virtual void replay() { stream->seek(offset - stream->pos); }
+    };
 
-        int resample(Sound::Frame *frames, Sound::Frame &frame) {
-            if (freq == 44100) {
-                frames[0] = frame;
-                return 1;
-            }
+// decodes the source by blocks at its own rate and upsamples the whole block to the mixer rate at once
+    struct BlockDecoder : Decoder {
+        Frame *block;
+        int   blockSize, blockPos, blockCount;
+        int   ratio;
+        Frame pending[4];   // the rest of the last upsampled frame that didn't fit into the output
+        int   pendingPos, pendingCount;
+
+        BlockDecoder(Stream *stream, int channels, int freq, int blockSize) : Decoder(stream, channels, freq), blockSize(blockSize), blockPos(0), blockCount(0), pendingPos(0), pendingCount(0) {
+            block = new Frame[blockSize];
+            ratio = clamp(44100 / max(freq, 1), 1, 4); // ! in the original game series only 11025, 22050 and 44100 Hz were used !
+            ASSERT(ratio * freq == 44100);
+        }
 
-            int dL = int(frame.L) - int(prevFrame.L);
-            int dR = int(frame.R) - int(prevFrame.R);
-            switch (freq) {
-                case 11025 :
-                    if (channels == 2) {
-                        frames[0].L = prevFrame.L + dL / 4;                   // 0.25 L
-                        frames[0].R = prevFrame.R + dR / 4;                   // 0.25 R
-                        frames[1].L = prevFrame.L + dL / 2;                   // 0.50 L
-                        frames[1].R = prevFrame.R + dR / 2;                   // 0.50 R
-                        frames[2].L = prevFrame.L + dL * 3 / 4;               // 0.75 L
-                        frames[2].R = prevFrame.R + dR * 3 / 4;               // 0.75 R
-                    } else {
-                        frames[0].L = frames[0].R = prevFrame.L + dL / 4;     // 0.25 LR
-                        frames[1].L = frames[1].R = prevFrame.L + dL / 2;     // 0.50 LR
-                        frames[2].L = frames[2].R = prevFrame.L + dL * 3 / 4; // 0.75 LR
+        virtual ~BlockDecoder() {
+            delete[] block;
+        }
+
+    // fills the block with frames at the source rate (mono as L = R), returns the number of frames
+        virtual int decodeBlock(Frame *frames) { return 0; }
+
+        void upsample(Frame *frames, const Frame *src, int count) {
+            Frame prev = prevFrame;
+            switch (ratio) {
+                case 1 :
+                    memcpy(frames, src, count * sizeof(Frame));
+                    prev = src[count - 1];
+                    break;
+                case 2 :
+                    for (int i = 0; i < count; i++, frames += 2) {
+                        int dL = int(src[i].L) - prev.L;
+                        int dR = int(src[i].R) - prev.R;
+                        frames[0].L = prev.L + dL / 2;      // 0.50
+                        frames[0].R = prev.R + dR / 2;
+                        frames[1] = prev = src[i];          // 1.00
+                    }
+                    break;
+                default :
+                    for (int i = 0; i < count; i++, frames += 4) {
+                        int dL = int(src[i].L) - prev.L;
+                        int dR = int(src[i].R) - prev.R;
+                        frames[0].L = prev.L + dL / 4;      // 0.25
+                        frames[0].R = prev.R + dR / 4;
+                        frames[1].L = prev.L + dL / 2;      // 0.50
+                        frames[1].R = prev.R + dR / 2;
+                        frames[2].L = prev.L + dL * 3 / 4;  // 0.75
+                        frames[2].R = prev.R + dR * 3 / 4;
+                        frames[3] = prev = src[i];          // 1.00
                     }
-                    frames[3] = prevFrame = frame;                            // 1.00 LR
-                    return 4;
-                case 22050 :
-                    if (channels == 2) {
-                        frames[0].L = prevFrame.L + dL / 2;                   // 0.50 L
-                        frames[0].R = prevFrame.R + dR / 2;                   // 0.50 R
-                    } else
-                        frames[0].L = frames[0].R = prevFrame.L + dL / 2;     // 0.50 LR
-                    frames[1] = prevFrame = frame;                            // 1.00 LR
-                    return 2;
-                default    : // impossible
-                    ASSERT(false);
-                    int k = 44100 / freq;
-                    for (int i = 0; i < k; i++) frames[i] = frame; // no lerp
-                    return k;
-            }        
+            }
+            prevFrame = prev;
+        }
+
+        virtual int decode(Frame *frames, int count) {
+            int i = 0;
+            while (i < count) {
+                if (pendingPos < pendingCount) {
+                    int part = min(count - i, pendingCount - pendingPos);
+                    memcpy(frames + i, pending + pendingPos, part * sizeof(Frame));
+                    pendingPos += part;
+                    i          += part;
+                    continue;
+                }
+
+                if (blockPos == blockCount) {
+                    blockPos   = 0;
+                    blockCount = decodeBlock(block);
+                    if (!blockCount)
+                        break;
+                }
+
+                int part = min(blockCount - blockPos, (count - i) / ratio);
+                if (!part) { // no room for the whole upsampled frame
+                    upsample(pending, block + blockPos++, 1);
+                    pendingPos   = 0;
+                    pendingCount = ratio;
+                    continue;
+                }
+
+                upsample(frames + i, block + blockPos, part);
+                blockPos += part;
+                i        += part * ratio;
+            }
+            return i;
+        }
+
+        virtual void replay() {
+            Decoder::replay();
+            blockPos = blockCount = pendingPos = pendingCount = 0;
+            memset(&prevFrame, 0, sizeof(prevFrame));
         }
     };
 
-    struct PCM : Decoder {
+    #define PCM_BLOCK_FRAMES 1024
+
+    struct PCM : BlockDecoder {
         int size, bits;
 
-        PCM(Stream *stream, int channels, int freq, int size, int bits) : Decoder(stream, channels, freq), size(size), bits(bits) {}
+        PCM(Stream *stream, int channels, int freq, int size, int bits) : BlockDecoder(stream, channels, freq, PCM_BLOCK_FRAMES), size(size), bits(bits) {}
 
-        virtual int decode(Frame *frames, int count) {
-            if (stream->pos - offset >= size) return 0;
+        virtual int decodeBlock(Frame *frames) {
+            if (bits != 16 && bits != 8 && bits != -8) {
+                ASSERT(false);
+                return 0;
+            }
 
-            // ! in the original game series only 11025 and 22050 Hz single channel samples were used ! //
+            int frameSize = channels * abs(bits) / 8;
+            int count = min(min(size - (stream->pos - offset), stream->size - stream->pos) / frameSize, blockSize);
+            if (count <= 0)
+                return 0;
+
+        // read samples into the beginning of the block and expand them to frames from the end
+            stream->raw(frames, count * frameSize);
 
-            Frame frame;
             if (bits == 16) {
-                int16 value;
+                if (channels == 1) {
+                    const int16 *src = (int16*)frames;
+                    for (int i = count - 1; i >= 0; i--)
+                        frames[i].L = frames[i].R = src[i];
+                }
+            } else {
+                int bias = bits > 0 ? 0 : 128; // unsigned or signed 8-bit
+                const uint8 *src = (uint8*)frames;
                 if (channels == 2) {
-                    frame.L = stream->read(value);
-                    frame.R = stream->read(value);
-                } else
-                    frame.L = frame.R = stream->read(value);
-            } else if (bits == 8 || bits == -8) {
-
-                if (bits > 0) {
-                    uint8 value;
-                    if (channels == 2) {
-                        frame.L = stream->read(value) * 257 - 32768;
-                        frame.R = stream->read(value) * 257 - 32768;
-                    } else
-                        frame.L = frame.R = stream->read(value) * 257 - 32768;
+                    for (int i = count - 1; i >= 0; i--) {
+                        int L = uint8(src[i * 2 + 0] + bias);
+                        int R = uint8(src[i * 2 + 1] + bias);
+                        frames[i].L = L * 257 - 32768;
+                        frames[i].R = R * 257 - 32768;
+                    }
                 } else {
-                    int8 value;
-                    if (channels == 2) {
-                        frame.L = (stream->read(value) + 128) * 257 - 32768;
-                        frame.R = (stream->read(value) + 128) * 257 - 32768;
-                    } else
-                        frame.L = frame.R = (stream->read(value) + 128) * 257 - 32768;
+                    for (int i = count - 1; i >= 0; i--)
+                        frames[i].L = frames[i].R = uint8(src[i] + bias) * 257 - 32768;
                 }
-
-            } else {
-                ASSERT(false);
-                return 0;
             }
 
-            return resample(frames, frame);
+            return count;
         }
     };
 
 #ifdef DECODE_ADPCM
-    struct ADPCM : Decoder // https://wiki.multimedia.cx/?title=Microsoft_ADPCM
+    struct ADPCM : BlockDecoder // https://wiki.multimedia.cx/?title=Microsoft_ADPCM
     {
-        int size, block;
+        int   size, block;
+        uint8 *data;
 
         struct Channel
         {
@@ -320,11 +387,9 @@ namespace Sound {
             int predicate(uint8 nibble)
             {
                 static const int table[] = { 230, 230, 230, 230, 307, 409, 512, 614, 768, 614, 512, 409, 307, 230, 230, 230 };
+                static const int nibbles[] = { 0, 1, 2, 3, 4, 5, 6, 7, -8, -7, -6, -5, -4, -3, -2, -1 };
 
-                int8 ns = nibble;
-                if (ns & 8) ns -= 16;
-
-                int sample = (sample1 * c1 + sample2 * c2) / 256 + ns * delta;
+                int sample = (sample1 * c1 + sample2 * c2) / 256 + nibbles[nibble] * delta;
                 sample  = clamp(sample, -32768, 32767);
                 sample2 = sample1;
                 sample1 = sample;
@@ -333,107 +398,95 @@ namespace Sound {
             }
         } channel[2];
 
-        ADPCM(Stream *stream, int channels, int freq, int size, int block) : Decoder(stream, channels, freq), size(size), block(block)
+        ADPCM(Stream *stream, int channels, int freq, int size, int block) : BlockDecoder(stream, channels, freq, 2 + (block - 7 * channels) * 2 / channels), size(size), block(block)
         {
+            data = new uint8[block];
             memset(channel, 0, sizeof(channel));
         }
 
-        virtual int decode(Frame *frames, int count)
+        virtual ~ADPCM()
+        {
+            delete[] data;
+        }
+
+        virtual int decodeBlock(Frame *frames)
         {
             static const int coeff1[] = { 256, 512, 0, 192, 240, 460, 392 };
             static const int coeff2[] = { 0, -256, 0, 64, 0, -208, -232 };
-            
-            int seek = stream->pos - offset;
-            if (seek >= size) return 0;
 
-            if (seek % block == 0)
+            int bytes = min(min(block, size - (stream->pos - offset)), stream->size - stream->pos);
+            if (bytes < 7 * channels) return 0;
+
+            stream->raw(data, bytes);
+
+        // block header
+            const uint8 *ptr = data;
+            for (int i = 0; i < channels; i++)
             {
-                for (int i = 0; i < channels; i++)
-                {
-                    uint8 index;
-                    stream->read(index);
-                    channel[i].c1 = coeff1[index];
-                    channel[i].c2 = coeff2[index];
-                }
-                for (int i = 0; i < channels; i++) stream->read(channel[i].delta);
-                for (int i = 0; i < channels; i++) stream->read(channel[i].sample1);
-                for (int i = 0; i < channels; i++) stream->read(channel[i].sample2);
+                int index = min(int(*ptr++), int(COUNT(coeff1)) - 1);
+                channel[i].c1 = coeff1[index];
+                channel[i].c2 = coeff2[index];
+            }
+            for (int i = 0; i < channels; i++, ptr += 2) channel[i].delta   = int16(ptr[0] | (ptr[1] << 8));
+            for (int i = 0; i < channels; i++, ptr += 2) channel[i].sample1 = int16(ptr[0] | (ptr[1] << 8));
+            for (int i = 0; i < channels; i++, ptr += 2) channel[i].sample2 = int16(ptr[0] | (ptr[1] << 8));
 
-                if (channels == 1)
-                {
-                    if (freq == 22050)
-                    {
-                        ASSERT(count >= 4);
-                        frames[0].L = frames[0].R =
-                        frames[1].L = frames[1].R = channel[0].sample2;
-                        frames[2].L = frames[2].R =
-                        frames[3].L = frames[3].R = channel[0].sample1;
-                        return 4;
-                    } else {
-                        ASSERT(count >= 2);
-                        frames[0].L = frames[0].R = channel[0].sample2;
-                        frames[1].L = frames[1].R = channel[0].sample1;
-                        return 2;
-                    }
-                } else {
-                    ASSERT(freq == 44100);
-                    ASSERT(count >= 2);
-                    frames[0].L = channel[0].sample2;
-                    frames[0].R = channel[1].sample2;
-                    frames[1].L = channel[0].sample1;
-                    frames[1].R = channel[1].sample1;
-                    return 2;
-                }
-            } else {
-                uint8 value;
-                stream->read(value);
-                uint8 n1 = value >> 4, n2 = value & 0xF;
+            const uint8 *end = data + bytes;
 
-                if (channels == 1)
+            if (channels == 1)
+            {
+                Channel &c = channel[0];
+                frames[0].L = frames[0].R = c.sample2;
+                frames[1].L = frames[1].R = c.sample1;
+
+                int count = 2;
+                while (ptr < end)
                 {
-                    if (freq == 22050)
-                    {
-                        ASSERT(count >= 4);
-                        frames[0].L = frames[0].R =
-                        frames[1].L = frames[1].R = channel[0].predicate(n1);
-                        frames[2].L = frames[2].R =
-                        frames[3].L = frames[3].R = channel[0].predicate(n2);
-                        return 4;
-                    } else {
-                        ASSERT(count >= 2);
-                        frames[0].L = frames[0].R = channel[0].predicate(n1);
-                        frames[1].L = frames[1].R = channel[0].predicate(n2);
-                        return 2;
-                    }
-                } else {
-                    ASSERT(freq == 44100);
-                    frames[0].L = channel[0].predicate(n1);
-                    frames[0].R = channel[1].predicate(n2);
-                    return 1;
+                    uint8 value = *ptr++;
+                    frames[count].L = frames[count].R = c.predicate(value >> 4);
+                    count++;
+                    frames[count].L = frames[count].R = c.predicate(value & 0xF);
+                    count++;
                 }
+                return count;
+            }
+
+            frames[0].L = channel[0].sample2;
+            frames[0].R = channel[1].sample2;
+            frames[1].L = channel[0].sample1;
+            frames[1].R = channel[1].sample1;
+
+            int count = 2;
+            while (ptr < end)
+            {
+                uint8 value = *ptr++;
+                frames[count].L = channel[0].predicate(value >> 4);
+                frames[count].R = channel[1].predicate(value & 0xF);
+                count++;
             }
+            return count;
         }
     };
 #endif
 
 #ifdef DECODE_IMA
-    struct IMA : Decoder { // https://wiki.multimedia.cx/?title=Microsoft_ADPCM
+    #define IMA_BLOCK_BYTES 512
+
+    struct IMA : BlockDecoder { // https://wiki.multimedia.cx/?title=Microsoft_ADPCM
         struct State {
             int amp, idx;
         } state[2];
 
-        int freq;
-
-        IMA(Stream *stream, int channels, int freq) : Decoder(stream, channels, freq) { 
+        IMA(Stream *stream, int channels, int freq) : BlockDecoder(stream, channels, freq, IMA_BLOCK_BYTES * 2) {
             memset(state, 0, sizeof(state)); 
         }
 
         int16 getSample(uint8 n, State &state) {
-            static int indexLUT[] = {
+            static const int indexLUT[] = {
                 -1, -1, -1, -1, 2, 4, 6, 8,
             };
 
-            static int stepLUT[] = {
+            static const int stepLUT[] = {
                 7,     8,     9,     10,    11,    12,    13,    14,
                 16,    17,    19,    21,    23,    25,    28,    31,
                 34,    37,    41,    45,    50,    55,    60,    66,
@@ -468,96 +521,76 @@ namespace Sound {
             return state.amp;
         }
 
-        virtual int decode(Frame *frames, int count) {
-            uint8 n;
-            stream->read(n);
+        virtual int decodeBlock(Frame *frames) {
+            int bytes = min(stream->size - stream->pos, IMA_BLOCK_BYTES);
+            if (bytes <= 0) return 0;
 
-            int a = getSample(n >> 4, state[0]);
-            int b = getSample(n,      state[1 % channels]);
+        // unpack into the second half of the block, the frames are written from the start
+            uint8 *data = (uint8*)(frames + blockSize) - bytes;
+            stream->raw(data, bytes);
 
-            Frame frame;
             if (channels == 2) {
-                frame.L = a;
-                frame.R = b;
-                return resample(frames, frame);
-            } else {
-                frame.L = frame.R = a;
-                int i = resample(frames, frame);
-                frame.L = frame.R = b;
-                return i + resample(frames + i, frame);
+                for (int i = 0; i < bytes; i++) {
+                    uint8 n = data[i];
+                    frames[i].L = getSample(n >> 4, state[0]);
+                    frames[i].R = getSample(n,      state[1]);
+                }
+                return bytes;
+            }
+
+            for (int i = 0; i < bytes; i++) {
+                uint8 n = data[i];
+                int16 a = getSample(n >> 4, state[0]);
+                int16 b = getSample(n,      state[0]);
+                frames[i * 2 + 0].L = frames[i * 2 + 0].R = a;
+                frames[i * 2 + 1].L = frames[i * 2 + 1].R = b;
             }
+            return bytes * 2;
         }
     };
 #endif
 
 #ifdef DECODE_VAG
-    struct VAG : Decoder {
-        uint8 pred, shift, flags;
-        int s1, s2;
-        Frame buffer[28 * 4];
-        int bufferSize;
+    #define VAG_BLOCK_SIZE   16
+    #define VAG_BLOCK_FRAMES 28
+    #define VAG_BLOCKS       32 // blocks decoded at once
 
-        VAG(Stream *stream) : Decoder(stream, 1, 11025), s1(0), s2(0), bufferSize(0) {
-            memset(buffer, 0, sizeof(buffer));
-        }
-
-        void predicate(short value) {
-            int s = (s1 * SPU_POS[pred] + s2 * SPU_NEG[pred]) >> 6;
-            s = clamp((value >> shift) + s, -32768, 32767);
-            s2 = s1;
-            s1 = s;
-        }
+    struct VAG : BlockDecoder {
+        int   s1, s2;
+        uint8 data[VAG_BLOCK_SIZE * VAG_BLOCKS];
 
-        void resample(Frame *frames, short value) {
-            predicate(value);
-            frames[0].L = frames[0].R = s2 + (s1 - s2) / 4;  // 0.25
-            frames[1].L = frames[1].R = s2 + (s1 - s2) / 2;  // 0.50
-            frames[2].L = frames[2].R = s1 - (s1 - s2) / 4;  // 0.75
-            frames[3].L = frames[3].R = s1;                  // 1.00
-        }
+        VAG(Stream *stream) : BlockDecoder(stream, 1, 11025, VAG_BLOCK_FRAMES * VAG_BLOCKS), s1(0), s2(0) {}
 
-        int processBlock() {
-            if (stream->pos >= stream->size)
+        virtual int decodeBlock(Frame *frames) {
+            int blocks = min((stream->size - stream->pos) / VAG_BLOCK_SIZE, VAG_BLOCKS);
+            if (blocks <= 0)
                 return 0;
-            stream->read(pred);
-            stream->read(flags);
-            shift = pred & 0x0F;
-            pred >>= 4;
-
-            int i = 0;
-            while (i < 14) {
-                uint8 d;
-                stream->read(d);
-                resample(&buffer[i * 8 + 0], (d & 0x0F) << 12);
-                resample(&buffer[i * 8 + 4], (d & 0xF0) <<  8);
-                i++;
-            }
-            return i * 8;
-        }
 
-        virtual int decode(Frame *frames, int count) {
-            int res = 0;
-
-            while (res < count) {
-                if (!bufferSize && !(bufferSize = processBlock())) // if no data in buffer - process next block
-                    break;
-
-                int length = min(bufferSize, count - res);
-                memcpy(&frames[res], buffer, length * sizeof(Frame));
-                res += length;
-
-                if (bufferSize -= length) { // if data remained in buffer, move it to the beginning
-                    for (int i = 0; i < bufferSize; i++) {
-                        buffer[i] = buffer[sizeof(buffer) / sizeof(Frame) - bufferSize + i];
-                    }
-                    break;
+            stream->raw(data, blocks * VAG_BLOCK_SIZE);
+
+            for (int b = 0; b < blocks; b++) {
+                const uint8 *ptr = data + b * VAG_BLOCK_SIZE;
+                int shift = ptr[0] & 0x0F;
+                int pred  = min(ptr[0] >> 4, int(COUNT(SPU_POS)) - 1);
+                int f0    = SPU_POS[pred];
+                int f1    = SPU_NEG[pred];
+                ptr += 2; // skip predictor and flags
+
+                for (int i = 0; i < VAG_BLOCK_FRAMES; i++) {
+                    int value = int16((i & 1) ? (ptr[i >> 1] & 0xF0) << 8 : (ptr[i >> 1] & 0x0F) << 12);
+                    int s = clamp((value >> shift) + ((s1 * f0 + s2 * f1) >> 6), -32768, 32767);
+                    s2 = s1;
+                    s1 = s;
+                    frames->L = frames->R = s;
+                    frames++;
                 }
             }
 
-            return res;
+            return blocks * VAG_BLOCK_FRAMES;
         }
 
         virtual void replay() {
+            BlockDecoder::replay();
             stream->setPos(0);
             s1 = s2 = 0;
         }
@@ -694,35 +727,136 @@ namespace Sound {
     };
 #endif
 
+// sliding window over the compressed stream, the memory doesn't depend on the track length
+    struct StreamWindow {
+        Stream *stream;
+        uint8  *data;
+        int    capacity, start, end;
+
+        StreamWindow(Stream *stream) : stream(stream), data(new uint8[SND_STREAM_CHUNK * 4]), capacity(SND_STREAM_CHUNK * 4), start(0), end(0) {}
+
+        ~StreamWindow() {
+            delete[] data;
+        }
+
+        void reset() {
+            start = end = 0;
+        }
+
+        uint8* ptr() {
+            return data + start;
+        }
+
+        int available() {
+            return end - start;
+        }
+
+        void consume(int count) {
+            start += count;
+        }
+
+    // shift unprocessed data to the front and append the next chunk, false at the end of the stream
+        bool fill() {
+            if (start) {
+                memmove(data, data + start, end - start);
+                end  -= start;
+                start = 0;
+            }
+
+            if (end == capacity) {
+                if (capacity >= SND_STREAM_MAX)
+                    return false;
+                uint8 *tmp = new uint8[capacity * 2];
+                memcpy(tmp, data, end);
+                delete[] data;
+                data      = tmp;
+                capacity *= 2;
+            }
+
+            int count = min(min(SND_STREAM_CHUNK, capacity - end), stream->size - stream->pos);
+            if (count <= 0)
+                return false;
+
+            stream->raw(data + end, count);
+            end += count;
+            return true;
+        }
+    };
+
 #ifdef DECODE_MP3
+    #define MP3_FRAME_MAX   4096        // enough data for any mp3 frame
+    #define MP3_SAMPLES_MAX (1152 * 2)
+
     struct MP3 : Decoder {
         mp3_decoder_t   mp3;
-        char    *buffer;
-        int     size, pos;        
+        StreamWindow    window;
+        Frame           pcm[MP3_SAMPLES_MAX];
+        int             pcmPos, pcmCount;
+        bool            tagChecked;
 
-        MP3(Stream *stream, int channels) : Decoder(stream, channels, 0), size(stream->size), pos(0) {
+        MP3(Stream *stream, int channels) : Decoder(stream, channels, 0), window(stream), pcmPos(0), pcmCount(0), tagChecked(false) {
             mp3 = mp3_create();
-            buffer = new char[size]; // TODO: file streaming
-            stream->raw(buffer, size);
+        }
+
+    // ID3v2 tag can be larger than the window (cover art), skip it by the synchsafe size
+        void skipTag() {
+            tagChecked = true;
+
+            uint8 *h = window.ptr();
+            if (window.available() < 10 || h[0] != 'I' || h[1] != 'D' || h[2] != '3')
+                return;
+
+            int size = 10 + ((h[6] & 0x7F) << 21) + ((h[7] & 0x7F) << 14) + ((h[8] & 0x7F) << 7) + (h[9] & 0x7F);
+            if (h[5] & 0x10) {
+                size += 10; // footer
+            }
+
+            int avail = window.available();
+            if (size <= avail) {
+                window.consume(size);
+            } else {
+                window.consume(avail);
+                stream->seek(min(size - avail, stream->size - stream->pos));
+            }
         }
 
         virtual ~MP3() {
-            delete[] buffer;
             mp3_done(mp3);
         }
 
         virtual int decode(Frame *frames, int count) {
-            mp3_info_t info;
             int i = 0;
-            char *ptr = (char*)frames;
-            while (ptr < (char*)&frames[count]) {
-                int res = mp3_decode(mp3, buffer + pos, size - pos, (short*)ptr, &info);
-                if (res) {
-                    pos += res;
-                    ptr += info.audio_bytes;
-                    i   += info.audio_bytes;
-                } else
-                    break;
+            while (i < count) {
+                if (pcmPos == pcmCount) {
+                    if (window.available() < MP3_FRAME_MAX)
+                        window.fill();
+
+                    if (!tagChecked) {
+                        skipTag();
+                        continue;
+                    }
+
+                    if (!window.available())
+                        break;
+
+                    mp3_info_t info;
+                    int res = mp3_decode(mp3, window.ptr(), window.available(), (short*)pcm, &info);
+                    if (!res) {
+                        if (window.fill())
+                            continue; // no frame sync in the window yet, read more
+                        break;
+                    }
+
+                    window.consume(res);
+                    pcmPos   = 0;
+                    pcmCount = min(info.audio_bytes / int(sizeof(Frame)), MP3_SAMPLES_MAX);
+                    continue;
+                }
+
+                int part = min(count - i, pcmCount - pcmPos);
+                memcpy(frames + i, pcm + pcmPos, part * sizeof(Frame));
+                pcmPos += part;
+                i      += part;
             }
             return i;
         }
@@ -730,7 +864,10 @@ namespace Sound {
         virtual void replay() {
             mp3_done(mp3);
             mp3 = mp3_create();
-            pos = 0;
+            Decoder::replay();
+            window.reset();
+            pcmPos = pcmCount = 0;
+            tagChecked = false;
         }
     };
 #endif
@@ -740,20 +877,37 @@ namespace Sound {
 #ifdef USE_LIBVORBIS
     struct OGG : Decoder {
         OggVorbis_File   vf;
-        FILE            *memFile;
-        uint8           *data;
 
-        OGG(Stream *stream, int channels) : Decoder(stream, channels, 0) {
-            char buf[255];
-            strcpy(buf, contentDir);
-            strcat(buf, stream->name);
+        static size_t streamRead(void *ptr, size_t size, size_t nmemb, void *datasource) {
+            Stream *stream = ((OGG*)datasource)->stream;
+            int count = min(int(size * nmemb), stream->size - stream->pos);
+            if (count <= 0)
+                return 0;
+            stream->raw(ptr, count);
+            return count / size;
+        }
 
-            data = new uint8[stream->size];
-            stream->raw(data, stream->size);
+        static int streamSeek(void *datasource, ogg_int64_t offset, int whence) {
+            OGG *ogg = (OGG*)datasource;
+            switch (whence) {
+                case SEEK_SET : ogg->stream->setPos(ogg->offset + int(offset));       break;
+                case SEEK_CUR : ogg->stream->seek(int(offset));                       break;
+                case SEEK_END : ogg->stream->setPos(ogg->stream->size + int(offset)); break;
+            }
+            return 0;
+        }
 
-            memFile = fmemopen(data, stream->size, "rb");
-            int err = ov_open(memFile, &vf, NULL, 0);
-            ASSERT(err >= 0);
+        static int streamClose(void *datasource) {
+            return 0;
+        }
+
+        static long streamTell(void *datasource) {
+            OGG *ogg = (OGG*)datasource;
+            return ogg->stream->pos - ogg->offset;
+        }
+
+        OGG(Stream *stream, int channels) : Decoder(stream, channels, 0) {
+            open();
             vorbis_info *info = ov_info(&vf, -1);
             this->channels = info->channels;
             this->freq     = info->rate;
@@ -761,8 +915,12 @@ namespace Sound {
 
         virtual ~OGG() {
             ov_clear(&vf);
-            fclose(memFile);
-            delete[] data;
+        }
+
+        void open() {
+            ov_callbacks callbacks = { streamRead, streamSeek, streamClose, streamTell };
+            int err = ov_open_callbacks(this, &vf, NULL, 0, callbacks);
+            ASSERT(err >= 0);
         }
 
         virtual int decode(Frame *frames, int count) {
@@ -772,65 +930,313 @@ namespace Sound {
             while (i < bytes) {
                 int bitstream;
                 int res = ov_read(&vf, (char*)frames + i, bytes - i, &bitstream);
-                if (!res) break;
+                if (res <= 0) break;
                 i += res;
             }
             return i / sizeof(Frame);
         }
 
         virtual void replay() {
-            fseek(memFile, 0, SEEK_SET);
-            ov_open(memFile, &vf, NULL, 0);
+            ov_clear(&vf);
+            Decoder::replay();
+            open();
         }
     };
 #else // stb_vorbis
     struct OGG : Decoder {
         stb_vorbis       *ogg;
         stb_vorbis_alloc alloc;
-        uint8            *data;
-
-        OGG(Stream *stream, int channels) : Decoder(stream, channels, 0) {
-            char buf[255];
-            strcpy(buf, contentDir);
-            strcat(buf, stream->name);
-
-            data = new uint8[stream->size];
-            stream->raw(data, stream->size);
+        StreamWindow     window;
+        float            **outputs;
+        int              outPos, outCount, outChannels;
 
+        OGG(Stream *stream, int channels) : Decoder(stream, channels, 0), window(stream) {
             alloc.alloc_buffer_length_in_bytes = 256 * 1024;
             alloc.alloc_buffer = new char[alloc.alloc_buffer_length_in_bytes];
-            ogg = stb_vorbis_open_memory(data, stream->size, NULL, &alloc);
+
+            open();
             ASSERT(ogg);
-            stb_vorbis_info info = stb_vorbis_get_info(ogg);
-            this->channels = info.channels;
-            this->freq     = info.sample_rate;
+            if (ogg) {
+                stb_vorbis_info info = stb_vorbis_get_info(ogg);
+                this->channels = info.channels;
+                this->freq     = info.sample_rate;
+            }
         }
 
         virtual ~OGG() {
-            stb_vorbis_close(ogg);
+            if (ogg)
+                stb_vorbis_close(ogg);
             delete[] alloc.alloc_buffer;
-            delete[] data;
+        }
+
+        void open() {
+            outPos = outCount = 0;
+            window.reset();
+
+            do {
+                int used, error;
+                ogg = stb_vorbis_open_pushdata(window.ptr(), window.available(), &used, &error, &alloc);
+                if (ogg) {
+                    window.consume(used);
+                    break;
+                }
+                if (error != VORBIS_need_more_data)
+                    break;
+            } while (window.fill());
         }
 
         virtual int decode(Frame *frames, int count) {
             PROFILE_CPU_TIMING(stats.ogg);
+            if (!ogg) return 0;
+
             int i = 0;
             while (i < count) {
-                int res = stb_vorbis_get_samples_short_interleaved(ogg, channels, (short*)frames + i, (count - i) * 2);
-                if (!res) break;
-                i += res;
+                if (outPos == outCount) {
+                    int samples;
+                    int used = stb_vorbis_decode_frame_pushdata(ogg, window.ptr(), window.available(), &outChannels, &outputs, &samples);
+                    window.consume(used);
+
+                    if (!used && !samples) { // need more data
+                        if (!window.fill())
+                            break;
+                        continue;
+                    }
+
+                    outPos   = 0;
+                    outCount = samples;
+                    continue;
+                }
+
+                const float *L = outputs[0];
+                const float *R = outputs[outChannels > 1 ? 1 : 0];
+
+                int part = min(count - i, outCount - outPos);
+                for (int j = 0; j < part; j++) {
+                    frames[i + j].L = int16(clamp(int(L[outPos + j] * 32767.0f), -32768, 32767));
+                    frames[i + j].R = int16(clamp(int(R[outPos + j] * 32767.0f), -32768, 32767));
+                }
+                outPos += part;
+                i      += part;
             }
             return i;
         }
 
         virtual void replay() {
-            stb_vorbis_seek_start(ogg);
+            if (ogg)
+                stb_vorbis_close(ogg);
+            Decoder::replay();
+            open();
         }
     };
 #endif
 
 #endif // DECODE_OGG
 
+    bool offline; // mixing runs faster than real time (offline rendering), decode in place
+
+#ifdef DECODE_THREAD
+    #define SND_LOAD(x)     __atomic_load_n(&(x), __ATOMIC_ACQUIRE)
+    #define SND_STORE(x, v) __atomic_store_n(&(x), (v), __ATOMIC_RELEASE)
+
+    struct PrefetchJob;
+
+// decoder thread, keeps PCM rings of the music channels filled
+    namespace DecodeThread {
+        PrefetchJob     *first;  // pushed under the mutex, unlinked by the thread only
+        pthread_t       thread;
+        pthread_mutex_t mutex;
+        pthread_cond_t  cond;
+        bool            running;
+
+        void wake() {
+            pthread_cond_signal(&cond);
+        }
+    }
+
+// PCM ring of a music channel, owned by the decoder thread
+// the audio thread never blocks on it, dead jobs are unlinked and released by the decoder thread
+    struct PrefetchJob {
+        Decoder     *source;
+        PrefetchJob *next;
+        Frame       *ring;
+        uint32      head;          // written by the decoder thread
+        uint32      tail;          // read by the audio thread
+        bool        ended;
+        bool        replayRequest;
+        bool        dead;          // the channel is released
+
+        PrefetchJob(Decoder *source) : source(source), next(NULL), head(0), tail(0), ended(false), replayRequest(false), dead(false) {
+            ring = new Frame[SND_PREFETCH_FRAMES];
+        }
+
+        ~PrefetchJob() {
+            delete source;
+            delete[] ring;
+        }
+
+    // decoder thread side, returns true if there is more work to do
+        bool process() {
+            if (SND_LOAD(replayRequest)) {
+                source->replay();
+                head  = tail = 0;
+                ended = false;
+                SND_STORE(replayRequest, false);
+            }
+
+            if (ended)
+                return false;
+
+            int free = SND_PREFETCH_FRAMES - int(head - SND_LOAD(tail));
+            if (free < SND_PREFETCH_CHUNK)
+                return false;
+
+            int pos   = head & (SND_PREFETCH_FRAMES - 1);
+            int count = min(SND_PREFETCH_CHUNK, SND_PREFETCH_FRAMES - pos);
+            int res   = source->decode(ring + pos, count);
+
+            if (!res) {
+                SND_STORE(ended, true);
+                return false;
+            }
+
+            SND_STORE(head, head + res);
+            return true;
+        }
+    };
+
+// wraps a music decoder, the audio thread only copies already decoded frames from the ring
+    struct Prefetch : Decoder {
+        PrefetchJob *job;
+
+        Prefetch(Decoder *source) : Decoder(NULL, source->channels, source->freq) {
+            job = new PrefetchJob(source);
+
+            pthread_mutex_lock(&DecodeThread::mutex);
+            job->next = DecodeThread::first;
+            DecodeThread::first = job;
+            pthread_mutex_unlock(&DecodeThread::mutex);
+
+            DecodeThread::wake();
+        }
+
+        virtual ~Prefetch() { // called by the mixer, hand the job over to the decoder thread
+            SND_STORE(job->dead, true);
+            DecodeThread::wake();
+        }
+
+        virtual int decode(Frame *frames, int count) {
+            if (SND_LOAD(job->replayRequest)) { // rewinding, play silence
+                memset(frames, 0, sizeof(Frame) * count);
+                return count;
+            }
+
+            bool end  = SND_LOAD(job->ended);
+            int avail = int(SND_LOAD(job->head) - job->tail);
+
+            if (!avail) {
+                if (end)
+                    return 0;
+                memset(frames, 0, sizeof(Frame) * count); // underrun
+                return count;
+            }
+
+            count = min(count, avail);
+            for (int i = 0; i < count; i++)
+                frames[i] = job->ring[(job->tail + i) & (SND_PREFETCH_FRAMES - 1)];
+            SND_STORE(job->tail, job->tail + count);
+
+            return count;
+        }
+
+        virtual void replay() {
+            SND_STORE(job->replayRequest, true);
+            DecodeThread::wake();
+        }
+    };
+
+    namespace DecodeThread {
+        void* decodeProc(void *arg) {
+            pthread_mutex_lock(&mutex);
+            while (running) {
+                bool busy = false;
+
+            // the mutex is released while decoding, new jobs are pushed to the list head only
+                PrefetchJob **p = &first;
+                while (*p) {
+                    PrefetchJob *job = *p;
+
+                    if (SND_LOAD(job->dead)) {
+                        *p = job->next;
+                        pthread_mutex_unlock(&mutex);
+                        delete job;
+                        pthread_mutex_lock(&mutex);
+                        continue;
+                    }
+
+                    pthread_mutex_unlock(&mutex);
+                    busy |= job->process();
+                    pthread_mutex_lock(&mutex);
+
+                    p = &job->next;
+                }
+
+                if (!busy) {
+                    timespec t;
+                    clock_gettime(CLOCK_REALTIME, &t);
+                    t.tv_nsec += SND_PREFETCH_SLEEP * 1000000;
+                    if (t.tv_nsec >= 1000000000) {
+                        t.tv_sec++;
+                        t.tv_nsec -= 1000000000;
+                    }
+                    pthread_cond_timedwait(&cond, &mutex, &t);
+                }
+            }
+            pthread_mutex_unlock(&mutex);
+            return NULL;
+        }
+
+        void init() {
+            first = NULL;
+            pthread_mutex_init(&mutex, NULL);
+            pthread_cond_init(&cond, NULL);
+            running = true;
+            if (pthread_create(&thread, NULL, decodeProc, NULL) != 0) {
+                LOG("! sound: decoder thread failed\n");
+                running = false;
+            }
+        }
+
+        void deinit() {
+            if (running) {
+                pthread_mutex_lock(&mutex);
+                running = false;
+                pthread_cond_signal(&cond);
+                pthread_mutex_unlock(&mutex);
+                pthread_join(thread, NULL);
+            }
+
+            while (first) {
+                PrefetchJob *job = first;
+                first = job->next;
+                delete job;
+            }
+
+            pthread_cond_destroy(&cond);
+            pthread_mutex_destroy(&mutex);
+        }
+    }
+
+    Decoder* prefetch(Decoder *decoder) {
+        if (!decoder || !DecodeThread::running || offline)
+            return decoder;
+        return new Prefetch(decoder);
+    }
+#else
+    Decoder* prefetch(Decoder *decoder) {
+        return decoder;
+    }
+#endif
+
     Core::Mutex lock;
 
     struct Listener
@@ -923,10 +1329,14 @@ namespace Sound {
                 stream->seek(-4);
                 #ifdef DECODE_OGG
                     decoder = new OGG(stream, 2);
-                #endif 
+                    if (flags & MUSIC)
+                        decoder = prefetch(decoder);
+                #endif
             } else if (fourcc == FOURCC("ID3\3")) { // mp3
                 #ifdef DECODE_MP3
                     decoder = new MP3(stream, 2);
+                    if (flags & MUSIC)
+                        decoder = prefetch(decoder);
                 #endif
             } else if (fourcc == FOURCC("SEGA")) { // Sega Saturn PCM mono signed 8-bit 11025 Hz
                 decoder = new PCM(stream, 1, 11025, stream->size, -8);
@@ -1080,6 +1490,7 @@ namespace Sound {
 
     FrameHI *result;
     Frame   *buffer;
+    int     resultSize;
 
     // TODO: per listener
     Filter::Reverberation reverb;
@@ -1092,9 +1503,13 @@ namespace Sound {
         callback = NULL;
         buffer = NULL;
         result = NULL;
+        resultSize = 0;
     #ifdef DECODE_MP3
         mp3_decode_init();
     #endif
+    #ifdef DECODE_THREAD
+        DecodeThread::init();
+    #endif
     }
 
     void deinit()
@@ -1103,6 +1518,9 @@ namespace Sound {
         {
             delete channels[i];
         }
+    #ifdef DECODE_THREAD
+        DecodeThread::deinit(); // after the channels, frees the jobs they released
+    #endif
     #ifdef DECODE_MP3
         mp3_decode_free();
     #endif
@@ -1184,8 +1602,17 @@ namespace Sound {
         OS_LOCK(lock);
         PROFILE_CPU_TIMING(stats.mixer);
 
+        if (count > resultSize) // sinks may change the period size
+        {
+            delete[] result;
+            delete[] buffer;
+            result = new FrameHI[count];
+            buffer = NULL;
+            resultSize = count;
+        }
+
         if (!channelsCount) {
-            if (result && (Core::settings.audio.music != 0 || Core::settings.audio.sound != 0)) {
+            if (Core::settings.audio.music != 0 || Core::settings.audio.sound != 0) {
                 memset(result, 0, sizeof(FrameHI) * count);
 
                 if (Core::settings.audio.reverb)
@@ -1200,11 +1627,6 @@ namespace Sound {
             return;
         }
 
-        if (!result)
-        {
-            result = new FrameHI[count];
-        }
-
         memset(result, 0, sizeof(FrameHI) * count);
 
         if (Core::settings.audio.sound != 0)
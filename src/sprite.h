@@ -4,6 +4,8 @@
 #include "controller.h"
 
 struct Sprite : Controller {
+    DECL_POOL(Sprite, 32);
+
 
     enum {
         FRAME_ANIMATED = -1,
@@ -795,20 +795,22 @@ struct Atlas {
         }
     } *root;
 
-    int      tilesCount;
-    int      size;
-    int      width, height;
-    short4   border;
-    void     *userData;
-    Callback *callback;
-
-    Atlas(int maxTiles, short4 border, void *userData, Callback *callback) : root(NULL), tilesCount(0), size(0), border(border), userData(userData), callback(callback) {
+    int        tilesCount;
+    int        size;
+    int        width, height;
+    short4     border;
+    void       *userData;
+    Callback   *callback;
+    AtlasColor *data; // packed pixels, valid until the atlas is destroyed
+
+    Atlas(int maxTiles, short4 border, void *userData, Callback *callback) : root(NULL), tilesCount(0), size(0), border(border), userData(userData), callback(callback), data(NULL) {
         tiles = new Tile[maxTiles];
     }
 
     ~Atlas() {
         delete root;
         delete[] tiles;
+        delete[] data;
     }
 
     void add(uint16 id, short4 uv, TR::TextureInfo *tex) {
@@ -880,7 +882,8 @@ struct Atlas {
 
         delete[] indices;
 
-        AtlasColor *data = new AtlasColor[width * height];
+        delete[] data;
+        data = new AtlasColor[width * height];
         memset(data, 0, width * height * sizeof(data[0]));
         fill(root, data);
         fillInstances();
@@ -889,7 +892,6 @@ struct Atlas {
 
         //Texture::SaveBMP("atlas", (char*)data, width, height);
 
-        delete[] data;
         return atlas;
     };
 
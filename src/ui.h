@@ -107,7 +107,7 @@ namespace UI {
         UI::advGlyphsStart = level.spriteTexturesCount;
 
     // init new sprites array with additional sprites
-        TR::TextureInfo *newSprites = new TR::TextureInfo[level.spriteTexturesCount + RU_GLYPH_COUNT + JA_GLYPH_COUNT + GR_GLYPH_COUNT + CN_GLYPH_COUNT];
+        TR::TextureInfo *newSprites = level.alloc<TR::TextureInfo>(level.spriteTexturesCount + RU_GLYPH_COUNT + JA_GLYPH_COUNT + GR_GLYPH_COUNT + CN_GLYPH_COUNT, TR::Level::MEM_TEXTURES);
 
     // copy original sprites
         memcpy(newSprites, level.spriteTextures, sizeof(TR::TextureInfo) * level.spriteTexturesCount);
@@ -142,14 +142,16 @@ namespace UI {
 
         level.spriteTexturesCount += RU_GLYPH_COUNT + JA_GLYPH_COUNT + GR_GLYPH_COUNT + CN_GLYPH_COUNT;
 
-        delete[] level.spriteTextures;
         TR::gSpriteTextures      = level.spriteTextures = newSprites;
         TR::gSpriteTexturesCount = level.spriteTexturesCount;
     }
 
+    inline bool isWideLanguage(int lang) {
+        return lang == STR_LANG_JA || lang == STR_LANG_GR || lang == STR_LANG_CN;
+    }
+
     bool isWideCharStart(char c) {
-        int lang = Core::settings.audio.language + STR_LANG_EN;
-        if (lang == STR_LANG_JA || lang == STR_LANG_GR || lang == STR_LANG_CN)
+        if (isWideLanguage(Core::settings.audio.language + STR_LANG_EN))
             return c == '\x11';
         return false;
     }
@@ -191,6 +193,165 @@ namespace UI {
         return glyph;
     }
 
+#ifndef SPLIT_BY_TILE
+// additional glyph pages, decoded once per process and kept in compact form
+    enum GlyphSet { GLYPHS_RU, GLYPHS_JA, GLYPHS_GR, GLYPHS_CN, GLYPHS_MAX };
+
+    struct GlyphPage {
+        const uint8 *data;    // 8-bit palette indices (RU) or 1-bit mask rows (embedded BMP data)
+        Color32     *palette; // NULL for 1-bit pages
+        int32        width, height;
+        int32        stride;  // negative for bottom-up rows
+    };
+
+    GlyphPage glyphPages[GLYPHS_MAX];
+    bool      glyphPagesReady;
+
+    uint32    glyphsUsed[(CN_GLYPH_COUNT + 31) / 32];
+    int       glyphsUsedLang = -1;
+
+    void initGlyphPage1bpp(GlyphPage &page, const uint8 *data, int size) {
+        int32  offset;
+        uint16 bpp;
+        Stream stream(NULL, data, size);
+        stream.seek(10);
+        stream.read(offset);
+        stream.seek(4);
+        stream.read(page.width);
+        stream.read(page.height);
+        stream.seek(2);
+        stream.read(bpp);
+        ASSERT(bpp == 1);
+    // point to the top row of bottom-up monochrome image
+        page.stride  = page.width / 8;
+        page.data    = data + offset + (page.height - 1) * page.stride;
+        page.stride  = -page.stride;
+        page.palette = NULL;
+    }
+
+    void initGlyphPage8bpp(GlyphPage &page, const uint8 *data, int size) {
+        uint32 width, height;
+        Stream stream(NULL, data, size);
+        Color32 *rgba = (Color32*)Texture::LoadPNG(stream, width, height);
+
+        uint8 *indices = new uint8[width * height];
+        page.palette = new Color32[256];
+        int count = 0;
+
+        for (uint32 i = 0; i < width * height; i++) {
+            int index = 0;
+            while (index < count && page.palette[index].value != rgba[i].value) {
+                index++;
+            }
+            if (index == count) {
+                ASSERT(count < 256);
+                page.palette[count++] = rgba[i];
+            }
+            indices[i] = index;
+        }
+        delete[] rgba;
+
+        page.data   = indices;
+        page.width  = width;
+        page.height = height;
+        page.stride = width;
+    }
+
+    void initGlyphPages() {
+        if (glyphPagesReady) return;
+        initGlyphPage8bpp(glyphPages[GLYPHS_RU], GLYPH_RU, size_GLYPH_RU);
+        initGlyphPage1bpp(glyphPages[GLYPHS_JA], GLYPH_JA, size_GLYPH_JA);
+        initGlyphPage1bpp(glyphPages[GLYPHS_GR], GLYPH_GR, size_GLYPH_GR);
+        initGlyphPage1bpp(glyphPages[GLYPHS_CN], GLYPH_CN, size_GLYPH_CN);
+        glyphPagesReady = true;
+    }
+
+    void freeGlyphPages() {
+        if (!glyphPagesReady) return;
+        delete[] glyphPages[GLYPHS_RU].data;
+        delete[] glyphPages[GLYPHS_RU].palette;
+        glyphPagesReady = false;
+    }
+
+// rasterize glyphs rect of 256x256 atlas page (see Level::getAdvGlyphPage)
+    void fillGlyphs(AtlasTile *dst, int atlasPage, const short4 &uv) {
+        initGlyphPages();
+
+        int set, y0;
+        if (atlasPage == 0) {
+            set = GLYPHS_RU; y0 = 0;
+        } else if (atlasPage < 3) {
+            set = GLYPHS_JA; y0 = (atlasPage - 1) * 256;
+        } else if (atlasPage == 3) {
+            set = GLYPHS_GR; y0 = 0;
+        } else {
+            set = GLYPHS_CN; y0 = (atlasPage - 4) * 256;
+        }
+
+        const GlyphPage &page = glyphPages[set];
+        ASSERT(uv.z <= page.width && y0 + uv.w <= page.height);
+
+        AtlasColor *ptr = &dst->color[uv.y * 256];
+        for (int y = uv.y; y < uv.w; y++) {
+            const uint8 *src = page.data + (y0 + y) * page.stride;
+            for (int x = uv.x; x < uv.z; x++) {
+                Color32 c;
+                if (page.palette) {
+                    c = page.palette[src[x]];
+                } else {
+                    c = ((src[x >> 3] << (x & 7)) & 0x80) ? 0xFFFFFFFF : 0x00FFFFFF;
+                }
+                ptr[x] = c;
+            }
+            ptr += 256;
+        }
+    }
+
+// check if additional glyph sprite is referenced by the current language strings
+    bool isAdvGlyphUsed(int index) {
+        index -= advGlyphsStart;
+        if (index < RU_GLYPH_COUNT) return true; // cyrillic and accent glyphs are shared between languages
+        index -= RU_GLYPH_COUNT;
+
+        int glyphLang;
+        if (index < JA_GLYPH_COUNT) {
+            glyphLang = STR_LANG_JA;
+        } else if ((index -= JA_GLYPH_COUNT) < GR_GLYPH_COUNT) {
+            glyphLang = STR_LANG_GR;
+        } else {
+            index -= GR_GLYPH_COUNT;
+            glyphLang = STR_LANG_CN;
+        }
+
+        int lang = Core::settings.audio.language + STR_LANG_EN;
+        if (glyphLang != lang)
+            return false;
+
+        if (glyphsUsedLang != lang) {
+            glyphsUsedLang = lang;
+            memset(glyphsUsed, 0, sizeof(glyphsUsed));
+
+            ensureLanguage(Core::settings.audio.language);
+            for (int i = 0; i < STR_MAX; i++) {
+                const char *str = STR[i];
+                if (!str) continue;
+                while (char c = *str++) {
+                    if (c != '\x11') continue;
+                    uint16 glyph;
+                    while ((glyph = getWideCharGlyph(str)) != 0xFFFF) {
+                        ASSERT(glyph < sizeof(glyphsUsed) * 8);
+                        glyphsUsed[glyph >> 5] |= 1 << (glyph & 31);
+                        str += 2;
+                    }
+                    str += 2;
+                }
+            }
+        }
+
+        return (glyphsUsed[index >> 5] & (1 << (index & 31))) != 0;
+    }
+#endif
+
     short2 getLineSize(const char *text) {
         int  x = 0;
 
@@ -553,6 +714,9 @@ namespace UI {
             delete pickups[i].animation;
         }
         pickups.clear();
+    #ifndef SPLIT_BY_TILE
+        freeGlyphPages();
+    #endif
     }
 
     void showHint(StringID str, float time) {
@@ -736,7 +900,11 @@ namespace UI {
 
     #ifdef UI_SHOW_FPS
         char buf[256];
-        sprintf(buf, "%d", Core::stats.fps);
+        if (Core::stats.scale != 100) {
+            sprintf(buf, "%d (%d%%)", Core::stats.fps, Core::stats.scale);
+        } else {
+            sprintf(buf, "%d", Core::stats.fps);
+        }
         textOut(vec2(0, 16), buf, aLeft, width, 255, UI::SHADE_ORANGE);
     #endif
     }
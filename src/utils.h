@@ -1673,6 +1673,207 @@ struct Array {
 };
 
 
+#define ARENA_ALIGN      16
+#define ARENA_BLOCK_SIZE (256 * 1024)
+#define ARENA_MAX_TAGS   16
+
+// linear allocator for the data with the same lifetime, all blocks are released at once
+struct Arena {
+    struct Block {
+        Block  *next;
+        uint32 size;
+        uint32 used;
+    };
+
+    Block  *blocks;
+    uint32 reserved;
+    uint32 tagSize[ARENA_MAX_TAGS];
+
+    Arena() : blocks(NULL), reserved(0) {
+        memset(tagSize, 0, sizeof(tagSize));
+    }
+
+    ~Arena() {
+        free();
+    }
+
+    Block* addBlock(uint32 size, bool current = true) {
+        Block *block = (Block*)malloc(sizeof(Block) + size + ARENA_ALIGN);
+        ASSERT(block);
+        block->size = size;
+        block->used = 0;
+        reserved   += size;
+
+        if (current || !blocks) {
+            block->next = blocks;
+            blocks = block;
+        } else { // keep filling the current block
+            block->next  = blocks->next;
+            blocks->next = block;
+        }
+        return block;
+    }
+
+// preallocate the first block (e.g. by the source file size)
+    void reserve(uint32 size) {
+        if (!blocks) {
+            addBlock(ALIGNADDR(size, ARENA_ALIGN));
+        }
+    }
+
+    void* alloc(uint32 size, int tag) {
+        ASSERT(tag >= 0 && tag < ARENA_MAX_TAGS);
+        if (!size) return NULL;
+
+        size = ALIGNADDR(size, ARENA_ALIGN);
+
+        Block *block = blocks;
+        if (!block || block->used + size > block->size) {
+        // big chunks get their own block
+            if (size > ARENA_BLOCK_SIZE / 2) {
+                block = addBlock(size, false);
+            } else {
+                block = addBlock(ARENA_BLOCK_SIZE);
+            }
+        }
+
+        uint8 *ptr = (uint8*)ALIGNADDR(size_t(block + 1), size_t(ARENA_ALIGN)) + block->used;
+        block->used  += size;
+        tagSize[tag] += size;
+
+        memset(ptr, 0, size);
+        return ptr;
+    }
+
+// zero-filled, constructors and destructors are not called
+    template <typename T>
+    T* alloc(int count, int tag) {
+        return (T*)alloc(uint32(count) * sizeof(T), tag);
+    }
+
+    void free() {
+        while (blocks) {
+            Block *next = blocks->next;
+            ::free(blocks);
+            blocks = next;
+        }
+        reserved = 0;
+        memset(tagSize, 0, sizeof(tagSize));
+    }
+
+    uint32 getUsed() {
+        uint32 used = 0;
+        for (int i = 0; i < ARENA_MAX_TAGS; i++) {
+            used += tagSize[i];
+        }
+        return used;
+    }
+};
+
+// fixed-size object pools with O(1) alloc/free, pages are never moved or released until clear
+struct PoolBase {
+    static PoolBase *first;
+
+    PoolBase    *next;
+    const char  *name;
+    int32       count;
+    int32       highWater;
+    int32       capacity;
+
+    PoolBase(const char *name) : name(name), count(0), highWater(0), capacity(0) {
+        next  = first;
+        first = this;
+    }
+};
+
+PoolBase *PoolBase::first = NULL;
+
+template <typename T, int N = 32>
+struct Pool : PoolBase {
+    union Slot {
+        Slot   *next;
+        uint64 align;
+        uint8  data[sizeof(T)];
+    };
+
+    struct Page {
+        Page *next;
+        Slot slots[N];
+    };
+
+    Page *pages;
+    Slot *freeSlots;
+
+    Pool(const char *name) : PoolBase(name), pages(NULL), freeSlots(NULL) {}
+
+    ~Pool() {
+        clear();
+    }
+
+    void* alloc() {
+        if (!freeSlots) {
+            Page *page = (Page*)malloc(sizeof(Page));
+            page->next = pages;
+            pages = page;
+            for (int i = 0; i < N; i++) {
+                page->slots[i].next = freeSlots;
+                freeSlots = page->slots + i;
+            }
+            capacity += N;
+        }
+
+        Slot *slot = freeSlots;
+        freeSlots = slot->next;
+
+        if (++count > highWater) {
+            highWater = count;
+        }
+
+        return slot;
+    }
+
+    void free(void *ptr) {
+        if (!ptr) return;
+        ASSERT(count > 0);
+        Slot *slot = (Slot*)ptr;
+        slot->next = freeSlots;
+        freeSlots = slot;
+        count--;
+    }
+
+    void clear() {
+        while (pages) {
+            Page *next = pages->next;
+            ::free(pages);
+            pages = next;
+        }
+        freeSlots = NULL;
+        capacity  = 0;
+    }
+};
+
+// class-specific new/delete backed by the type pool, T must be the declaring class
+// derived classes without their own pool don't fit the slots and fall back to the heap
+#define DECL_POOL(T, N)\
+    static Pool<T, N>& getPool() {\
+        static Pool<T, N> pool(#T);\
+        return pool;\
+    }\
+    void* operator new(size_t size) {\
+        if (size != sizeof(T)) return ::operator new(size);\
+        return getPool().alloc();\
+    }\
+    void operator delete(void *ptr, size_t size) {\
+        if (size != sizeof(T)) { ::operator delete(ptr); return; }\
+        getPool().free(ptr);\
+    }\
+    void checkPoolType() {\
+        typedef char PoolTypeCheck[sizeof(*this) == sizeof(T) ? 1 : -1];\
+        T *self = this;\
+        (void)self;\
+        (void)sizeof(PoolTypeCheck);\
+    }
+
 struct Stream;
 
 extern void osCacheWrite (Stream *stream);
@@ -2315,15 +2516,171 @@ public:
 Stream::Pack* Stream::packs[MAX_PACKS];
 Array<char*> Stream::fileList;
 
+// raw deflate encoder (LZ77 + fixed Huffman codes), output can be inflated with tinf_uncompress
+#define DEFLATE_WINDOW      32768
+#define DEFLATE_HASH_BITS   14
+#define DEFLATE_MAX_CHAIN   32
+#define DEFLATE_MIN_MATCH   3
+#define DEFLATE_MAX_MATCH   258
+
+namespace Deflate {
+
+    static const uint16 lengthBase[]  = { 3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31, 35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258 };
+    static const uint8  lengthExtra[] = { 0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2, 3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0 };
+    static const uint16 distBase[]    = { 1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129, 193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097, 6145, 8193, 12289, 16385, 24577 };
+    static const uint8  distExtra[]   = { 0, 0, 0, 0, 1, 1, 2, 2, 3, 3, 4, 4, 5, 5, 6, 6, 7, 7, 8, 8, 9, 9, 10, 10, 11, 11, 12, 12, 13, 13 };
+
+    struct BitWriter {
+        uint8  *ptr, *end;
+        uint32 bits;
+        int    count;
+        bool   overflow;
+
+        BitWriter(uint8 *data, int size) : ptr(data), end(data + size), bits(0), count(0), overflow(false) {}
+
+        void put(uint32 value, int n) {
+            bits  |= value << count;
+            count += n;
+            while (count >= 8) {
+                if (ptr < end)
+                    *ptr++ = uint8(bits);
+                else
+                    overflow = true;
+                bits  >>= 8;
+                count -= 8;
+            }
+        }
+
+    // Huffman codes are packed starting from the most significant bit
+        void putCode(uint32 code, int n) {
+            uint32 r = 0;
+            for (int i = 0; i < n; i++) {
+                r = (r << 1) | (code & 1);
+                code >>= 1;
+            }
+            put(r, n);
+        }
+
+        void flush() {
+            if (count > 0)
+                put(0, 8 - count);
+        }
+    };
+
+    void putSymbol(BitWriter &w, int c) {
+        if (c < 144)
+            w.putCode(0x30 + c, 8);
+        else if (c < 256)
+            w.putCode(0x190 + c - 144, 9);
+        else if (c < 280)
+            w.putCode(c - 256, 7);
+        else
+            w.putCode(0xC0 + c - 280, 8);
+    }
+
+    void putMatch(BitWriter &w, int length, int dist) {
+        int i = COUNT(lengthBase) - 1;
+        while (lengthBase[i] > length) i--;
+        putSymbol(w, 257 + i);
+        w.put(length - lengthBase[i], lengthExtra[i]);
+
+        i = COUNT(distBase) - 1;
+        while (distBase[i] > dist) i--;
+        w.putCode(i, 5);
+        w.put(dist - distBase[i], distExtra[i]);
+    }
+
+    inline uint32 hash(const uint8 *p) {
+        return ((p[0] << 16 | p[1] << 8 | p[2]) * 2654435761U) >> (32 - DEFLATE_HASH_BITS);
+    }
+
+// returns compressed size or -1 if the output doesn't fit into dstSize
+    int compress(const uint8 *src, int size, uint8 *dst, int dstSize) {
+        int32 *head = new int32[1 << DEFLATE_HASH_BITS];
+        int32 *prev = new int32[DEFLATE_WINDOW];
+        memset(head, 0xFF, sizeof(int32) << DEFLATE_HASH_BITS);
+
+        BitWriter w(dst, dstSize);
+        w.put(1, 1); // final block
+        w.put(1, 2); // fixed Huffman codes
+
+        int i = 0;
+        while (i < size && !w.overflow) {
+            int bestLen  = 0;
+            int bestDist = 0;
+
+            if (i + DEFLATE_MIN_MATCH <= size) {
+                int maxLen = min(DEFLATE_MAX_MATCH, size - i);
+                uint32 h   = hash(src + i);
+                int cand   = head[h];
+                int chain  = DEFLATE_MAX_CHAIN;
+
+                while (cand >= 0 && i - cand < DEFLATE_WINDOW && chain--) {
+                    if (src[cand + bestLen] == src[i + bestLen]) {
+                        int len = 0;
+                        while (len < maxLen && src[cand + len] == src[i + len])
+                            len++;
+                        if (len > bestLen) {
+                            bestLen  = len;
+                            bestDist = i - cand;
+                            if (len == maxLen) break;
+                        }
+                    }
+                    cand = prev[cand & (DEFLATE_WINDOW - 1)];
+                }
+
+                prev[i & (DEFLATE_WINDOW - 1)] = head[h];
+                head[h] = i;
+            }
+
+            if (bestLen >= DEFLATE_MIN_MATCH) {
+                putMatch(w, bestLen, bestDist);
+                for (int j = 1; j < bestLen; j++) {
+                    int k = i + j;
+                    if (k + DEFLATE_MIN_MATCH > size) break;
+                    uint32 h = hash(src + k);
+                    prev[k & (DEFLATE_WINDOW - 1)] = head[h];
+                    head[h] = k;
+                }
+                i += bestLen;
+            } else {
+                putSymbol(w, src[i]);
+                i++;
+            }
+        }
+
+        putSymbol(w, 256); // end of block
+        w.flush();
+
+        delete[] head;
+        delete[] prev;
+
+        return w.overflow ? -1 : int(w.ptr - dst);
+    }
+}
+
 #ifdef OS_FILEIO_CACHE
 void osDataWrite(Stream *stream, const char *dir) {
-    char path[255];
+    char path[255], tmp[255];
     strcpy(path, dir);
     strcat(path, stream->name);
-    FILE *f = fopen(path, "wb");
+// write into a temporary file and replace the old one only when it's complete
+    strcpy(tmp, path);
+    strcat(tmp, ".tmp");
+    FILE *f = fopen(tmp, "wb");
+    bool ok = false;
     if (f) {
-        fwrite(stream->data, 1, stream->size, f);
-        fclose(f);
+        ok = fwrite(stream->data, 1, stream->size, f) == size_t(stream->size);
+        ok = (fclose(f) == 0) && ok;
+    #ifdef _OS_WIN
+        ok = ok && MoveFileExA(tmp, path, MOVEFILE_REPLACE_EXISTING);
+    #else
+        ok = ok && rename(tmp, path) == 0;
+    #endif
+        if (!ok)
+            remove(tmp);
+    }
+    if (ok) {
         if (stream->callback)
             stream->callback(new Stream(stream->name, stream->data, stream->size), stream->userData);
     } else
@@ -793,7 +793,11 @@ struct Video {
         int   curVideoChunk;
         int   curAudioChunk;
 
+    #ifdef NO_SOUND
+        Sound::Decoder *audioDecoder;
+    #else
         Sound::XA *audioDecoder;
+    #endif
 
         struct {
             uint8 code;
@@ -853,8 +857,10 @@ struct Video {
         virtual ~STR()
         {
             OS_LOCK(Sound::lock);
-            audioDecoder->stream = NULL;
-            delete audioDecoder;
+            if (audioDecoder) {
+                audioDecoder->stream = NULL;
+                delete audioDecoder;
+            }
         }
 
         void buildLUT(uint8 *LUT, int start, int end, int shift)
@@ -1287,9 +1293,11 @@ struct Video {
                 }
             }
 
+        #ifndef NO_SOUND
             AudioChunk *chunk = audioChunks + (curAudioChunk % MAX_CHUNKS);
             ASSERT(chunk->size > 0);
             audioDecoder->processSector(chunk->data);
+        #endif
             return true;
         }
 